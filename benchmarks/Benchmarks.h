@@ -0,0 +1,24 @@
+#pragma once
+
+// Entry points of the benchmark subcommands; each returns the process exit code
+
+// Throughput of STLReader on generated ASCII STL files against the original line-based reader
+int runSTLReaderBenchmark(int argc, char* argv[]);
+
+// Vertex counts and meshing time of the cube, culled-face and greedy meshing of STL models
+int runVoxelMeshBenchmark(int argc, char* argv[]);
+
+// Check that refining a voxelization marks the same cells as voxelizing directly at the finer size
+int runRefineCheck(int argc, char* argv[]);
+
+// Check the cell counts of the sample meshes against pinned ones, on every traversal and kernel
+int runGridCheck(int argc, char* argv[]);
+
+// Check that the AVX2 and scalar separating axis kernels agree on random, degenerate and touching triangles
+int runSatCheck(int argc, char* argv[]);
+
+// Box-triangle tests per second of the separating axis kernels over triangles set up in advance
+int runSatBenchmark(int argc, char* argv[]);
+
+// Check that voxel files with damaged headers, directories and bricks are refused rather than read
+int runVoxelFileCheck(int argc, char* argv[]);
@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Benchmarks.h"
+#include "SampleMeshes.h"
+#include "Model/Voxelizer.h"
+
+namespace
+{
+    // Cells of the sample meshes as the single-precision tests mark them. A change of these counts is a change
+    // of which boundary cells count as touching, so it has to be deliberate.
+    struct ExpectedGrid
+    {
+        const char* filePath;
+        double voxelSize;
+        VoxelizerOptions::Fill fill;
+        size_t cells;
+    };
+
+    const ExpectedGrid expectedGrids[] = {
+        { "sample_sphere.stl", 2, VoxelizerOptions::Fill::Surface, 1736 },
+        { "sample_sphere.stl", 1, VoxelizerOptions::Fill::Surface, 6974 },
+        { "sample_sphere.stl", 0.5, VoxelizerOptions::Fill::Surface, 27962 },
+        { "sample_sphere.stl", 1, VoxelizerOptions::Fill::Solid, 33485 },
+        { "sample_offset_sphere.stl", 2, VoxelizerOptions::Fill::Surface, 2909 },
+        { "sample_offset_sphere.stl", 1, VoxelizerOptions::Fill::Surface, 11660 },
+        { "sample_offset_sphere.stl", 0.3, VoxelizerOptions::Fill::Surface, 130662 },
+        { "sample_offset_sphere.stl", 1, VoxelizerOptions::Fill::Solid, 71100 },
+        { "sample_torus.stl", 2, VoxelizerOptions::Fill::Surface, 2086 },
+        { "sample_torus.stl", 1, VoxelizerOptions::Fill::Surface, 8596 },
+        { "sample_torus.stl", 0.5, VoxelizerOptions::Fill::Surface, 34820 },
+        { "sample_torus.stl", 1, VoxelizerOptions::Fill::Solid, 25260 },
+        { "sample_thin_torus.stl", 1, VoxelizerOptions::Fill::Surface, 1782 },
+        { "sample_thin_torus.stl", 0.5, VoxelizerOptions::Fill::Surface, 7468 },
+        { "sample_thin_torus.stl", 0.25, VoxelizerOptions::Fill::Surface, 29904 },
+        { "sample_thin_torus.stl", 0.5, VoxelizerOptions::Fill::Solid, 20934 },
+    };
+
+    // The count of every path, which all make the same boundary decisions
+    size_t cellsOf(const ExpectedGrid& expected, VoxelizerOptions::Traversal traversal, bool vectorize, int threadCount)
+    {
+        VoxelizerOptions options;
+        options.fill = expected.fill;
+        options.traversal = traversal;
+        options.vectorize = vectorize;
+        options.threadCount = threadCount;
+        return Voxelizer::getVoxelizer(expected.filePath, expected.voxelSize, options)->grid().count();
+    }
+}
+
+int runGridCheck(int argc, char*[])
+{
+    if (argc > 0)
+    {
+        std::fprintf(stderr, "Usage: Benchmarks grid-check\n");
+        return 1;
+    }
+    std::vector<std::string> filePaths = writeSampleMeshes();
+    std::printf("%-26s %8s %6s %10s %10s %10s %10s %10s\n", "model", "fill", "size", "expected", "triangle", "cell", "scalar", "1 thread");
+    bool same = true;
+    for (const ExpectedGrid& expected : expectedGrids)
+    {
+        size_t cells[4] = {
+            cellsOf(expected, VoxelizerOptions::Traversal::TriangleDriven, true, 0),
+            cellsOf(expected, VoxelizerOptions::Traversal::CellDriven, true, 0),
+            cellsOf(expected, VoxelizerOptions::Traversal::TriangleDriven, false, 0),
+            cellsOf(expected, VoxelizerOptions::Traversal::TriangleDriven, true, 1),
+        };
+        std::printf("%-26s %8s %6g %10zu %10zu %10zu %10zu %10zu\n", expected.filePath, expected.fill == VoxelizerOptions::Fill::Solid ? "solid" : "surface",
+            expected.voxelSize, expected.cells, cells[0], cells[1], cells[2], cells[3]);
+        for (size_t count : cells)
+        {
+            same = same && count == expected.cells;
+        }
+    }
+    removeSampleMeshes(filePaths);
+    if (!same)
+    {
+        std::fprintf(stderr, "Cell counts differ from the expected ones\n");
+        return 1;
+    }
+    return 0;
+}
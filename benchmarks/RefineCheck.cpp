@@ -0,0 +1,104 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Benchmarks.h"
+#include "SampleMeshes.h"
+#include "Model/Voxelizer.h"
+
+namespace
+{
+    // Cells set in one grid and not the other; every cell when the dimensions differ
+    size_t differingCells(const VoxelGrid& refined, const VoxelGrid& direct)
+    {
+        if (refined.sizeX() != direct.sizeX() || refined.sizeY() != direct.sizeY() || refined.sizeZ() != direct.sizeZ())
+        {
+            return refined.count() + direct.count();
+        }
+        std::vector<unsigned long long> refinedLayer(refined.layerWords());
+        std::vector<unsigned long long> directLayer(direct.layerWords());
+        size_t differing = 0;
+        for (size_t i = 0; i < refined.sizeX(); i++)
+        {
+            refined.getLayer(i, refinedLayer.data());
+            direct.getLayer(i, directLayer.data());
+            for (size_t w = 0; w < refinedLayer.size(); w++)
+            {
+                unsigned long long bits = refinedLayer[w] ^ directLayer[w];
+                for (; bits != 0; bits &= bits - 1)
+                {
+                    differing++;
+                }
+            }
+        }
+        return differing;
+    }
+
+    // Refine levels times from voxelSize and compare every level with a direct run at its size
+    bool refinesLikeDirect(const std::string& filePath, double voxelSize, int levels)
+    {
+        const VoxelizerOptions::Fill fills[] = { VoxelizerOptions::Fill::Surface, VoxelizerOptions::Fill::Solid };
+        const char* names[] = { "surface", "solid" };
+        bool same = true;
+        for (int fill = 0; fill < 2; fill++)
+        {
+            VoxelizerOptions options;
+            options.fill = fills[fill];
+            Voxelizer::Ptr refined = Voxelizer::getVoxelizer(filePath, voxelSize, options);
+            for (int level = 0; level < levels; level++)
+            {
+                if (!refined->refine())
+                {
+                    std::fprintf(stderr, "Cannot refine %s\n", filePath.c_str());
+                    return false;
+                }
+                double size = refined->levelVoxelSize(refined->levelCount() - 1);
+                Voxelizer::Ptr direct = Voxelizer::getVoxelizer(filePath, size, options);
+                size_t differing = differingCells(refined->grid(), direct->grid());
+                std::printf("%-32s %8s %8g %8g %12zu %12zu %10zu\n", filePath.c_str(), names[fill], voxelSize, size,
+                    refined->grid().count(), direct->grid().count(), differing);
+                same = same && differing == 0;
+            }
+        }
+        return same;
+    }
+}
+
+int runRefineCheck(int argc, char* argv[])
+{
+    std::printf("%-32s %8s %8s %8s %12s %12s %10s\n", "model", "fill", "from", "to", "refined", "direct", "differing");
+    bool same = true;
+    if (argc == 0)
+    {
+        // Sizes that do not halve to round numbers, as well as ones that do
+        std::vector<std::string> filePaths = writeSampleMeshes();
+        for (const std::string& filePath : filePaths)
+        {
+            same = refinesLikeDirect(filePath, 4, 2) && same;
+            same = refinesLikeDirect(filePath, 2.4, 3) && same;
+            same = refinesLikeDirect(filePath, 3, 2) && same;
+        }
+        removeSampleMeshes(filePaths);
+    }
+    else
+    {
+        char* end = nullptr;
+        double voxelSize = std::strtod(argv[0], &end);
+        if (argc < 2 || end == argv[0] || *end != '\0' || !std::isfinite(voxelSize) || voxelSize <= 0)
+        {
+            std::fprintf(stderr, "Usage: Benchmarks refine-check [voxelSize file.stl ...]\n");
+            return 1;
+        }
+        for (int file = 1; file < argc; file++)
+        {
+            same = refinesLikeDirect(argv[file], voxelSize, 3) && same;
+        }
+    }
+    if (!same)
+    {
+        std::fprintf(stderr, "Refined grids differ from direct runs\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Benchmarks.h"
+#include "Model/Mesh.h"
+#include "Model/Point3D.h"
+#include "Model/STLReader.h"
+
+namespace
+{
+    // The ASCII reader STLReader used before the tokenizer: std::getline plus an istringstream per line
+    void readLineByLine(const std::string& filePath, std::vector<Point3D>& vertices, std::vector<Point3D>& normals)
+    {
+        std::ifstream dataFile(filePath);
+        std::string line;
+        while (std::getline(dataFile, line))
+        {
+            if (line.find("normal") != std::string::npos)
+            {
+                std::istringstream iss(line);
+                std::string token;
+                float x = 0;
+                float y = 0;
+                float z = 0;
+                iss >> token >> x >> y >> z;
+                Point3D normal(x, y, z);
+                normals.push_back(normal);
+                normals.push_back(normal);
+                normals.push_back(normal);
+            }
+            if (line.find("vertex") != std::string::npos)
+            {
+                Point3D corners[3];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    if (corner > 0)
+                    {
+                        std::getline(dataFile, line);
+                    }
+                    std::istringstream iss(line);
+                    std::string token;
+                    float x;
+                    float y;
+                    float z;
+                    iss >> token >> x >> y >> z;
+                    corners[corner] = Point3D(x, y, z);
+                }
+                vertices.push_back(corners[0]);
+                vertices.push_back(corners[1]);
+                vertices.push_back(corners[2]);
+                vertices.push_back(corners[0]);
+            }
+        }
+    }
+
+    // Write random facets until the file reaches the requested size
+    void writeAsciiSTL(const std::string& filePath, unsigned long long targetBytes)
+    {
+        FILE* file = std::fopen(filePath.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        std::mt19937 random(12345);
+        std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+
+        unsigned long long written = std::fprintf(file, "solid benchmark\n");
+        while (written < targetBytes)
+        {
+            float x = coordinate(random);
+            float y = coordinate(random);
+            float z = coordinate(random);
+            written += std::fprintf(file,
+                "  facet normal %e %e %e\n"
+                "    outer loop\n"
+                "      vertex %e %e %e\n"
+                "      vertex %e %e %e\n"
+                "      vertex %e %e %e\n"
+                "    endloop\n"
+                "  endfacet\n",
+                0.0f, 0.0f, 1.0f,
+                x, y, z,
+                x + offset(random), y + offset(random), z + offset(random),
+                x + offset(random), y + offset(random), z + offset(random));
+        }
+        written += std::fprintf(file, "endsolid benchmark\n");
+        std::fclose(file);
+    }
+
+    // True when the mesh holds the same triangles as the line loops p1, p2, p3, p1 of the old reader
+    bool sameTriangles(const Mesh& mesh, const std::vector<Point3D>& loops)
+    {
+        if (4 * mesh.triangleCount() != loops.size())
+        {
+            return false;
+        }
+        for (size_t t = 0; t < mesh.triangleCount(); t++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                if (!(mesh.corner(t, corner) == loops[4 * t + corner]))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int runSTLReaderBenchmark(int argc, char* argv[])
+{
+    std::vector<unsigned long long> sizesMB;
+    for (int i = 0; i < argc; i++)
+    {
+        sizesMB.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+    if (sizesMB.empty())
+    {
+        sizesMB = { 100, 500, 1000, 2000 };
+    }
+
+    std::printf("%10s %12s %14s %14s %9s %16s %16s\n", "size [MB]", "facets", "line [MB/s]", "mapped [MB/s]", "speedup", "line [B/facet]", "mesh [B/facet]");
+    for (unsigned long long sizeMB : sizesMB)
+    {
+        std::string filePath = "stl_read_benchmark_" + std::to_string(sizeMB) + "MB.stl";
+        writeAsciiSTL(filePath, sizeMB << 20);
+
+        std::vector<Point3D> lineVertices;
+        std::vector<Point3D> lineNormals;
+        auto start = std::chrono::steady_clock::now();
+        readLineByLine(filePath, lineVertices, lineNormals);
+        double lineSeconds = secondsSince(start);
+
+        Mesh mesh;
+        start = std::chrono::steady_clock::now();
+        IOOperation::STLReader reader(filePath, mesh);
+        double mappedSeconds = secondsSince(start);
+
+        if (!sameTriangles(mesh, lineVertices))
+        {
+            std::cerr << "Readers disagree on " << filePath << "\n";
+            std::remove(filePath.c_str());
+            return 1;
+        }
+
+        size_t facets = mesh.triangleCount();
+        size_t lineBytes = (lineVertices.size() + lineNormals.size()) * sizeof(Point3D);
+        std::printf("%10llu %12zu %14.1f %14.1f %8.1fx %16.1f %16.1f\n", sizeMB, facets,
+            sizeMB / lineSeconds, sizeMB / mappedSeconds, lineSeconds / mappedSeconds,
+            double(lineBytes) / facets, double(mesh.memoryBytes()) / facets);
+        std::remove(filePath.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include "SampleMeshes.h"
+
+namespace
+{
+    const double pi = 3.14159265358979323846;
+
+    // Write the surface of (u, v) in [0, 1] x [0, 1], split into segments x rings quads of two triangles each
+    bool writeSurface(const std::string& filePath, int segments, int rings, const std::function<void(double, double, float*)>& surface)
+    {
+        FILE* file = std::fopen(filePath.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        // A header of zeros, since one starting with "solid" would be read as ASCII
+        char header[80] = {};
+        uint32_t triangles = uint32_t(2 * segments * rings);
+        std::fwrite(header, 1, sizeof(header), file);
+        std::fwrite(&triangles, sizeof(triangles), 1, file);
+        for (int i = 0; i < segments; i++)
+        {
+            for (int j = 0; j < rings; j++)
+            {
+                float corners[4][3];
+                surface(double(i) / segments, double(j) / rings, corners[0]);
+                surface(double(i + 1) / segments, double(j) / rings, corners[1]);
+                surface(double(i + 1) / segments, double(j + 1) / rings, corners[2]);
+                surface(double(i) / segments, double(j + 1) / rings, corners[3]);
+                const int quad[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+                for (const int* triangle : quad)
+                {
+                    // Normal, three corners and the attribute byte count
+                    char facet[50] = {};
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        std::memcpy(facet + 12 * (corner + 1), corners[triangle[corner]], 12);
+                    }
+                    std::fwrite(facet, 1, sizeof(facet), file);
+                }
+            }
+        }
+        return std::fclose(file) == 0;
+    }
+
+    bool writeSphere(const std::string& filePath, double cx, double cy, double cz, double radius, int segments, int rings)
+    {
+        return writeSurface(filePath, segments, rings, [=](double u, double v, float* p) {
+            p[0] = float(cx + radius * std::sin(pi * v) * std::cos(2 * pi * u));
+            p[1] = float(cy + radius * std::sin(pi * v) * std::sin(2 * pi * u));
+            p[2] = float(cz + radius * std::cos(pi * v));
+        });
+    }
+
+    bool writeTorus(const std::string& filePath, double cx, double cy, double cz, double radius, double tube, int segments, int rings)
+    {
+        return writeSurface(filePath, segments, rings, [=](double u, double v, float* p) {
+            p[0] = float(cx + (radius + tube * std::cos(2 * pi * v)) * std::cos(2 * pi * u));
+            p[1] = float(cy + (radius + tube * std::cos(2 * pi * v)) * std::sin(2 * pi * u));
+            p[2] = float(cz + tube * std::sin(2 * pi * v));
+        });
+    }
+}
+
+std::vector<std::string> writeSampleMeshes()
+{
+    std::vector<std::string> filePaths;
+    if (writeSphere("sample_sphere.stl", 20, 20, 20, 19.3, 48, 24))
+    {
+        filePaths.push_back("sample_sphere.stl");
+    }
+    // Refining this one from 2.4 to 0.3 used to lose cells the direct run marks
+    if (writeSphere("sample_offset_sphere.stl", 100.5, 200.25, -50, 25, 80, 40))
+    {
+        filePaths.push_back("sample_offset_sphere.stl");
+    }
+    if (writeTorus("sample_torus.stl", 30, 30, 20, 22, 7, 96, 48))
+    {
+        filePaths.push_back("sample_torus.stl");
+    }
+    if (writeTorus("sample_thin_torus.stl", 0, 0, 0, 10, 3.3, 128, 64))
+    {
+        filePaths.push_back("sample_thin_torus.stl");
+    }
+    return filePaths;
+}
+
+void removeSampleMeshes(const std::vector<std::string>& filePaths)
+{
+    for (const std::string& filePath : filePaths)
+    {
+        std::remove(filePath.c_str());
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Closed meshes written as binary STL files for the check modes, so they run without model files.
+// Some lie far from the origin, where the single-precision tests round coarsely.
+
+// Function to write the sample meshes to the working directory and return their paths
+std::vector<std::string> writeSampleMeshes();
+
+// Function to delete the files of writeSampleMeshes
+void removeSampleMeshes(const std::vector<std::string>& filePaths);
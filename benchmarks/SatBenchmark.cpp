@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Benchmarks.h"
+#include "Model/SatKernel.h"
+
+namespace
+{
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Best of three runs of a batch of tests, which returns its hit count
+    template <typename Batch>
+    double bestSeconds(Batch batch, size_t& hits)
+    {
+        double best = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            hits = batch();
+            double seconds = secondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+        return best;
+    }
+}
+
+int runSatBenchmark(int argc, char* argv[])
+{
+    size_t triangleCount = argc > 0 ? std::strtoull(argv[0], nullptr, 10) : 100000;
+    size_t boxCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    if (triangleCount == 0 || boxCount == 0)
+    {
+        std::fprintf(stderr, "Usage: Benchmarks sat [triangles] [boxes per triangle]\n");
+        return 1;
+    }
+
+    // Triangles of about a voxel, as in a finely voxelized mesh, each against a row of boxes along z around it
+    const float voxelSize = 1.0f;
+    const Vec3f extent = { voxelSize * 0.5f, voxelSize * 0.5f, voxelSize * 0.5f };
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    std::vector<SatKernel::TriangleSetup> setups(triangleCount);
+    std::vector<Vec3f> firstCenters(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        Vec3f p1 = { coordinate(random), coordinate(random), coordinate(random) };
+        Vec3f p2 = p1 + Vec3f{ offset(random), offset(random), offset(random) };
+        Vec3f p3 = p1 + Vec3f{ offset(random), offset(random), offset(random) };
+        setups[t] = SatKernel::setupTriangle(p1, p2, p3, extent);
+        firstCenters[t] = { std::floor(p1.x) + 0.5f, std::floor(p1.y) + 0.5f, std::floor(p1.z) + 0.5f - boxCount / 2 };
+    }
+
+    // The same boxes as lower corners, laid out in advance so the row kernels time only the tests
+    size_t tests = triangleCount * boxCount;
+    std::vector<float> minX(tests);
+    std::vector<float> minY(tests);
+    std::vector<float> minZ(tests);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (size_t n = 0; n < boxCount; n++)
+        {
+            minX[t * boxCount + n] = firstCenters[t].x - extent.x;
+            minY[t * boxCount + n] = firstCenters[t].y - extent.y;
+            minZ[t * boxCount + n] = firstCenters[t].z + n * voxelSize - extent.z;
+        }
+    }
+    std::vector<unsigned char> rowHits(boxCount);
+
+    size_t hits[3] = {};
+    double seconds[3];
+    seconds[0] = bestSeconds([&]() {
+        size_t count = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            Vec3f center = firstCenters[t];
+            for (size_t n = 0; n < boxCount; n++, center.z += voxelSize)
+            {
+                count += SatKernel::boxIntersectsTriangle(setups[t], center);
+            }
+        }
+        return count;
+    }, hits[0]);
+    for (int vectorize = 0; vectorize < 2; vectorize++)
+    {
+        seconds[1 + vectorize] = bestSeconds([&]() {
+            size_t count = 0;
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                size_t row = t * boxCount;
+                SatKernel::triangleIntersectsBoxes(setups[t], &minX[row], &minY[row], &minZ[row], boxCount, voxelSize, rowHits.data(), vectorize == 1);
+                count += std::count(rowHits.begin(), rowHits.end(), 1);
+            }
+            return count;
+        }, hits[1 + vectorize]);
+    }
+
+    const char* names[] = { "boxIntersectsTriangle", "triangleIntersectsBoxes scalar", SatKernel::hasAvx2() ? "triangleIntersectsBoxes AVX2" : "triangleIntersectsBoxes (no AVX2)" };
+    std::printf("%-34s %12s %10s %10s %14s\n", "kernel", "tests", "hits", "time [ms]", "tests/s [M]");
+    for (int kernel = 0; kernel < 3; kernel++)
+    {
+        std::printf("%-34s %12zu %10zu %10.1f %14.1f\n", names[kernel], tests, hits[kernel], seconds[kernel] * 1000.0, tests / seconds[kernel] / 1e6);
+    }
+    return 0;
+}
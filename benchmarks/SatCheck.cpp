@@ -0,0 +1,236 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Benchmarks.h"
+#include "Model/SatKernel.h"
+
+namespace
+{
+    // Kinds of triangles placed around the boxes under test
+    enum class Placement
+    {
+        Random, // Corners anywhere within two boxes of the first one
+        Degenerate, // Two or three corners coinciding, or all three on a line
+        Touching, // Corners on the faces, edges and corners of a box, or the triangle in the plane of a face
+        FarFromOrigin // Random corners at coordinates up to 1e5, where float rounding is coarse
+    };
+
+    const char* placementNames[] = { "random", "degenerate", "touching", "far" };
+
+    struct Case
+    {
+        std::mt19937 random;
+        float size = 1;
+        Vec3f lower = { 0, 0, 0 }; // Lower corner of the first box
+
+        explicit Case(unsigned int seed) : random(seed)
+        {
+        }
+
+        float uniform(float from, float to)
+        {
+            return std::uniform_real_distribution<float>(from, to)(random);
+        }
+
+        int pick(int count)
+        {
+            return std::uniform_int_distribution<int>(0, count - 1)(random);
+        }
+
+        // Start a new case: a box size and a box on a lattice, as the voxelizer lays them
+        void reset(Placement placement)
+        {
+            const float sizes[] = { 0.25f, 0.5f, 1.0f, 2.4f, 3.0f, 0.3f };
+            size = sizes[pick(6)];
+            float scale = placement == Placement::FarFromOrigin ? 1e5f : 100.0f;
+            Vec3f origin = { uniform(-scale, scale), uniform(-scale, scale), uniform(-scale, scale) };
+            lower = { origin.x + pick(64) * size, origin.y + pick(64) * size, origin.z + pick(64) * size };
+        }
+
+        // A point of the first box: on a corner, an edge or a face, or inside it
+        Vec3f onBox()
+        {
+            float coordinates[3];
+            const float lows[3] = { lower.x, lower.y, lower.z };
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int where = pick(3);
+                coordinates[axis] = where == 0 ? lows[axis] : where == 1 ? lows[axis] + size : uniform(lows[axis], lows[axis] + size);
+            }
+            return { coordinates[0], coordinates[1], coordinates[2] };
+        }
+
+        Vec3f nearBox()
+        {
+            return { uniform(lower.x - 2 * size, lower.x + 3 * size), uniform(lower.y - 2 * size, lower.y + 3 * size), uniform(lower.z - 2 * size, lower.z + 3 * size) };
+        }
+
+        void triangle(Placement placement, Vec3f corners[3])
+        {
+            switch (placement)
+            {
+            case Placement::Random:
+            case Placement::FarFromOrigin:
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    corners[corner] = nearBox();
+                }
+                break;
+            case Placement::Degenerate:
+                corners[0] = pick(2) ? onBox() : nearBox();
+                corners[1] = pick(2) ? corners[0] : nearBox();
+                if (pick(2))
+                {
+                    corners[2] = pick(2) ? corners[0] : corners[1];
+                }
+                else
+                {
+                    // On the line through the first two, up to rounding
+                    corners[2] = corners[0] + (corners[1] - corners[0]) * uniform(-1.0f, 2.0f);
+                }
+                break;
+            case Placement::Touching:
+                corners[0] = onBox();
+                corners[1] = pick(2) ? onBox() : nearBox();
+                corners[2] = pick(2) ? onBox() : nearBox();
+                if (pick(4) == 0)
+                {
+                    // Flat in the plane of a face
+                    int axis = pick(3);
+                    float plane = (axis == 0 ? lower.x : axis == 1 ? lower.y : lower.z) + (pick(2) ? size : 0.0f);
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        (axis == 0 ? corners[corner].x : axis == 1 ? corners[corner].y : corners[corner].z) = plane;
+                    }
+                }
+                break;
+            }
+        }
+    };
+
+    struct Tally
+    {
+        size_t tests = 0;
+        size_t hits = 0;
+        size_t disagreements = 0;
+    };
+
+    // One triangle against a row of boxes along z, and a few boxes off the row, with both kernels
+    void checkBoxes(Case& check, Placement placement, Tally& tally)
+    {
+        Vec3f corners[3];
+        check.triangle(placement, corners);
+        float half = check.size * 0.5f;
+        SatKernel::TriangleSetup setup = SatKernel::setupTriangle(corners[0], corners[1], corners[2], { half, half, half });
+
+        // Long enough for whole groups of eight and a tail
+        size_t count = 1 + check.pick(37);
+        std::vector<float> minX(count);
+        std::vector<float> minY(count);
+        std::vector<float> minZ(count);
+        for (size_t n = 0; n < count; n++)
+        {
+            bool offRow = check.pick(4) == 0;
+            minX[n] = check.lower.x + (offRow ? (check.pick(5) - 2) * check.size : 0.0f);
+            minY[n] = check.lower.y + (offRow ? (check.pick(5) - 2) * check.size : 0.0f);
+            minZ[n] = check.lower.z + (float(n) - 2) * check.size;
+        }
+        std::vector<unsigned char> vectorized(count);
+        std::vector<unsigned char> scalar(count);
+        SatKernel::triangleIntersectsBoxes(setup, minX.data(), minY.data(), minZ.data(), count, check.size, vectorized.data(), true);
+        SatKernel::triangleIntersectsBoxes(setup, minX.data(), minY.data(), minZ.data(), count, check.size, scalar.data(), false);
+        for (size_t n = 0; n < count; n++)
+        {
+            tally.tests++;
+            tally.hits += scalar[n];
+            if (vectorized[n] != scalar[n])
+            {
+                tally.disagreements++;
+                if (tally.disagreements <= 5)
+                {
+                    std::fprintf(stderr, "triangleIntersectsBoxes: box (%.9g %.9g %.9g) size %g, triangle (%.9g %.9g %.9g) (%.9g %.9g %.9g) (%.9g %.9g %.9g): AVX2 %d, scalar %d\n",
+                        minX[n], minY[n], minZ[n], check.size, corners[0].x, corners[0].y, corners[0].z, corners[1].x, corners[1].y, corners[1].z,
+                        corners[2].x, corners[2].y, corners[2].z, vectorized[n], scalar[n]);
+                }
+            }
+        }
+    }
+
+    // One box against a list of triangles, whole or through indices, with both kernels
+    void checkTriangles(Case& check, Placement placement, Tally& tally)
+    {
+        float half = check.size * 0.5f;
+        size_t count = 1 + check.pick(20);
+        std::vector<SatKernel::TriangleSetup> setups(count);
+        for (SatKernel::TriangleSetup& setup : setups)
+        {
+            Vec3f corners[3];
+            check.triangle(placement, corners);
+            setup = SatKernel::setupTriangle(corners[0], corners[1], corners[2], { half, half, half });
+        }
+        std::vector<int> indices;
+        for (size_t n = 0; n < count; n++)
+        {
+            if (check.pick(2))
+            {
+                indices.push_back(int(count - 1 - n));
+            }
+        }
+
+        Point3D min(check.lower.x, check.lower.y, check.lower.z);
+        Point3D max(check.lower.x + check.size, check.lower.y + check.size, check.lower.z + check.size);
+        bool whole[2] = { SatKernel::boxIntersectsAny(min, max, setups.data(), nullptr, count, true), SatKernel::boxIntersectsAny(min, max, setups.data(), nullptr, count, false) };
+        bool listed[2] = { SatKernel::boxIntersectsAny(min, max, setups.data(), indices.data(), indices.size(), true),
+            SatKernel::boxIntersectsAny(min, max, setups.data(), indices.data(), indices.size(), false) };
+        tally.tests += 2;
+        tally.hits += whole[1] + listed[1];
+        if (whole[0] != whole[1] || listed[0] != listed[1])
+        {
+            tally.disagreements++;
+            if (tally.disagreements <= 5)
+            {
+                std::fprintf(stderr, "boxIntersectsAny: box (%.9g %.9g %.9g) size %g against %zu triangles: AVX2 %d %d, scalar %d %d\n",
+                    check.lower.x, check.lower.y, check.lower.z, check.size, count, whole[0], listed[0], whole[1], listed[1]);
+            }
+        }
+    }
+}
+
+int runSatCheck(int argc, char* argv[])
+{
+    unsigned long long cases = argc > 0 ? std::strtoull(argv[0], nullptr, 10) : 100000;
+    if (cases == 0)
+    {
+        std::fprintf(stderr, "Usage: Benchmarks sat-check [cases]\n");
+        return 1;
+    }
+    if (!SatKernel::hasAvx2())
+    {
+        std::fprintf(stderr, "AVX2 is not available, so there is no vectorized kernel to check\n");
+        return 0;
+    }
+
+    std::printf("%-12s %12s %12s %14s\n", "triangles", "tests", "hits", "disagreements");
+    bool same = true;
+    for (int kind = 0; kind < 4; kind++)
+    {
+        Placement placement = static_cast<Placement>(kind);
+        Case check(12345 + kind);
+        Tally tally;
+        for (unsigned long long n = 0; n < cases; n++)
+        {
+            check.reset(placement);
+            checkBoxes(check, placement, tally);
+            checkTriangles(check, placement, tally);
+        }
+        std::printf("%-12s %12zu %12zu %14zu\n", placementNames[kind], tally.tests, tally.hits, tally.disagreements);
+        same = same && tally.disagreements == 0;
+    }
+    if (!same)
+    {
+        std::fprintf(stderr, "The AVX2 and scalar kernels disagree\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include "Benchmarks.h"
+#include "SampleMeshes.h"
+#include "Model/Voxelizer.h"
+#include "Model/VoxelFile.h"
+
+using namespace IOOperation;
+
+namespace
+{
+    // A damage done to the bytes of a saved voxel file, which the reader has to refuse
+    struct Corruption
+    {
+        const char* name;
+        std::function<void(std::vector<char>&)> apply;
+    };
+
+    VoxelFileHeader headerOf(const std::vector<char>& bytes)
+    {
+        VoxelFileHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        return header;
+    }
+
+    void setHeader(std::vector<char>& bytes, const VoxelFileHeader& header)
+    {
+        std::memcpy(bytes.data(), &header, sizeof(header));
+    }
+
+    // Change the header through edit
+    std::function<void(std::vector<char>&)> patchHeader(const std::function<void(VoxelFileHeader&)>& edit)
+    {
+        return [edit](std::vector<char>& bytes) {
+            VoxelFileHeader header = headerOf(bytes);
+            edit(header);
+            setHeader(bytes, header);
+        };
+    }
+
+    // Position of the directory entry of the first chunk with bricks
+    size_t firstChunkEntry(const std::vector<char>& bytes)
+    {
+        VoxelFileHeader header = headerOf(bytes);
+        size_t entry = static_cast<size_t>(header.directoryOffset);
+        for (; entry + sizeof(unsigned long long) <= bytes.size(); entry += sizeof(unsigned long long))
+        {
+            unsigned long long offset;
+            std::memcpy(&offset, bytes.data() + entry, sizeof(offset));
+            if (offset != 0)
+            {
+                break;
+            }
+        }
+        return entry;
+    }
+
+    unsigned long long firstChunkOffset(const std::vector<char>& bytes)
+    {
+        unsigned long long offset;
+        std::memcpy(&offset, bytes.data() + firstChunkEntry(bytes), sizeof(offset));
+        return offset;
+    }
+
+    // Store value at the directory entry of the first chunk with bricks
+    std::function<void(std::vector<char>&)> patchEntry(unsigned long long value)
+    {
+        return [value](std::vector<char>& bytes) {
+            std::memcpy(bytes.data() + firstChunkEntry(bytes), &value, sizeof(value));
+        };
+    }
+
+    // Store value at offset bytes into the first chunk with bricks; its brick count comes first, then the
+    // brick y, the brick z and the encoding of the first brick
+    template <typename T>
+    std::function<void(std::vector<char>&)> patchChunk(size_t offset, T value)
+    {
+        return [offset, value](std::vector<char>& bytes) {
+            std::memcpy(bytes.data() + firstChunkOffset(bytes) + offset, &value, sizeof(value));
+        };
+    }
+
+    bool readBytes(const std::string& filePath, std::vector<char>& bytes)
+    {
+        FILE* file = std::fopen(filePath.c_str(), "rb");
+        if (!file)
+        {
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        bytes.resize(static_cast<size_t>(std::ftell(file)));
+        std::fseek(file, 0, SEEK_SET);
+        bool read = std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        std::fclose(file);
+        return read;
+    }
+
+    bool writeBytes(const std::string& filePath, const std::vector<char>& bytes)
+    {
+        FILE* file = std::fopen(filePath.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        return std::fclose(file) == 0 && written;
+    }
+}
+
+int runVoxelFileCheck(int argc, char*[])
+{
+    if (argc > 0)
+    {
+        std::fprintf(stderr, "Usage: Benchmarks voxel-file-check\n");
+        return 1;
+    }
+
+    // A saved sphere, which has to load back with all its cells before any damaged copy means anything
+    std::vector<std::string> filePaths = writeSampleMeshes();
+    Voxelizer::Ptr voxelizer = Voxelizer::getVoxelizer(filePaths.front(), 1.0);
+    const std::string savedPath = "sample_check.vox";
+    const std::string corruptPath = "sample_check_corrupt.vox";
+    std::vector<char> saved;
+    bool ready = voxelizer->saveVoxels(savedPath) && readBytes(savedPath, saved);
+    Voxelizer::Ptr loaded = ready ? Voxelizer::loadVoxelizer(savedPath) : nullptr;
+    std::remove(savedPath.c_str());
+    removeSampleMeshes(filePaths);
+    if (!loaded || loaded->grid().count() != voxelizer->grid().count())
+    {
+        std::fprintf(stderr, "The saved sphere does not load back\n");
+        return 1;
+    }
+
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double infinity = std::numeric_limits<double>::infinity();
+    const Corruption corruptions[] = {
+        { "zero size", patchHeader([](VoxelFileHeader& header) { header.size[1] = 0; }) },
+        { "wrapping size", patchHeader([](VoxelFileHeader& header) { header.size[1] = 1ULL << 33; header.size[2] = 1ULL << 33; }) },
+        { "huge size", patchHeader([](VoxelFileHeader& header) { header.size[0] = 1; header.size[1] = 1ULL << 40; header.size[2] = 1ULL << 20; }) },
+        { "NaN voxel size", patchHeader([nan](VoxelFileHeader& header) { header.voxelSize = nan; }) },
+        { "negative voxel size", patchHeader([](VoxelFileHeader& header) { header.voxelSize = -1; }) },
+        { "infinite origin", patchHeader([infinity](VoxelFileHeader& header) { header.origin[2] = infinity; }) },
+        { "directory past the end", patchHeader([](VoxelFileHeader& header) { header.directoryOffset += 1ULL << 32; }) },
+        { "directory in the header", patchHeader([](VoxelFileHeader& header) { header.directoryOffset = 8; }) },
+        { "truncated", [](std::vector<char>& bytes) { bytes.resize(bytes.size() / 2); } },
+        { "chunk in the header", patchEntry(16) },
+        { "chunk at the directory", patchEntry(headerOf(saved).directoryOffset) },
+        { "chunk near 2^64", patchEntry(0xFFFFFFFFFFFFFFFDULL) },
+        { "brick count past the end", patchChunk<unsigned int>(0, 0xFFFFFFFFu) },
+        { "brick y outside", patchChunk<unsigned int>(4, 0xFFFFFFFFu) },
+        { "brick z outside", patchChunk<unsigned int>(8, 1u << 20) },
+        { "unknown encoding", patchChunk<unsigned char>(12, 7) },
+    };
+
+    std::printf("%-28s %10s\n", "corruption", "result");
+    bool refused = true;
+    for (const Corruption& corruption : corruptions)
+    {
+        std::vector<char> bytes = saved;
+        corruption.apply(bytes);
+        if (!writeBytes(corruptPath, bytes))
+        {
+            std::fprintf(stderr, "Cannot write %s\n", corruptPath.c_str());
+            return 1;
+        }
+        bool loads = Voxelizer::loadVoxelizer(corruptPath) != nullptr;
+        std::printf("%-28s %10s\n", corruption.name, loads ? "loaded" : "refused");
+        refused = refused && !loads;
+    }
+    std::remove(corruptPath.c_str());
+    if (!refused)
+    {
+        std::fprintf(stderr, "A damaged voxel file was loaded\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "Benchmarks.h"
+#include "Model/Voxelizer.h"
+
+int runVoxelMeshBenchmark(int argc, char* argv[])
+{
+    char* end = nullptr;
+    double voxelSize = argc > 0 ? std::strtod(argv[0], &end) : 0.0;
+    if (argc < 2 || end == argv[0] || *end != '\0' || !std::isfinite(voxelSize) || voxelSize <= 0)
+    {
+        std::fprintf(stderr, "Usage: Benchmarks voxel-mesh voxelSize file.stl ...\n");
+        return 1;
+    }
+
+    const VoxelizerOptions::Meshing modes[] = { VoxelizerOptions::Meshing::Cubes, VoxelizerOptions::Meshing::CulledFaces, VoxelizerOptions::Meshing::Greedy, VoxelizerOptions::Meshing::Instances };
+    const char* names[] = { "cubes", "culled", "greedy", "instanced" };
+
+    std::printf("%-32s %10s %9s %14s %10s %12s %12s\n", "model", "voxels", "mode", "vertices", "reduction", "upload [MB]", "time [ms]");
+    for (int file = 1; file < argc; file++)
+    {
+        for (int mode = 0; mode < 4; mode++)
+        {
+            VoxelizerOptions options;
+            options.meshing = modes[mode];
+            Voxelizer::Ptr voxelizer = Voxelizer::getVoxelizer(argv[file], voxelSize, options);
+            voxelizer->vertices();
+            VoxelMeshStats stats = voxelizer->meshStats();
+            std::printf("%-32s %10zu %9s %14zu %9.1fx %12.2f %12.2f\n", argv[file], stats.voxelCount, names[mode],
+                stats.vertexCount, stats.reduction(), stats.bytes / 1048576.0, stats.seconds * 1000.0);
+        }
+    }
+    return 0;
+}
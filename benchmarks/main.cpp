@@ -0,0 +1,45 @@
+#include <cstring>
+#include <iostream>
+#include "Benchmarks.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2 && std::strcmp(argv[1], "stl-read") == 0)
+    {
+        return runSTLReaderBenchmark(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "voxel-mesh") == 0)
+    {
+        return runVoxelMeshBenchmark(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "refine-check") == 0)
+    {
+        return runRefineCheck(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "grid-check") == 0)
+    {
+        return runGridCheck(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "sat-check") == 0)
+    {
+        return runSatCheck(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "sat") == 0)
+    {
+        return runSatBenchmark(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "voxel-file-check") == 0)
+    {
+        return runVoxelFileCheck(argc - 2, argv + 2);
+    }
+
+    std::cerr << "Usage: Benchmarks <benchmark> [arguments]\n"
+              << "  stl-read [sizeMB ...]   ASCII STL parsing throughput (default 100 500 1000 2000 MB)\n"
+              << "  voxel-mesh voxelSize file.stl ...   Render vertices of each meshing mode\n"
+              << "  refine-check [voxelSize file.stl ...]   Refined against direct grids (default sample meshes)\n"
+              << "  grid-check   Cell counts of the sample meshes against the expected ones\n"
+              << "  sat-check [cases]   AVX2 against scalar box-triangle tests (default 100000 cases per kind)\n"
+              << "  sat [triangles] [boxes]   Box-triangle tests per second (default 100000 triangles, 64 boxes each)\n"
+              << "  voxel-file-check   Damaged voxel files are refused\n";
+    return 1;
+}
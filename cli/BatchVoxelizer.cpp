@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include "BatchVoxelizer.h"
+#include "Model/STLWriter.h"
+#include "Model/StreamingVoxelizer.h"
+#include "Model/VoxelFile.h"
+#include "Model/ThreadPool.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool isStlFile(const fs::path& path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".stl";
+    }
+
+    // Output name of an input without extension: part.stl becomes part
+    std::string outputName(const fs::path& relative)
+    {
+        fs::path output = relative;
+        output.replace_extension();
+        return output.generic_string();
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A CSV field in quotes, with the quotes inside doubled
+    std::string quoted(const std::string& text)
+    {
+        std::string field = "\"";
+        for (char c : text)
+        {
+            field += c;
+            if (c == '"')
+            {
+                field += '"';
+            }
+        }
+        return field + '"';
+    }
+}
+
+BatchVoxelizer::BatchVoxelizer(const BatchSettings& settings) : mSettings(settings)
+{
+}
+
+bool BatchVoxelizer::addInput(const std::string& path)
+{
+    std::error_code error;
+    fs::path root(path);
+    if (fs::is_regular_file(root, error))
+    {
+        mInputs.push_back({ path, uniqueOutput(outputName(root.filename())) });
+        return true;
+    }
+    if (!fs::is_directory(root, error))
+    {
+        return false;
+    }
+
+    // Keep the layout below the directory, so equal file names in different folders of it do not collide
+    std::vector<fs::path> files;
+    for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->is_regular_file(error) && isStlFile(it->path()))
+        {
+            files.push_back(it->path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const fs::path& file : files)
+    {
+        mInputs.push_back({ file.string(), uniqueOutput(outputName(file.lexically_relative(root))) });
+    }
+    return true;
+}
+
+std::string BatchVoxelizer::uniqueOutput(const std::string& output)
+{
+    // Compared without case, as output directories on Windows and macOS are case-insensitive
+    auto key = [](std::string name) {
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return name;
+    };
+    std::string unique = output;
+    for (int n = 2; !mOutputs.insert(key(unique)).second; n++)
+    {
+        unique = output + "_" + std::to_string(n);
+    }
+    return unique;
+}
+
+bool BatchVoxelizer::addInputList(const std::string& listPath)
+{
+    std::ifstream list(listPath);
+    if (!list)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(list, line))
+    {
+        // Tolerate CRLF lists and blank lines
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+        {
+            line.pop_back();
+        }
+        if (!line.empty() && !addInput(line))
+        {
+            std::fprintf(stderr, "Skipping missing input %s\n", line.c_str());
+        }
+    }
+    return true;
+}
+
+size_t BatchVoxelizer::fileCount() const
+{
+    return mInputs.size();
+}
+
+std::vector<BatchResult> BatchVoxelizer::run()
+{
+    // Split the hardware threads among the files running at once, unless a count per file was given
+    int jobCount = mSettings.jobCount > 0 ? mSettings.jobCount : ThreadPool::defaultThreadCount();
+    jobCount = static_cast<int>(std::max<size_t>(1, std::min<size_t>(jobCount, mInputs.size())));
+    int threadCount = mSettings.options.threadCount > 0 ? mSettings.options.threadCount : std::max(1, ThreadPool::defaultThreadCount() / jobCount);
+
+    std::vector<BatchResult> results(mInputs.size());
+    std::mutex printMutex;
+    size_t finished = 0;
+    ThreadPool pool(jobCount);
+    pool.run(mInputs.size(), [&](size_t file, int) {
+        results[file] = process(mInputs[file], threadCount);
+
+        const BatchResult& result = results[file];
+        std::lock_guard<std::mutex> lock(printMutex);
+        finished++;
+        if (result.succeeded)
+        {
+            std::printf("[%zu/%zu] %s: %zu triangles, %zu voxels%s, %zu vertices, %.3f s voxelize, %.3f s mesh, %.3f s write\n",
+                finished, results.size(), result.input.c_str(), result.triangleCount, result.voxelCount, result.reused ? " (reused)" : "",
+                result.vertexCount, result.voxelizeSeconds, result.meshSeconds, result.writeSeconds);
+        }
+        else
+        {
+            std::printf("[%zu/%zu] %s: failed, %s\n", finished, results.size(), result.input.c_str(), result.error.c_str());
+        }
+        std::fflush(stdout);
+    });
+    return results;
+}
+
+BatchResult BatchVoxelizer::process(const Input& input, int threadCount) const
+{
+    BatchResult result;
+    result.input = input.path;
+    if (mSettings.memoryBudget > 0)
+    {
+        processStreaming(input, threadCount, result);
+        return result;
+    }
+    result.output = (fs::path(mSettings.outputDirectory) / (input.output + ".voxels.stl")).string();
+    std::string voxelPath = (fs::path(mSettings.outputDirectory) / (input.output + ".vox")).string();
+    std::error_code error;
+    fs::create_directories(fs::path(result.output).parent_path(), error);
+
+    VoxelizerOptions options = mSettings.options;
+    options.threadCount = threadCount;
+    Voxelizer::Ptr voxelizer;
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (mSettings.reuseVoxels && isReusable(input, voxelPath))
+        {
+            voxelizer = Voxelizer::loadVoxelizer(voxelPath, options);
+            result.reused = voxelizer != nullptr;
+        }
+        if (!result.reused)
+        {
+            voxelizer = Voxelizer::getVoxelizer(input.path, mSettings.voxelSize, options);
+            result.triangleCount = voxelizer->mesh().triangleCount();
+            if (result.triangleCount == 0)
+            {
+                result.error = "no triangles read";
+                return result;
+            }
+        }
+        result.voxelizeSeconds = secondsSince(start);
+
+        // Keep the voxels for later runs before the quads are built
+        start = std::chrono::steady_clock::now();
+        if (!result.reused && !voxelizer->saveVoxels(voxelPath))
+        {
+            result.error = "cannot write " + voxelPath;
+            return result;
+        }
+        result.writeSeconds = secondsSince(start);
+
+        // The geometry keeps the quads alive after the voxelizer is released, without copying them
+        VoxelGeometry geometry = voxelizer->geometry();
+        VoxelMeshStats stats = voxelizer->meshStats();
+        result.voxelCount = stats.voxelCount;
+        result.vertexCount = stats.vertexCount;
+        result.meshSeconds = stats.seconds;
+        voxelizer.reset();
+
+        start = std::chrono::steady_clock::now();
+        if (!IOOperation::STLWriter::writeQuads(result.output, *geometry.vertices))
+        {
+            result.error = "cannot write " + result.output;
+            return result;
+        }
+        result.writeSeconds += secondsSince(start);
+        result.succeeded = true;
+    }
+    catch (const std::exception& exception)
+    {
+        // A file too large for memory fails on its own instead of ending the whole batch
+        voxelizer.reset();
+        result.error = exception.what();
+    }
+    return result;
+}
+
+void BatchVoxelizer::processStreaming(const Input& input, int threadCount, BatchResult& result) const
+{
+    result.output = (fs::path(mSettings.outputDirectory) / (input.output + ".vox")).string();
+    if (mSettings.reuseVoxels && isReusable(input, result.output))
+    {
+        // The file can still change or vanish after isReusable looked at it; then it is voxelized again
+        IOOperation::VoxelFileReader reader;
+        if (reader.open(result.output))
+        {
+            result.voxelCount = static_cast<size_t>(reader.header().voxelCount);
+            result.reused = true;
+            result.succeeded = true;
+            return;
+        }
+    }
+    std::error_code error;
+    fs::create_directories(fs::path(result.output).parent_path(), error);
+
+    VoxelizerOptions options = mSettings.options;
+    options.threadCount = threadCount;
+    StreamingVoxelizer voxelizer(mSettings.memoryBudget, options);
+    auto start = std::chrono::steady_clock::now();
+    result.succeeded = voxelizer.run(input.path, mSettings.voxelSize, result.output);
+    result.voxelizeSeconds = secondsSince(start);
+    result.error = voxelizer.error();
+
+    StreamingStats stats = voxelizer.stats();
+    result.triangleCount = stats.triangleCount;
+    result.voxelCount = static_cast<size_t>(stats.voxelCount);
+}
+
+bool BatchVoxelizer::isReusable(const Input& input, const std::string& voxelPath) const
+{
+    // A voxel file older than its input may hold the voxels of an earlier version of the mesh
+    std::error_code error;
+    fs::file_time_type voxelTime = fs::last_write_time(voxelPath, error);
+    if (error || voxelTime < fs::last_write_time(input.path, error) || error)
+    {
+        return false;
+    }
+    IOOperation::VoxelFileReader reader;
+    if (!reader.open(voxelPath))
+    {
+        return false;
+    }
+    unsigned int flags = mSettings.options.fill == VoxelizerOptions::Fill::Solid ? IOOperation::voxelFileSolid : 0;
+    return reader.header().voxelSize == mSettings.voxelSize && reader.header().flags == flags;
+}
+
+bool BatchVoxelizer::writeStats(const std::string& filePath, const std::vector<BatchResult>& results)
+{
+    std::ofstream file(filePath, std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+    file << "input,output,status,reused,triangles,voxels,vertices,voxelize_s,mesh_s,write_s,error\n";
+    for (const BatchResult& result : results)
+    {
+        file << quoted(result.input) << ',' << quoted(result.output) << ',' << (result.succeeded ? "ok" : "failed")
+             << ',' << (result.reused ? 1 : 0) << ',' << result.triangleCount << ',' << result.voxelCount << ',' << result.vertexCount
+             << ',' << result.voxelizeSeconds << ',' << result.meshSeconds << ',' << result.writeSeconds << ',' << quoted(result.error) << '\n';
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <set>
+#include <string>
+#include <vector>
+#include "Model/Voxelizer.h"
+
+// Settings of a batch run
+struct BatchSettings
+{
+    double voxelSize = 1.0;
+    std::string outputDirectory = "."; // Results are written below this directory
+    int jobCount = 0; // Files voxelized at once; 0 uses every hardware thread
+    size_t memoryBudget = 0; // Bytes per file for out-of-core voxelization into a voxel file; 0 voxelizes in memory
+    bool reuseVoxels = false; // Load the voxel file of an earlier run instead of voxelizing, when it is newer than the input and has the same settings
+    VoxelizerOptions options; // Settings of each voxelization; threadCount 0 splits the hardware threads among the jobs
+};
+
+// Outcome and timings of one input file
+struct BatchResult
+{
+    std::string input;
+    std::string output;
+    bool succeeded = false;
+    bool reused = false; // The voxels came from the voxel file of an earlier run
+    std::string error; // Reason of a failure
+    size_t triangleCount = 0; // 0 when the voxels were reused
+    size_t voxelCount = 0;
+    size_t vertexCount = 0; // Vertices of the written quads
+    double voxelizeSeconds = 0.0; // Reading the STL file and marking the cells
+    double meshSeconds = 0.0; // Building the quads
+    double writeSeconds = 0.0; // Writing the output file
+};
+
+// Voxelizes many STL files with only the Model layer: a bounded number of files run at once and
+// each writes its voxel file and its greedy-meshed voxel surface as a binary STL file next to a CSV
+// of per-file timings. With a memory budget the files are streamed out of core instead and only
+// written as voxel files.
+class BatchVoxelizer
+{
+public:
+    explicit BatchVoxelizer(const BatchSettings& settings);
+
+    // Add an STL file, or every *.stl file below a directory; returns false when the path does not exist
+    bool addInput(const std::string& path);
+
+    // Add the paths listed in a text file, one per line; returns false when the list cannot be read
+    bool addInputList(const std::string& listPath);
+
+    size_t fileCount() const;
+
+    // Voxelize every file, printing one line per finished file; results are in input order
+    std::vector<BatchResult> run();
+
+    // Write the results as CSV; returns false when the file cannot be written
+    static bool writeStats(const std::string& filePath, const std::vector<BatchResult>& results);
+
+private:
+    // An input file and where its result goes, relative to the output directory and without extension
+    struct Input
+    {
+        std::string path;
+        std::string output;
+    };
+
+    // The output name, or with _2, _3 and so on appended when an earlier input already writes to it
+    std::string uniqueOutput(const std::string& output);
+
+    // Whether the voxel file of an earlier run can stand in for voxelizing the input
+    bool isReusable(const Input& input, const std::string& voxelPath) const;
+
+    // Voxelize one file out of core into a voxel file
+    void processStreaming(const Input& input, int threadCount, BatchResult& result) const;
+
+    // Voxelize one file with the given number of threads
+    BatchResult process(const Input& input, int threadCount) const;
+
+private:
+    BatchSettings mSettings;
+    std::vector<Input> mInputs;
+    std::set<std::string> mOutputs; // Output names of mInputs in lower case
+};
@@ -0,0 +1,154 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include "BatchVoxelizer.h"
+
+namespace
+{
+    int usage()
+    {
+        std::fprintf(stderr,
+            "Usage: VoxelizeCLI [options] voxelSize input ...\n"
+            "  input             STL file, or directory searched recursively for *.stl\n"
+            "  -o directory      Output directory (default: current directory)\n"
+            "  -l list.txt       Read further inputs from a file, one per line\n"
+            "  -j jobs           Files voxelized at once (default: hardware threads)\n"
+            "  -t threads        Threads per file (default: hardware threads / jobs)\n"
+            "  --solid           Fill the inside of the meshes\n"
+            "  --meshing mode    cubes, culled or greedy (default: greedy)\n"
+            "  --budget MB       Voxelize out of core within this much memory per file and write\n"
+            "                    only <name>.vox voxel files (surface fill only)\n"
+            "  --reuse           Load <name>.vox of an earlier run instead of voxelizing when it is\n"
+            "                    newer than the input and has the same voxel size and fill\n"
+            "Writes <name>.vox and <name>.voxels.stl per input and voxelize_stats.csv to the output directory.\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BatchSettings settings;
+    std::vector<std::string> inputs;
+    std::vector<std::string> lists;
+    bool hasVoxelSize = false;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        bool hasValue = arg + 1 < argc;
+        if (std::strcmp(argv[arg], "-o") == 0 && hasValue)
+        {
+            settings.outputDirectory = argv[++arg];
+        }
+        else if (std::strcmp(argv[arg], "-l") == 0 && hasValue)
+        {
+            lists.push_back(argv[++arg]);
+        }
+        else if (std::strcmp(argv[arg], "-j") == 0 && hasValue)
+        {
+            settings.jobCount = std::atoi(argv[++arg]);
+        }
+        else if (std::strcmp(argv[arg], "-t") == 0 && hasValue)
+        {
+            settings.options.threadCount = std::atoi(argv[++arg]);
+        }
+        else if (std::strcmp(argv[arg], "--budget") == 0 && hasValue)
+        {
+            settings.memoryBudget = static_cast<size_t>(std::atoll(argv[++arg])) << 20;
+        }
+        else if (std::strcmp(argv[arg], "--reuse") == 0)
+        {
+            settings.reuseVoxels = true;
+        }
+        else if (std::strcmp(argv[arg], "--solid") == 0)
+        {
+            settings.options.fill = VoxelizerOptions::Fill::Solid;
+        }
+        else if (std::strcmp(argv[arg], "--meshing") == 0 && hasValue)
+        {
+            std::string mode = argv[++arg];
+            if (mode == "cubes")
+            {
+                settings.options.meshing = VoxelizerOptions::Meshing::Cubes;
+            }
+            else if (mode == "culled")
+            {
+                settings.options.meshing = VoxelizerOptions::Meshing::CulledFaces;
+            }
+            else if (mode == "greedy")
+            {
+                settings.options.meshing = VoxelizerOptions::Meshing::Greedy;
+            }
+            else
+            {
+                return usage();
+            }
+        }
+        else if (argv[arg][0] == '-')
+        {
+            return usage();
+        }
+        else if (!hasVoxelSize)
+        {
+            char* end = nullptr;
+            settings.voxelSize = std::strtod(argv[arg], &end);
+            hasVoxelSize = true;
+            if (end == argv[arg] || *end != '\0')
+            {
+                return usage();
+            }
+        }
+        else
+        {
+            inputs.push_back(argv[arg]);
+        }
+    }
+    if (!hasVoxelSize || !std::isfinite(settings.voxelSize) || settings.voxelSize <= 0.0 || (inputs.empty() && lists.empty()))
+    {
+        return usage();
+    }
+
+    BatchVoxelizer batch(settings);
+    for (const std::string& input : inputs)
+    {
+        if (!batch.addInput(input))
+        {
+            std::fprintf(stderr, "Skipping missing input %s\n", input.c_str());
+        }
+    }
+    for (const std::string& list : lists)
+    {
+        if (!batch.addInputList(list))
+        {
+            std::fprintf(stderr, "Cannot read input list %s\n", list.c_str());
+        }
+    }
+    if (batch.fileCount() == 0)
+    {
+        std::fprintf(stderr, "No STL files found\n");
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(settings.outputDirectory, error);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = batch.run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    for (const BatchResult& result : results)
+    {
+        failed += result.succeeded ? 0 : 1;
+    }
+    std::string statsPath = (std::filesystem::path(settings.outputDirectory) / "voxelize_stats.csv").string();
+    if (!BatchVoxelizer::writeStats(statsPath, results))
+    {
+        std::fprintf(stderr, "Cannot write %s\n", statsPath.c_str());
+    }
+    std::printf("%zu files, %zu failed, %.2f s (%.2f files/s)\n", results.size(), failed, seconds, results.size() / seconds);
+    return failed == 0 ? 0 : 1;
+}
@@ -5,12 +5,17 @@
 #include <QPushButton>
 #include <QFileDialog>
 #include <QSpinBox>
+#include <QCheckBox>
+#include <QProgressBar>
 #include <QColorDialog>
+#include <QElapsedTimer>
 #include <qopenglshaderprogram.h>
 #include <qlabel.h>
 #include "Model/Triangle.h" 
+#include "Model/VoxelGeometry.h" // Including header file for VoxelGeometry struct
 
 class OpenGLWindow;
+class VoxelizationJob;
 
 class Visualizer : public QMainWindow
 {
@@ -44,9 +49,15 @@ private:
     QPushButton* mRenderButton; 
     QPushButton* mVoxelizeButton; 
     QPushButton* mColorDialogButton; 
-    QSpinBox* mSpinBox;
+    QPushButton* mSaveButton; // Writes the shown voxels to a voxel file
+    QDoubleSpinBox* mSpinBox;
+    QCheckBox* mInstancedCheckBox; // Draw one instanced cube per voxel instead of quads
     QLabel* mSizeLabel; 
+    QProgressBar* mProgressBar; // Progress of the background voxelization
+    QLabel* mFrameTimeLabel; // Time the last frame took to draw, in the status bar
     OpenGLWindow* mRenderer; 
+    VoxelizationJob* mVoxelizationJob; // Voxelizes off the GUI thread
+    QElapsedTimer mVoxelizationTimer; // Time since the running voxelization was requested
     QGridLayout* mGridLayout;
     QOpenGLShaderProgram* mProgram;  
 
@@ -55,7 +66,7 @@ private:
     void setRandomBackgroundColor(QPushButton* button);
 
     // Function to set random background color for spin box
-    void setRandomBackgroundColor(QSpinBox* spinBox);
+    void setRandomBackgroundColor(QDoubleSpinBox* spinBox);
 
     // Function to open file dialog
     void openFileDialog();
@@ -65,4 +76,25 @@ private:
 
     // Function to voxelize STL file
     void voxelizeSTL();
+
+    // Function to load a voxel file in the background and show it
+    void loadVoxels();
+
+    // Function to save the shown voxels to a voxel file
+    void saveVoxels();
+
+    // Function to choose the geometry of the next request from the instanced check box and the renderer
+    void updateMeshing();
+
+    // Function to show a coarser level while the background voxelization refines it
+    void voxelizationPreview(const VoxelGeometry& geometry);
+
+    // Function to show the result of the background voxelization
+    void voxelizationFinished(const VoxelGeometry& geometry);
+
+    // Function to report a voxelization or voxel file that produced no voxels
+    void voxelizationFailed(const QString& reason);
+
+    // Function to drop the running voxelization, e.g. when its voxel size is no longer wanted
+    void cancelVoxelization();
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Model/VoxelCache.h"
+
+class QThread;
+
+// Runs voxelizations on background threads and hands the cube geometry back on the GUI thread.
+// Only the latest request counts: starting a new one or calling cancel() stops the running request
+// without waiting for it, and whatever it still produces is dropped.
+// Results go through a VoxelCache, so asking again for a file and voxel size seen before is served
+// from memory or from the cache directory instead of voxelizing again. Anything else is voxelized
+// coarse to fine: a few times coarser first, then refined level by level with a preview of each, and
+// a later request for a power-of-two fraction of the last size refines the last result further.
+class VoxelizationJob : public QObject
+{
+    Q_OBJECT
+
+signals:
+    // Fraction of the current request that is done
+    void progress(double fraction);
+
+    // Geometry of a coarser level of the current request, shown while the finer levels are made
+    void preview(const VoxelGeometry& geometry);
+
+    // Geometry of the current request, once it is complete
+    void finished(const VoxelGeometry& geometry);
+
+    // The current request produced no grid, e.g. because its voxel file is malformed
+    void failed(const QString& reason);
+
+public:
+    explicit VoxelizationJob(QObject* parent = nullptr);
+
+    // Cancels every request and waits for their threads, so none reports to a deleted job
+    ~VoxelizationJob();
+
+    // Start voxelizing the STL file, replacing any request still running
+    void start(const std::string& fileName, double voxelSize);
+
+    // Start loading a voxel file written by save() or the batch voxelizer, replacing any request still running
+    void load(const std::string& voxelFileName);
+
+    // Stop the current request; nothing more is reported for it
+    void cancel();
+
+    bool isRunning() const;
+
+    // Whether a finished request left a grid that save() can write
+    bool hasResult() const;
+
+    // Write the grid of the last finished request to a voxel file; returns false when there is none or the write fails
+    bool save(const std::string& voxelFileName) const;
+
+    // Choose the geometry later requests hand back, e.g. Instances when the view can draw instanced cubes
+    void setMeshing(VoxelizerOptions::Meshing meshing);
+
+    // Change the caps of the result cache in bytes
+    void setCacheBudgets(size_t memoryBudget, unsigned long long diskBudget);
+
+    // Hit and miss counters and size of the result cache
+    VoxelCacheStats cacheStats() const;
+
+private:
+    // Run make on a new thread with the options and id of a new request and report its grid and geometry
+    void run(const std::function<std::shared_ptr<const Voxelizer>(const VoxelizerOptions&, quint64)>& make);
+
+    // Voxelize coarse to fine on the thread of a request, starting from previous when it is given
+    std::shared_ptr<const Voxelizer> voxelize(const std::string& fileName, double voxelSize, std::shared_ptr<Voxelizer> previous, const VoxelizerOptions& options, quint64 request);
+
+    // Post the geometry of a coarser level from the thread of a request
+    void postPreview(quint64 request, const Voxelizer& voxelizer);
+
+    // Post the voxelizer a request refined or was cancelled refining, so a later request can refine it further
+    void postRefinable(quint64 request, const std::string& fileName, const std::shared_ptr<Voxelizer>& voxelizer);
+
+    // Called on the GUI thread when the thread of a request ends
+    void threadFinished(QThread* thread);
+
+private:
+    quint64 mRequest = 0; // Id of the current request; results of other ids are stale
+    std::shared_ptr<std::atomic<bool>> mCancel; // Cancellation flag of the current request
+    QList<QThread*> mThreads; // Threads still running, including cancelled ones
+    std::shared_ptr<const Voxelizer> mResult; // Voxelizer of the last finished request
+    std::unique_ptr<VoxelCache> mCache; // Results of earlier requests; outlives the threads, which the destructor joins
+    std::shared_ptr<Voxelizer> mRefinable; // Unfrozen voxelizer of the last finished voxelization, owned by no thread
+    std::string mRefinableFile; // STL file of mRefinable
+    VoxelizerOptions::Meshing mMeshing = VoxelizerOptions::Meshing::Greedy; // Geometry of new requests
+};
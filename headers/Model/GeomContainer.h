@@ -1,37 +1,49 @@
 #pragma once
+#include <memory>
 #include <vector>
 #include "Model/Point3D.h" // Including header file for Point3D class
+#include "Model/Mesh.h" // Including header file for Mesh class
 
 class GeomContainer {
 public:
-	static GeomContainer* getContainer();
+	static std::unique_ptr<GeomContainer> getContainer();
 
-	static GeomContainer* getContainer(std::vector<Point3D> inPoints);
+	// The mesh must outlive the container
+	static std::unique_ptr<GeomContainer> getContainer(const Mesh& inMesh);
 
-	// Function to create vertices for triangles
+	// Function to create vertices and edge indices for the triangles of the mesh
 	void makeTriangleVertices();
 
 	// Function to create vertices for quads (four-sided polygons)
 	void makeQuadVertices(const Point3D& p1, const Point3D& p2, const Point3D& p3, const Point3D& p4);
 
-	std::vector<float> vertices();
+	const std::vector<float>& vertices() const;
 
-	std::vector<float> colors();
+	const std::vector<float>& colors() const;
 
-	std::vector<float> normals();
+	const std::vector<float>& normals() const;
+
+	// Two vertex indices per triangle edge, for drawing with GL_LINES
+	const std::vector<unsigned int>& indices() const;
+
+	// Functions to hand the vertices or the edge indices over to the caller, leaving them empty here
+	std::vector<float> releaseVertices();
+
+	std::vector<unsigned int> releaseIndices();
 
 private:
 	// Private default constructor
 	GeomContainer();
 
-	// Private constructor with initial points
-	GeomContainer(std::vector<Point3D> inPoints);
+	// Private constructor with the mesh to display
+	GeomContainer(const Mesh& inMesh);
 
 private:
-	std::vector<Point3D> mPoints; 
+	const Mesh* mMesh; 
 	std::vector<float> mVertices; 
 	std::vector<float> mColors; 
 	std::vector<float> mNormals; 
+	std::vector<unsigned int> mIndices; 
 
 	Point3D mColor;
 };
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Map the file; returns false if it cannot be opened or mapped. Empty files map to a null buffer.
+	bool open(const std::string& filePath);
+
+	// Unmap the file
+	void close();
+
+	bool isOpen() const;
+
+	// Start of the mapped bytes
+	const char* data() const;
+
+	// Number of mapped bytes
+	size_t size() const;
+
+private:
+	const char* mData; // Start of the mapping
+	size_t mSize; // Length of the mapping
+	bool mOpen; // Set while a file is mapped
+#ifdef _WIN32
+	void* mFile; // File handle
+	void* mMapping; // File mapping handle
+#endif
+};
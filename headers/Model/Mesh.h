@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include "Model/Point3D.h" // Including header file for Point3D class
+
+// Indexed triangle mesh with float positions.
+// Corners with bit-identical coordinates are welded into one vertex while triangles are added,
+// so a closed mesh stores about half a vertex and three indices per triangle.
+class Mesh
+{
+public:
+	Mesh();
+	~Mesh();
+
+	// Remove every vertex and triangle
+	void clear();
+
+	// Reserve space for the given number of triangles
+	void reserve(size_t triangleCount);
+
+	// Append a triangle with its facet normal, welding its corners to existing vertices
+	void addTriangle(const float normal[3], const float p1[3], const float p2[3], const float p3[3]);
+
+	// Release the welding table and unused capacity once no more triangles are added
+	void shrinkToFit();
+
+	size_t vertexCount() const;
+
+	size_t triangleCount() const;
+
+	bool empty() const;
+
+	// Vertex positions: x, y, z per vertex
+	const std::vector<float>& positions() const;
+
+	// Vertex indices: three per triangle
+	const std::vector<unsigned int>& indices() const;
+
+	// Facet normals: x, y, z per triangle
+	const std::vector<float>& normals() const;
+
+	// Position of a vertex
+	Point3D vertex(size_t index) const;
+
+	// Position of corner 0, 1 or 2 of a triangle
+	Point3D corner(size_t triangle, int index) const;
+
+	// x, y, z of corner 0, 1 or 2 of a triangle, without converting them
+	const float* cornerPosition(size_t triangle, int index) const;
+
+	// Facet normal of a triangle
+	Point3D normal(size_t triangle) const;
+
+	// Bounding box of the vertices; both corners are left untouched when the mesh is empty
+	void bounds(Point3D& min, Point3D& max) const;
+
+	// Bytes held by the mesh buffers
+	size_t memoryBytes() const;
+
+private:
+	// Index of the vertex at p, adding it if there is none yet
+	unsigned int weld(const float p[3]);
+
+	// Resize the welding table to the given power of two and reinsert every vertex
+	void rehash(size_t slotCount);
+
+	static size_t hashPosition(const float p[3]);
+
+private:
+	std::vector<float> mPositions; // x, y, z per vertex
+	std::vector<unsigned int> mIndices; // Three vertex indices per triangle
+	std::vector<float> mNormals; // x, y, z per triangle
+	std::vector<unsigned int> mSlots; // Open-addressing table of vertex index + 1, 0 marks a free slot
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Memory of the transient buffers of one voxelization run: the triangle lists of the layers and the scratch
+// buffers of the workers. Buffers are carved from a few large blocks and never freed one by one; all of it
+// goes back in one step when the arena is destroyed at the end of the run. Every pool worker allocates from
+// an arena of its own, so none of them takes a lock.
+class RunArena
+{
+public:
+	// One arena for the thread setting up the run and one for each of workerCount pool workers
+	explicit RunArena(int workerCount);
+	~RunArena();
+
+	RunArena(const RunArena&) = delete;
+	RunArena& operator=(const RunArena&) = delete;
+
+	// Arena of the thread setting up the run; not to be used from inside ThreadPool::run
+	std::pmr::memory_resource* shared();
+
+	// Arena of a pool worker
+	std::pmr::memory_resource* worker(int worker);
+
+	// Number of pool workers
+	int workerCount() const;
+
+private:
+	static const size_t initialBlockSize = 1 << 16; // First block of every arena; later ones grow geometrically
+
+	std::pmr::monotonic_buffer_resource mShared; // Arena of the thread setting up the run
+	std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> mWorkers; // One arena per worker
+};
@@ -1,21 +1,83 @@
 #pragma once
 #include "vector"
-#include "Model/Point3D.h"
+#include <functional>
+#include "Model/Mesh.h"
+#include "Model/MappedFile.h"
 #include "string"
 
 // Namespace for IOOperation
 namespace IOOperation {
 
+#pragma pack(push, 1)
+	// One facet record of a binary STL file, laid out exactly as on disk (50 bytes)
+	struct StlFacet {
+		float normal[3];
+		float vertices[3][3];
+		unsigned short attribute;
+	};
+#pragma pack(pop)
+
+	static_assert(sizeof(StlFacet) == 50, "StlFacet must match the 50-byte STL record");
+
+	// Read-only view of consecutive facet records, pointing into a mapped file
+	class StlFacetSpan {
+	public:
+		StlFacetSpan();
+		StlFacetSpan(const StlFacet* facets, size_t count);
+
+		const StlFacet* begin() const;
+		const StlFacet* end() const;
+		size_t size() const;
+		bool empty() const;
+		const StlFacet& operator[](size_t index) const;
+
+	private:
+		const StlFacet* mFacets; // First record
+		size_t mCount; // Number of records
+	};
+
 	// Class for reading STL files
 	class STLReader {
 	public:	
 		STLReader(); 
-		STLReader(std::string filePath, std::vector<Point3D>& vertices, std::vector<Point3D>& colors, std::vector<Point3D>& normals); 
+		// Reader for readFacets that tokenizes ASCII files on threadCount threads (0 = all hardware threads)
+		explicit STLReader(int threadCount);
+		// Read the file into the mesh, welding shared corners; ASCII files are tokenized on threadCount threads (0 = all hardware threads)
+		STLReader(std::string filePath, Mesh& mesh, int threadCount = 0); 
 		~STLReader(); 
 
+		// Map the file; returns true when it is a binary STL, whose records are then available through facets().
+		// ASCII files stay mapped until they have been read.
+		bool mapBinary(std::string filePath);
+
+		// Facet records of the binary STL mapped by mapBinary, valid while the reader is alive
+		StlFacetSpan facets() const;
+
+		// Stream the facets of a binary or ASCII STL file through a bounded buffer, without mapping the file or
+		// building a mesh. The callback gets batches of at most batchSize facets as normal, p1, p2 and p3
+		// (12 floats each), in file order.
+		// Returns false when the file cannot be opened, or when an ASCII file has no "endfacet" within 1 MB, which
+		// no real facet needs; the facets before that point have been delivered.
+		bool readFacets(std::string filePath, size_t batchSize, const std::function<void(const float* facets, size_t count)>& callback);
+
+		// True when the bytes hold a binary STL rather than an ASCII one: the file size matches the facet count of
+		// the header, or its first 84 bytes are not text starting with "solid" in any case and the file holds the
+		// facets counted or is not text at all. data holds at least the first 84 bytes of a file of size bytes.
+		static bool isBinary(const char* data, size_t size);
+
+	private:
+		// Private function to read STL file and populate the mesh
+		void readSTL(std::string filePath, Mesh& mesh);
+
+		// Private function to populate the mesh from the mapped binary facets
+		void readBinarySTL(Mesh& mesh);
+
+		// Private function to tokenize a mapped ASCII STL file in facet-aligned chunks, in parallel
+		void readAsciiSTL(const char* data, size_t size, Mesh& mesh);
+
 	private:
-		// Private function to read STL file and populate vectors
-		void readSTL(std::string filePath, std::vector<Point3D>& vertices, std::vector<Point3D>& colors, std::vector<Point3D>& normals);
+		int mThreadCount; // Threads used for tokenizing ASCII files
+		MappedFile mFile; // Mapping of the file being read
+		StlFacetSpan mFacets; // Facet records inside mFile
 	};
 }
-
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Namespace for IOOperation
+namespace IOOperation {
+
+	// Class for writing binary STL files
+	class STLWriter {
+	public:
+		// Write quads (four corners of three floats each, counter-clockwise seen from outside) as two facets each.
+		// Returns false when the file cannot be written.
+		static bool writeQuads(const std::string& filePath, const std::vector<float>& vertices);
+	};
+}
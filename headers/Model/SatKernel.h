@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "Model/Point3D.h" // Including header file for Point3D class
+#include "Model/Vec3f.h" // Including header file for Vec3f struct
+
+// Allocator of 64-byte aligned blocks, so every coordinate array starts on a cache line and full
+// groups of eight floats can be loaded with aligned loads
+template <class T>
+struct CacheLineAllocator
+{
+	using value_type = T;
+
+	static const size_t alignment = 64;
+
+	CacheLineAllocator() = default;
+
+	template <class U>
+	CacheLineAllocator(const CacheLineAllocator<U>&)
+	{
+	}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignment)));
+	}
+
+	void deallocate(T* block, size_t)
+	{
+		::operator delete(block, std::align_val_t(alignment));
+	}
+
+	template <class U>
+	bool operator==(const CacheLineAllocator<U>&) const
+	{
+		return true;
+	}
+
+	template <class U>
+	bool operator!=(const CacheLineAllocator<U>&) const
+	{
+		return false;
+	}
+};
+
+// Box-triangle separating axis tests on several boxes or triangles at once.
+// Everything that depends only on the triangle and the box size is computed once per triangle by
+// setupTriangle, so testing a box comes down to projecting its center onto the 13 axes and comparing.
+// Everything is computed in single precision; the SIMD kernels agree bit for bit with boxIntersectsTriangle.
+// A box that touches a triangle only within float rounding may be decided otherwise than by a test in double
+// precision, so such boundary cells can differ from a double-precision voxelizer. Benchmarks grid-check pins
+// the counts this gives on its sample meshes.
+namespace SatKernel
+{
+	// Axes of the separating axis test: the cross products of the three edges with x, y and z, the x, y
+	// and z axes themselves and the triangle normal
+	static const int axisCount = 13;
+
+	// Separating axis setup of one triangle for boxes of one size. The triangle is taken relative to its
+	// first corner, and its projection onto every axis is widened by the projected radius of the box, so a box
+	// misses the triangle exactly when the projection of its center, relative to the same corner, leaves one
+	// of the intervals. The axes are stored as a structure of arrays padded to 16, two AVX registers.
+	struct alignas(64) TriangleSetup
+	{
+		float axisX[16];
+		float axisY[16];
+		float axisZ[16];
+		float lower[16]; // Widened projection interval on every axis; padding lanes hold [0, 0] and never separate
+		float upper[16];
+		Vec3f origin; // First corner of the triangle
+	};
+
+	// True when the AVX2 kernels can run on this CPU
+	bool hasAvx2();
+
+	// Set up a triangle for boxes of the given half extents
+	TriangleSetup setupTriangle(Vec3f p1, Vec3f p2, Vec3f p3, Vec3f extent);
+
+	// True when the box of the given center, of the size the triangle was set up for, touches the triangle
+	bool boxIntersectsTriangle(const TriangleSetup& triangle, Vec3f center);
+
+	// True when the box [min, max] touches any of the listed triangles, which were set up for its size.
+	// With indices == nullptr the triangles [0, count) are tested.
+	bool boxIntersectsAny(const Point3D& min, const Point3D& max, const TriangleSetup* triangles, const int* indices, size_t count, bool vectorize);
+
+	// Test one triangle, set up for boxes of voxelSize, against the boxes [min_n, min_n + voxelSize],
+	// n in [0, count), whose corners are given per axis; hits[n] is set to 1 or 0
+	void triangleIntersectsBoxes(const TriangleSetup& triangle, const float* minX, const float* minY, const float* minZ, size_t count, double voxelSize, unsigned char* hits, bool vectorize);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Model/Voxelizer.h" // Including header file for VoxelizerOptions struct
+#include "Model/ThreadPool.h" // Including header file for ThreadPool class
+
+// Counts and times of a streaming run
+struct StreamingStats
+{
+	size_t triangleCount = 0; // Facets read from the STL file
+	size_t spilledTriangles = 0; // Triangles written to the slab files; those spanning several slabs count once per slab
+	size_t slabCount = 0;
+	size_t slabLayers = 0; // x layers per slab
+	size_t batchTriangles = 0; // Triangles tested per batch
+	size_t memoryBytes = 0; // Largest of the layer, batch and spill buffers held at once
+	unsigned long long brickCount = 0; // 8x8x8 bricks written
+	unsigned long long voxelCount = 0; // Occupied cells written
+	double boundsSeconds = 0.0; // First pass: bounding box
+	double spillSeconds = 0.0; // Second pass: binning the triangles into slab files
+	double voxelizeSeconds = 0.0; // Marking the slabs and writing their bricks
+};
+
+// Out-of-core surface voxelization for meshes that do not fit in memory.
+// The STL file is streamed twice: once for the bounding box, once to bin every triangle into a spill
+// file per slab of x layers. The slabs are then marked one at a time, reading their triangles in batches,
+// and each finished slab is appended to a voxel file as sparse 8x8x8 bricks. Neither the mesh nor the
+// whole grid is ever held, and the buffers are sized to stay within the memory budget.
+// The cells marked are exactly those of Voxelizer with the triangle-driven traversal.
+class StreamingVoxelizer
+{
+public:
+	// Memory budget in bytes for the slab layers, triangle batches and spill buffers; options.fill must be Surface.
+	// Spill files go to a fresh directory below spillDirectory, by default the system temporary directory.
+	StreamingVoxelizer(size_t memoryBudget, const VoxelizerOptions& options = VoxelizerOptions(), const std::string& spillDirectory = std::string());
+
+	// Voxelize the STL file into a voxel file; returns false and sets error() on failure or cancellation
+	bool run(const std::string& stlPath, double voxelSize, const std::string& outputPath);
+
+	// Reason of the last failure
+	const std::string& error() const;
+
+	// Counts and times of the last run
+	StreamingStats stats() const;
+
+private:
+	// Triangles of one slab file, loaded in batches
+	struct Batch
+	{
+		std::vector<float> corners; // p1, p2 and p3 of every triangle
+		std::vector<Voxelizer::CellRange> ranges;
+		std::vector<size_t> layerStart; // Triangles of slab layer l are layerTriangles[layerStart[l], layerStart[l + 1])
+		std::vector<unsigned int> layerTriangles;
+	};
+
+	// Per-worker buffers of the row tests
+	struct Scratch
+	{
+		std::vector<float> minX;
+		std::vector<float> minY;
+		std::vector<float> minZ;
+		std::vector<unsigned char> hits;
+	};
+
+	// First pass: bounding box and triangle count
+	bool readBounds(const std::string& stlPath, double minCorner[3], double maxCorner[3]);
+
+	// Second pass: append every triangle to the spill file of each slab its cell range reaches
+	bool spillTriangles(const std::string& stlPath, const std::vector<std::string>& slabPaths, ThreadPool& pool);
+
+	// Mark the layers of one slab from its spill file into layers, one bitset per layer
+	bool markSlab(size_t slab, const std::string& slabPath, ThreadPool& pool, std::vector<unsigned long long>& layers);
+
+	// Mark the cells the batch triangles touch in slab layer l
+	void markLayer(size_t slab, size_t l, const Batch& batch, Scratch& scratch, unsigned long long* layer) const;
+
+	bool cancelled() const;
+
+private:
+	size_t mMemoryBudget; // Bytes the buffers may take
+	VoxelizerOptions mOptions; // Thread count, vectorization, progress and cancellation
+	std::string mSpillDirectory; // Parent of the spill directory of a run
+	double mVoxelSize; // Edge length of a cell
+	std::vector<float> mGridX; // Corner coordinates of the cells along x
+	std::vector<float> mGridY; // Corner coordinates of the cells along y
+	std::vector<float> mGridZ; // Corner coordinates of the cells along z
+	size_t mLayerWords; // Words of one layer bitset
+	size_t mSlabLayers; // x layers per slab, a multiple of 8
+	size_t mBatchTriangles; // Triangles loaded from a spill file at once
+	size_t mSpillTriangles; // Triangles buffered per slab before they are appended to its file
+	std::string mError; // Reason of the last failure
+	StreamingStats mStats; // Counts and times of the last run
+};
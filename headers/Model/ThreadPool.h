@@ -0,0 +1,57 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running batches of indexed tasks.
+// Every worker owns a queue; a worker that runs out of tasks steals from the others.
+class ThreadPool
+{
+public:
+	// Start the workers; a thread count below 1 uses every hardware thread
+	explicit ThreadPool(int threadCount);
+	~ThreadPool();
+
+	// Number of workers, including the thread calling run()
+	int threadCount() const;
+
+	// Run task(index, worker) for every index in [0, taskCount) and return once all of them finished.
+	// The calling thread works as worker 0, so worker ids are in [0, threadCount()).
+	void run(size_t taskCount, const std::function<void(size_t, int)>& task);
+
+	// Number of threads used for a thread count below 1
+	static int defaultThreadCount();
+
+private:
+	// Task queue of one worker
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	// Loop of the spawned workers: wait for a batch, drain it, report back
+	void workerLoop(int worker);
+
+	// Run tasks from the own queue, then from the other queues, until all are empty
+	void drain(int worker, const std::function<void(size_t, int)>& task);
+
+	// Take the next task from the front of the own queue or the back of another one
+	bool nextTask(int worker, size_t& index);
+
+private:
+	std::vector<std::unique_ptr<Queue>> mQueues; // One queue per worker
+	std::vector<std::thread> mThreads; // Spawned workers 1..n-1
+
+	std::mutex mMutex; // Guards the batch state below
+	std::condition_variable mWake; // Signals a new batch or shutdown
+	std::condition_variable mDone; // Signals a worker finishing its batch
+	const std::function<void(size_t, int)>* mTask; // Task of the current batch
+	unsigned long long mBatch; // Number of the current batch
+	int mBusy; // Spawned workers still draining the current batch
+	bool mStop; // Set when the pool shuts down
+};
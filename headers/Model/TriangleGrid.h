@@ -0,0 +1,46 @@
+#pragma once
+#include <memory_resource>
+#include <vector>
+#include "Model/Point3D.h" // Including header file for Point3D class
+#include "Model/Mesh.h" // Including header file for Mesh class
+
+// Uniform bin grid over the triangles of a mesh, used to find the triangles
+// that may touch a box without testing every triangle of the mesh
+class TriangleGrid
+{
+public:
+	TriangleGrid();
+	~TriangleGrid();
+
+	// Bin the triangles of the mesh by their bounding boxes
+	void build(const Mesh& mesh);
+
+	// Collect the indices of the triangles whose bounding boxes overlap the box [min, max].
+	// Every index is reported once; the list may contain triangles that do not touch the box.
+	void query(const Point3D& min, const Point3D& max, std::pmr::vector<int>& candidates) const;
+
+	// Release the bins
+	void clear();
+
+	bool empty() const;
+
+private:
+	// Range of bins covered by the box [min, max], clamped to the grid
+	void binRange(const Point3D& min, const Point3D& max, int lo[3], int hi[3]) const;
+
+	// Bin coordinate of a value along one axis, clamped to the grid
+	int binCoordinate(double value, int axis) const;
+
+	int binIndex(int ix, int iy, int iz) const;
+
+private:
+	double mOrigin[3]; // Lower corner of the grid
+	double mBinSize[3]; // Extent of a single bin
+	int mDims[3]; // Number of bins along each axis
+	double mPadding; // Tolerance added to every box so that touching triangles are never dropped
+
+	std::vector<int> mBinStart; // Offset of each bin into mBinTriangles (one extra entry at the end)
+	std::vector<int> mBinTriangles; // Triangle indices, grouped by bin
+	std::vector<Point3D> mTriangleMin; // Lower corner of each triangle's bounding box
+	std::vector<Point3D> mTriangleMax; // Upper corner of each triangle's bounding box
+};
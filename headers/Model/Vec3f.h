@@ -0,0 +1,53 @@
+#pragma once
+#include "Model/Point3D.h" // Including header file for Point3D class
+
+// Float vector for the inner loops of the voxelizer. Point3D stays at the interfaces; unlike it, Vec3f is a
+// plain aggregate whose operations are constexpr and inline, so a chain of them compiles to a few float
+// instructions without temporaries or calls.
+struct Vec3f
+{
+	float x;
+	float y;
+	float z;
+};
+
+constexpr Vec3f operator+(Vec3f a, Vec3f b)
+{
+	return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+constexpr Vec3f operator-(Vec3f a, Vec3f b)
+{
+	return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+constexpr Vec3f operator*(Vec3f a, float s)
+{
+	return { a.x * s, a.y * s, a.z * s };
+}
+
+// Summed as (x + y) + z, the order the SIMD kernels use
+constexpr float dot(Vec3f a, Vec3f b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+constexpr Vec3f cross(Vec3f a, Vec3f b)
+{
+	return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+constexpr Vec3f absolute(Vec3f a)
+{
+	return { a.x < 0.0f ? -a.x : a.x, a.y < 0.0f ? -a.y : a.y, a.z < 0.0f ? -a.z : a.z };
+}
+
+constexpr Vec3f toVec3f(const float* p)
+{
+	return { p[0], p[1], p[2] };
+}
+
+inline Vec3f toVec3f(const Point3D& p)
+{
+	return { static_cast<float>(p.x()), static_cast<float>(p.y()), static_cast<float>(p.z()) };
+}
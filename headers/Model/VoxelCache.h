@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Model/Voxelizer.h" // Including header file for Voxelizer class
+
+// Counters of a voxelization cache
+struct VoxelCacheStats
+{
+	size_t memoryHits = 0; // Requests served from memory
+	size_t diskHits = 0; // Requests served from a voxel file of the cache directory
+	size_t misses = 0; // Requests that voxelized the STL file
+	size_t entryCount = 0; // Results held in memory
+	size_t memoryBytes = 0; // Bytes held by the results in memory
+	unsigned long long diskBytes = 0; // Bytes of the voxel files in the cache directory
+};
+
+// Cache of voxelization results keyed by the content of the STL file, the voxel size and the fill and meshing modes.
+// Recent results stay in memory, least recently used first out once the memory cap is exceeded. Every
+// result is also written as a voxel file to the cache directory, whose oldest files go once the disk cap
+// is exceeded, so a result evicted from memory or made by an earlier session only has to be meshed again.
+// Requests may come from several threads at once.
+class VoxelCache
+{
+public:
+	// Caps in bytes; an empty directory or a disk cap of 0 keeps results in memory only
+	VoxelCache(size_t memoryBudget, const std::string& directory, unsigned long long diskBudget);
+
+	VoxelCache(const VoxelCache&) = delete;
+	VoxelCache& operator=(const VoxelCache&) = delete;
+
+	// Frozen voxelizer of the STL file, from memory, from disk or voxelized now. Returns the unfinished
+	// result, uncached, when the run was cancelled through options.cancel.
+	std::shared_ptr<const Voxelizer> get(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options);
+
+	// Frozen voxelizer of the STL file from memory or disk; nullptr, counted as a miss, when there is none
+	std::shared_ptr<const Voxelizer> find(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options);
+
+	// Keep a frozen voxelizer made elsewhere, e.g. by refining a coarser one
+	void insert(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options, const std::shared_ptr<const Voxelizer>& voxelizer);
+
+	// Change the caps, evicting results until both are met
+	void setBudgets(size_t memoryBudget, unsigned long long diskBudget);
+
+	// Drop every result held in memory; the voxel files stay
+	void clear();
+
+	VoxelCacheStats stats() const;
+
+	// 64-bit hash of the bytes of a file; 0 when it cannot be read
+	static unsigned long long hashFile(const std::string& filePath);
+
+private:
+	// A result held in memory
+	struct Entry
+	{
+		std::string key;
+		std::shared_ptr<const Voxelizer> voxelizer;
+		size_t bytes;
+	};
+
+	// Hash of a file as of its size and modification time
+	struct FileHash
+	{
+		unsigned long long size;
+		std::filesystem::file_time_type modified;
+		unsigned long long hash;
+	};
+
+	// Hash of the STL file, read again only when its size or modification time changed since the last request;
+	// 0 when it cannot be read
+	unsigned long long stlHash(const std::string& stlPath);
+
+	// Memory key and voxel file name of a request; false when the STL file cannot be read
+	bool keys(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options, std::string& key, std::string& fileName);
+
+	// Look a key up in memory, making it the most recent entry
+	std::shared_ptr<const Voxelizer> findInMemory(const std::string& key);
+
+	// Hold a result in memory as the most recent entry
+	void addToMemory(const std::string& key, const std::shared_ptr<const Voxelizer>& voxelizer);
+
+	// Write a result to the cache directory
+	void addToDisk(const std::string& fileName, const Voxelizer& voxelizer);
+
+	// Evict the least recently used entries until the memory cap is met; mMutex must be held
+	void trimMemory();
+
+	// Delete the oldest voxel files until the disk cap is met; mMutex must be held
+	void trimDisk();
+
+private:
+	mutable std::mutex mMutex; // Guards everything below
+	size_t mMemoryBudget; // Bytes the results in memory may take
+	std::string mDirectory; // Directory of the voxel files; empty when results are not written
+	unsigned long long mDiskBudget; // Bytes the voxel files may take
+	std::list<Entry> mEntries; // Results in memory, most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> mIndex; // Entry of every key
+	std::unordered_map<std::string, FileHash> mHashes; // Hash of every STL file requested, by path
+	VoxelCacheStats mStats; // Counters
+	std::atomic<unsigned int> mTemporaryCount; // Makes the names of voxel files being written unique
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+#include "Model/Point3D.h" // Including header file for Point3D class
+#include "Model/VoxelGeometry.h" // Including header file for VoxelChunk struct
+
+// Grouping of voxel render geometry into chunks of chunkCells x chunkCells x chunkCells cells, so the view can
+// keep every chunk in a buffer of its own and skip the chunks outside the view. The quads or cells are
+// reordered in place, chunk after chunk in x, y, z order of the chunks; nothing is copied.
+namespace VoxelChunks
+{
+	// Cells along each edge of a chunk
+	static const size_t chunkCells = 32;
+
+	// Group quads, four vertices (x, y, z each) per quad, of a lattice with cell (0, 0, 0) at origin. A quad
+	// belongs to the chunk holding its center; the bounds of a chunk are those of its quads.
+	std::vector<VoxelChunk> groupQuads(std::vector<float>& vertices, const Point3D& origin, double voxelSize, int threadCount);
+
+	// Group cell indices, i, j, k and a padding value per cell, of a lattice with cell (0, 0, 0) at origin.
+	// The bounds of a chunk are those of its cells.
+	std::vector<VoxelChunk> groupCells(std::vector<unsigned short>& cells, const Point3D& origin, double voxelSize, int threadCount);
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Model/MappedFile.h"
+#include "Model/VoxelGrid.h"
+
+// Namespace for IOOperation
+namespace IOOperation {
+
+	// Flags of a voxel file
+	const unsigned int voxelFileSolid = 1; // Inside cells are filled, not only the surface
+
+	// How the cells of a brick are stored
+	enum class BrickEncoding : unsigned char {
+		Full = 0, // All 512 cells occupied, no payload
+		Bitmask = 1, // 8 words, word i % 8 holding bit (j % 8) * 8 + k % 8
+		Runs = 2 // Run count (16 bits) and that many run lengths (8 bits) over the cells in bitmask order,
+		         // alternating empty and occupied runs and starting with an empty one
+	};
+
+#pragma pack(push, 1)
+	// Header of a voxel file (96 bytes).
+	// It is followed by one chunk per 8 x layers: a 32-bit brick count and the occupied 8x8x8 bricks of
+	// those layers in y, z order, each as brick y and z (32 bits each), its BrickEncoding and the payload.
+	// The directory at directoryOffset holds the file offset of every chunk (64 bits each, 0 = empty).
+	struct VoxelFileHeader {
+		char magic[4]; // "VOXL"
+		unsigned int version;
+		unsigned long long size[3]; // Cells along x, y and z
+		double origin[3]; // Lower corner of cell (0, 0, 0)
+		double voxelSize;
+		unsigned long long brickCount;
+		unsigned long long voxelCount; // Occupied cells
+		unsigned long long directoryOffset;
+		unsigned int flags; // voxelFileSolid
+		unsigned int reserved;
+	};
+#pragma pack(pop)
+
+	static_assert(sizeof(VoxelFileHeader) == 96, "VoxelFileHeader must match the 96-byte file header");
+
+	// Class for writing voxel files a few x layers at a time, so the whole grid never has to be in memory
+	class VoxelFileWriter {
+	public:
+		VoxelFileWriter();
+		~VoxelFileWriter();
+
+		VoxelFileWriter(const VoxelFileWriter&) = delete;
+		VoxelFileWriter& operator=(const VoxelFileWriter&) = delete;
+
+		// Create the file for a grid of nx * ny * nz cells; returns false when it cannot be created
+		bool open(const std::string& filePath, size_t nx, size_t ny, size_t nz, const double origin[3], double voxelSize, unsigned int flags = 0);
+
+		// Append the x layers [firstLayer, firstLayer + layerCount), given as consecutive layer bitsets in which
+		// cell (j, k) is bit j * nz + k. firstLayer must be a multiple of 8 and follow the layers written before;
+		// only the last call may end on a layer that is not a multiple of 8.
+		void writeLayers(size_t firstLayer, size_t layerCount, const unsigned long long* layers);
+
+		// Write the whole grid
+		void writeGrid(const VoxelGrid& grid);
+
+		// Write the chunk directory and the header and close the file; returns false when any write failed
+		bool close();
+
+		// Words of one layer bitset
+		size_t layerWords() const;
+
+		// Bricks written so far
+		unsigned long long brickCount() const;
+
+		// Occupied cells written so far
+		unsigned long long voxelCount() const;
+
+	private:
+		// Eight x planes of 8x8 cells, bit (j % 8) * 8 + k % 8 of word i % 8
+		struct Brick {
+			unsigned long long planes[8];
+		};
+
+		// Append the encoded brick to mBuffer
+		void encodeBrick(unsigned long long key, const Brick& brick);
+
+	private:
+		std::ofstream mFile; // File being written
+		VoxelFileHeader mHeader; // Header, completed by close()
+		size_t mLayerWords; // Words of one layer bitset
+		unsigned long long mOffset; // Bytes written so far
+		std::vector<unsigned long long> mDirectory; // Offset of every chunk
+		std::unordered_map<unsigned long long, Brick> mBricks; // Bricks of the 8 layers being converted
+		std::vector<unsigned long long> mKeys; // Keys of mBricks, sorted before writing
+		std::vector<unsigned char> mBuffer; // Encoded chunk
+	};
+
+	// Class for reading voxel files from a memory mapping; chunks are decoded on demand
+	class VoxelFileReader {
+	public:
+		VoxelFileReader();
+		~VoxelFileReader();
+
+		// Map the file and check its header and directory; returns false for a missing or malformed file, including
+		// one with an empty grid, a cell count beyond size_t or a voxel size that is not finite and positive
+		bool open(const std::string& filePath);
+
+		void close();
+
+		const VoxelFileHeader& header() const;
+
+		// Words of one layer bitset
+		size_t layerWords() const;
+
+		// Decode the layers 8 * chunk to 8 * chunk + 7 (fewer at the end of the grid) into consecutive layer
+		// bitsets of layerWords() words each; returns false when the chunk is malformed
+		bool readChunk(size_t chunk, unsigned long long* layers) const;
+
+		// Decode the whole file into a grid, chunks in parallel; returns false when a chunk is malformed
+		bool readGrid(VoxelGrid& grid, int threadCount = 0, VoxelGrid::Storage storage = VoxelGrid::Storage::Automatic) const;
+
+	private:
+		MappedFile mFile; // Mapping of the file
+		VoxelFileHeader mHeader; // Copy of the header
+		size_t mLayerWords; // Words of one layer bitset
+		size_t mChunkCount; // Chunks of 8 x layers
+	};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "Model/Mesh.h" // Including header file for Mesh class
+#include "Model/VoxelGrid.h" // Including header file for VoxelGrid class
+
+// Marks the cells inside a mesh by ray parity.
+// Rays through the cell centres along x, y and z toggle a bit at every crossing with the mesh, and a
+// prefix XOR over whole words turns the toggles into inside/outside. A cell is filled when the rays of
+// at least two axes find it inside, so a hole that one ray slips through does not flood a whole row.
+class VoxelFiller
+{
+public:
+	// cornersX/Y/Z hold the lower corner of every cell along each axis; all cells are voxelSize wide
+	VoxelFiller(const Mesh& mesh, const std::vector<float>& cornersX, const std::vector<float>& cornersY, const std::vector<float>& cornersZ, double voxelSize, int threadCount);
+
+	// Mark the inside cells in a grid that already holds the surface cells
+	void fill(VoxelGrid& grid) const;
+
+private:
+	// Corners of a mesh triangle in double precision
+	void triangleCorners(size_t triangle, double corners[3][3]) const;
+
+	// Range of cell centres along an axis that lie within [min, max]
+	void centreRange(int axis, double min, double max, size_t& first, size_t& last) const;
+
+	// Index of the first cell whose centre lies above a crossing, which is where the crossing toggles parity
+	size_t toggleIndex(int axis, double crossing) const;
+
+private:
+	const Mesh& mMesh; // Surface to fill
+	std::vector<double> mCentres[3]; // Cell centres along x, y and z
+	int mThreadCount; // Worker threads; 0 uses every hardware thread
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "Model/Point3D.h" // Including header file for Point3D class
+
+// Quads or cells of one spatial chunk of the geometry, with their bounds
+struct VoxelChunk
+{
+	float min[3]; // Lower corner of the bounds
+	float max[3]; // Upper corner of the bounds
+	size_t first; // First quad or cell of the chunk
+	size_t count; // Quads or cells of the chunk
+};
+
+// Render geometry of a voxelization, handed from the voxelizer to the view. Depending on the meshing,
+// it holds quads or, for instanced drawing, only the indices of the occupied cells, grouped by chunk.
+// The buffers are shared with the voxelizer that built them and never change, so copying the
+// geometry from thread to thread copies no vertices.
+struct VoxelGeometry
+{
+	std::shared_ptr<const std::vector<float>> vertices; // Quads, four vertices (x, y, z each) per quad; empty when cells is used
+	std::shared_ptr<const std::vector<unsigned short>> cells; // Indices i, j, k and a padding 0 of every occupied cell, for instanced drawing
+	std::shared_ptr<const std::vector<VoxelChunk>> chunks; // Ranges of the quads or cells, one per non-empty chunk
+	std::shared_ptr<const VoxelGeometry> coarse; // The same drawn at twice the voxel size from the occupancy downsampled 2x, for zoomed-out views; may be null
+	Point3D origin; // Lower corner of cell (0, 0, 0)
+	double voxelSize = 0.0; // Width of a cell
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Occupancy of a box of nx * ny * nz cells, one bit per cell.
+// Small grids keep every bit in one dense array; large grids keep only the 8x8x8 bricks
+// that hold at least one occupied cell, in one hash map per slab of 8 x layers.
+class VoxelGrid
+{
+public:
+	// How the bits are stored
+	enum class Storage
+	{
+		Automatic, // Dense while the bit array stays below denseLimitBytes, sparse beyond
+		Dense, // One bit per cell of the box
+		Sparse // One 8x8x8 brick per occupied region
+	};
+
+	// Largest dense bit array chosen by Storage::Automatic
+	static const size_t denseLimitBytes = 64 << 20;
+
+	VoxelGrid();
+	VoxelGrid(size_t nx, size_t ny, size_t nz, Storage storage = Storage::Automatic);
+	~VoxelGrid();
+
+	VoxelGrid(const VoxelGrid& other);
+	VoxelGrid& operator=(const VoxelGrid& other);
+
+	// Drop every cell and resize the box
+	void reset(size_t nx, size_t ny, size_t nz, Storage storage = Storage::Automatic);
+
+	size_t sizeX() const;
+	size_t sizeY() const;
+	size_t sizeZ() const;
+
+	bool isSparse() const;
+
+	bool isOccupied(size_t i, size_t j, size_t k) const;
+
+	// Mark a cell; not safe to call concurrently
+	void set(size_t i, size_t j, size_t k);
+
+	// Number of occupied cells
+	size_t count() const;
+
+	// Words of a layer bitset, in which cell (j, k) of an x layer is bit j * sizeZ() + k
+	size_t layerWords() const;
+
+	// Copy the occupancy of the x layer i into a layer bitset of layerWords() words
+	void getLayer(size_t i, unsigned long long* words) const;
+
+	// Mark the cells set in a layer bitset of the x layer i.
+	// Calls for different layers may run concurrently.
+	void setLayer(size_t i, const unsigned long long* words);
+
+	// Bytes held by the occupancy bits
+	size_t memoryBytes() const;
+
+private:
+	// Eight x planes of 8x8 cells, bit y * 8 + z of word x
+	struct Brick
+	{
+		unsigned long long planes[8];
+	};
+
+	static unsigned long long brickKey(size_t j, size_t k);
+
+	size_t mSize[3]; // Cells along x, y and z
+	bool mSparse; // Set when the bricks are used instead of the dense array
+	size_t mLayerWords; // Words of one x layer in mDense
+	std::vector<unsigned long long> mDense; // Layer after layer, every layer starting on a fresh word
+	std::vector<std::unordered_map<unsigned long long, Brick>> mSlabs; // Bricks of every slab of 8 x layers, keyed by brick y and z
+	std::unique_ptr<std::mutex[]> mSlabLocks; // Serialise the layers of one slab in setLayer
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include "Model/VoxelGrid.h" // Including header file for VoxelGrid class
+
+// Size and cost of one meshing run
+struct VoxelMeshStats
+{
+	size_t voxelCount = 0; // Occupied cells
+	size_t cubeVertexCount = 0; // Vertices six separate faces per voxel would take
+	size_t vertexCount = 0; // Vertices actually emitted, or drawn through instancing
+	size_t bytes = 0; // Bytes of vertices or cell indices handed to the renderer
+	double seconds = 0.0; // Wall time of the run
+
+	// cubeVertexCount / vertexCount, or 1 when nothing was emitted
+	double reduction() const;
+};
+
+// Turns the occupied cells of a VoxelGrid into quads that only cover the surface.
+// The grid is cut into slabs of slabDepth x layers that are meshed in parallel;
+// quads never reach across a slab boundary, so the output does not depend on the thread count.
+class VoxelMesher
+{
+public:
+	enum class Mode
+	{
+		CulledFaces, // One quad per face between an occupied and an empty cell
+		Greedy // Coplanar faces facing the same way merged into rectangles
+	};
+
+	static const size_t slabDepth = 32;
+
+	// planesX/Y/Z hold the n + 1 cell boundaries along each axis of the grid
+	VoxelMesher(const VoxelGrid& grid, const std::vector<float>& planesX, const std::vector<float>& planesY, const std::vector<float>& planesZ, int threadCount);
+
+	// Append four vertices (x, y, z each) per quad, wound counter-clockwise seen from outside
+	VoxelMeshStats mesh(Mode mode, std::vector<float>& vertices) const;
+
+private:
+	// Coplanar faces of one plane: -1 faces the negative axis, +1 the positive one, 0 no face
+	struct FaceMask
+	{
+		size_t rows;
+		size_t cols;
+		std::vector<signed char> faces;
+	};
+
+	// Mesh the x layers [first, last) into vertices
+	void meshSlab(Mode mode, size_t first, size_t last, std::vector<float>& vertices) const;
+
+	// Emit the faces of a mask lying on the plane at coordinate of the axis; rows and columns run along rowAxis and colAxis
+	void emitFaces(Mode mode, FaceMask& mask, int axis, float coordinate, int rowAxis, const float* rowPlanes, int colAxis, const float* colPlanes, std::vector<float>& vertices) const;
+
+	// Append one quad spanning [row0, row1] x [col0, col1] on the plane
+	static void addQuad(int axis, float coordinate, int sign, int rowAxis, float row0, float row1, int colAxis, float col0, float col1, std::vector<float>& vertices);
+
+private:
+	const VoxelGrid& mGrid; // Cells to mesh
+	const std::vector<float>* mPlanes[3]; // Cell boundaries along x, y and z
+	int mThreadCount; // Worker threads; 0 uses every hardware thread
+};
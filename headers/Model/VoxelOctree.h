@@ -0,0 +1,77 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include "Model/Point3D.h" // Including header file for Point3D class
+#include "Model/VoxelGrid.h" // Including header file for VoxelGrid class
+
+// Sparse voxel octree over the occupied cells of a VoxelGrid, laid out breadth first in one array without pointers.
+// The root covers a cube of 2^depth() cells starting at cell (0, 0, 0). Every node holds a mask of its occupied
+// octants and the index of its first child; the children of a node are stored next to each other, so octant c is
+// found at firstChild plus the number of mask bits below c. Octant c holds the cells whose x, y and z halves are
+// bits 0, 1 and 2 of c. The nodes of the last level are 2x2x2 bricks whose mask bits are the cells themselves,
+// and their firstChild numbers their first occupied cell, which is where the cell's triangles are found.
+class VoxelOctree
+{
+public:
+	// One node: 8 bytes, against the 288 bytes of cube vertices a voxel takes
+	struct Node
+	{
+		unsigned int firstChild; // Node index of the first child, or cell number below the last level
+		unsigned char childMask; // Bit c set when octant c holds an occupied cell
+		unsigned char padding[3];
+	};
+
+	// Append the triangles touching cell (i, j, k) of the grid; called from several threads at once
+	using TriangleLookup = std::function<void(size_t, size_t, size_t, std::vector<int>&)>;
+
+	VoxelOctree();
+
+	// Build over the occupied cells of a grid whose cell (0, 0, 0) starts at origin; all cells are voxelSize wide.
+	// When triangles is given, every cell keeps the triangles it returns.
+	VoxelOctree(const VoxelGrid& grid, const Point3D& origin, double voxelSize, int threadCount, const TriangleLookup& triangles = nullptr);
+
+	// Levels below the root; the root covers 2^depth() cells along each axis
+	int depth() const;
+
+	// Nodes of every level, root first
+	const std::vector<Node>& nodes() const;
+
+	// Index of the first node of a level in nodes(); levelStart(depth()) is the node count
+	size_t levelStart(int level) const;
+
+	// Number of occupied cells
+	size_t cellCount() const;
+
+	// Whether the cells keep their triangles
+	bool hasTriangles() const;
+
+	bool isOccupied(size_t i, size_t j, size_t k) const;
+
+	// Triangles touching cell (i, j, k); count is 0 when the cell is empty or no triangles were kept
+	const int* triangles(size_t i, size_t j, size_t k, size_t& count) const;
+
+	// Find the first occupied cell a ray from origin along direction enters. On a hit, cell receives its
+	// indices and distance the ray parameter at which the ray enters it, in units of direction.
+	bool raycast(const Point3D& origin, const Point3D& direction, size_t cell[3], double& distance) const;
+
+	// Occupancy of the nodes of a level, one cell per node, e.g. to mesh a coarser level of detail
+	VoxelGrid levelGrid(int level) const;
+
+	// Bytes held by the nodes and the triangle lists
+	size_t memoryBytes() const;
+
+private:
+	// Number of the occupied cell (i, j, k) below the last level, or cellCount() when it is empty
+	size_t cellNumber(size_t i, size_t j, size_t k) const;
+
+private:
+	size_t mSize[3]; // Cells of the grid along x, y and z
+	int mDepth; // Levels below the root
+	Point3D mOrigin; // Lower corner of cell (0, 0, 0)
+	double mVoxelSize; // Width of a cell
+	std::vector<Node> mNodes; // Every level, root first, each level in Morton order
+	std::vector<size_t> mLevelStart; // First node of every level, then the node count
+	size_t mCellCount; // Occupied cells
+	std::vector<size_t> mTriangleStart; // Triangles of cell n are mTriangles[mTriangleStart[n], mTriangleStart[n + 1]); empty without triangles
+	std::vector<int> mTriangles; // Triangle lists of all cells, in Morton order
+};
@@ -1,65 +1,327 @@
 #pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include "Model/Point3D.h" // Including header file for Point3D class
+#include "Model/Mesh.h" // Including header file for Mesh class
+#include "Model/RunArena.h" // Including header file for RunArena class
+#include "Model/TriangleGrid.h" // Including header file for TriangleGrid class
+#include "Model/SatKernel.h" // Including header file for TriangleSetup struct
+#include "Model/VoxelGeometry.h" // Including header file for VoxelGeometry struct
+#include "Model/VoxelGrid.h" // Including header file for VoxelGrid class
+#include "Model/VoxelMesher.h" // Including header file for VoxelMeshStats struct
+#include "Model/VoxelOctree.h" // Including header file for VoxelOctree class
+
+class ThreadPool;
+
+// Settings of a voxelization run
+struct VoxelizerOptions
+{
+	// How the cell-driven traversal finds the triangles tested against a voxel
+	enum class Acceleration
+	{
+		None, // Test every triangle of the mesh (reference path)
+		UniformGrid // Test only the triangles binned near the voxel
+	};
+
+	// Which loop drives the voxelization
+	enum class Traversal
+	{
+		CellDriven, // Visit every cell of the bounding box (reference path)
+		TriangleDriven // Visit only the cells inside each triangle's bounding box
+	};
+
+	// Which cells are marked
+	enum class Fill
+	{
+		Surface, // Cells touching the mesh
+		Solid // Cells touching the mesh and cells inside it
+	};
+
+	// Which faces of the occupied cells are turned into render quads
+	enum class Meshing
+	{
+		Cubes, // Six faces per voxel (reference path)
+		CulledFaces, // Only faces between an occupied and an empty cell
+		Greedy, // Culled faces merged into larger coplanar quads
+		Instances // No quads: the occupied cells are listed for drawing one cube per cell with instancing
+	};
+
+	Acceleration acceleration = Acceleration::UniformGrid;
+	Traversal traversal = Traversal::TriangleDriven;
+	int threadCount = 0; // Worker threads; 0 uses every hardware thread. The result does not depend on it.
+	bool vectorize = true; // Test several triangles or voxels at once with AVX2 when the CPU supports it
+	VoxelGrid::Storage storage = VoxelGrid::Storage::Automatic; // Dense or sparse occupancy bits
+	Meshing meshing = Meshing::Greedy; // Quads built by vertices()
+	bool coarseLevel = false; // Also build the geometry at twice the voxel size, which the view draws when zoomed out
+	Fill fill = Fill::Surface; // Surface shell or solid voxelization
+	std::function<void(double)> progress; // Called from worker threads with the fraction of x layers marked, once per percent
+	const std::atomic<bool>* cancel = nullptr; // Polled between layers; once set, the run stops early and its grid is incomplete
+};
 
 class Voxelizer
 {
 public:
+	// Destroys an instance through release, for the owning pointers handed out by the factories
+	struct Deleter
+	{
+		void operator()(Voxelizer* voxelizer) const
+		{
+			release(voxelizer);
+		}
+	};
+
+	// Owning pointer to an instance; it converts to a std::shared_ptr when an instance is shared
+	using Ptr = std::unique_ptr<Voxelizer, Deleter>;
+
 	// Static function to get an instance of Voxelizer
-	static Voxelizer* getVoxelizer(std::string fileName, int voxelSize);
+	static Ptr getVoxelizer(std::string fileName, double voxelSize, const VoxelizerOptions& options = VoxelizerOptions());
+
+	// Static function to get an instance holding the grid of a voxel file, without a mesh; returns nullptr when the file cannot be read
+	static Ptr loadVoxelizer(std::string voxelFileName, const VoxelizerOptions& options = VoxelizerOptions());
 
-	// Function to return vertices of created cubes
-	std::vector<float> vertices() const;
+	// Static function to destroy an instance; called by Deleter
+	static void release(Voxelizer* voxelizer);
+
+	// Function to return vertices of created cubes, grouped by chunk (see VoxelChunks); the cubes are built from
+	// the grid on the first call
+	const std::vector<float>& vertices() const;
 
 	// Function to return colors of created cubes
-	std::vector<float> colors() const;
+	const std::vector<float>& colors() const;
+
+	// Function to return the indices i, j, k and a padding 0 of every occupied cell, grouped by chunk, when the
+	// meshing is Instances; built on the first call. Empty when an axis has more than instanceAxisLimit cells,
+	// in which case vertices() holds greedy quads instead.
+	const std::vector<unsigned short>& instances() const;
+
+	// Function to return what the view draws: the quads or the instances with their chunks, the coarse level when
+	// selected, the lattice origin and the voxel size. The buffers are shared with this instance and its
+	// snapshots rather than copied.
+	VoxelGeometry geometry() const;
+
+	// Cells along each axis up to which Instances meshing fits the 16-bit cell indices
+	static const size_t instanceAxisLimit = 65536;
+
+	const std::vector<float>& normals() const;
+
+	// Function to return the mesh read from the STL file
+	const Mesh& mesh() const;
+
+	// Function to return the occupied cells, without building any cube geometry
+	const VoxelGrid& grid() const;
+
+	// Function to return the lower corner of cell (i, j, k) of the grid
+	Point3D cellCorner(size_t i, size_t j, size_t k) const;
+
+	// Function to write the grid to a voxel file; returns false when the file cannot be written
+	bool saveVoxels(const std::string& voxelFileName) const;
+
+	// Function to halve the voxel size without starting over: each occupied cell of the current grid is split
+	// into 2x2x2 cells, which are tested only against the triangles that touched it. The grid that is replaced
+	// stays available as a coarser level. The cells marked are exactly those of a run at the finer size.
+	// Returns false when the mesh is gone (see freeze) or the run was cancelled, in which case the voxelizer is left
+	// at the level it had and can be refined again.
+	bool refine();
+
+	// Function to return the number of levels, coarsest first; the last one is grid()
+	size_t levelCount() const;
+
+	// Function to return the grid of a level
+	const VoxelGrid& level(size_t index) const;
+
+	// Function to return the voxel size of a level
+	double levelVoxelSize(size_t index) const;
+
+	// Function to build a sparse voxel octree of the grid, needing neither the quads nor vertices().
+	// With triangles, every cell keeps the mesh triangles touching it, which takes the mesh (see freeze);
+	// cells filled inside a solid have none.
+	VoxelOctree octree(bool withTriangles);
+
+	// Function to return a new instance holding a copy of the grid and the quads only, like a frozen one;
+	// the quads are shared, not copied
+	Ptr snapshot() const;
+
+	// Function to build the quads and drop what only the run needed: the mesh, the triangle buffers and the
+	// progress and cancel callbacks. Afterwards the instance no longer changes, so it can be kept and shared
+	// between threads, and mesh() is empty.
+	void freeze();
+
+	// Function to return the bytes held by the mesh, the grid and the quads
+	size_t memoryBytes() const;
 
-	std::vector<float> normals() const;
+	// Function to return the vertex counts and time of the last geometry build
+	VoxelMeshStats meshStats() const;
 
-	void createBoundingBoxGrid(const std::vector<Point3D>& vertices);
+	// Function to tell whether the run was stopped through VoxelizerOptions::cancel
+	bool cancelled() const;
+
+	void createBoundingBoxGrid(const Mesh& mesh);
 
 	bool intersectsAnyTriangle(const Point3D& voxelCorner);
 
-	bool lineIntersectsVoxel(const Point3D& voxelCorner, const Point3D& p1, const Point3D& p2, int voxelSize);
+	bool lineIntersectsVoxel(const Point3D& voxelCorner, const Point3D& p1, const Point3D& p2, double voxelSize);
 
 	bool planeAABBIntersect(const Point3D& normal, const Point3D& voxelCorner);
 
 	void findPlaneCubeIntersections(const Point3D& normal, const Point3D& voxelCorner, std::vector<Point3D>& intersectionPoints);
 
-	bool triangleIntersectsVoxel(const Point3D& voxelCorner, const Point3D& p1, const Point3D& p2, const Point3D& p3, int voxelSize);
+	bool triangleIntersectsVoxel(const Point3D& voxelCorner, const Point3D& p1, const Point3D& p2, const Point3D& p3, double voxelSize);
 
 	bool aabbIntersectsTriangle(const Point3D& min, const Point3D& max, const Point3D& p1, const Point3D& p2, const Point3D& p3);
 
 	bool isInsideTriangle(const Point3D& point, const Point3D& p1, const Point3D& p2, const Point3D& p3);
 
+	// Cells overlapping a triangle's bounding box: [first, last) along x, y and z
+	struct CellRange
+	{
+		size_t first[3];
+		size_t last[3];
+	};
+
+	// Function to list the corner coordinates of the cells along one axis: the lattice points min + n * voxelSize
+	// up to max. Every corner is computed from its index, so no rounding error builds up along the axis.
+	static std::vector<float> gridSteps(double min, double max, double voxelSize);
+
+	// Function to list the corner coordinates of count cells along one axis starting at origin
+	static std::vector<float> latticeSteps(double origin, size_t count, double voxelSize);
+
+	// Function to find the cells of a grid, given by its cell corners, that a triangle's bounding box overlaps
+	static CellRange cellRange(const Point3D& p1, const Point3D& p2, const Point3D& p3, const std::vector<float>& gridX, const std::vector<float>& gridY, const std::vector<float>& gridZ, double voxelSize);
+
 	// Function to set voxel size
-	void setVoxelSize(int inVoxelSize);
+	void setVoxelSize(double inVoxelSize);
+
+	// Function to set the traversal and triangle lookup
+	void setOptions(const VoxelizerOptions& inOptions);
 
 private:
-	// Private constructor taking filename and voxel size as parameters
-	Voxelizer(std::string fileName, int inVoxelSize);
+	// Private constructor taking filename, voxel size and run settings as parameters
+	Voxelizer(std::string fileName, double inVoxelSize, const VoxelizerOptions& inOptions);
+	// Private constructor of an empty instance, filled by loadVoxelizer
+	Voxelizer(double inVoxelSize, const VoxelizerOptions& inOptions);
 	// Private destructor
 	~Voxelizer();
 
 	// Function to create cubes from the input file
 	void makeCubes(std::string fileName);
 
+	// Function to set up every mesh triangle for the cell-driven tests at the current voxel size
+	void makeTriangles();
+
+	// Per-worker buffers reused from voxel to voxel, allocated from the given memory
+	struct Scratch
+	{
+		explicit Scratch(std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+		std::pmr::vector<int> candidates; // Triangles near the current voxel
+		std::pmr::vector<float> minX; // Corners of a row of voxels
+		std::pmr::vector<float> minY;
+		std::pmr::vector<float> minZ;
+		std::pmr::vector<unsigned char> hits; // Test result of each voxel of the row
+		std::pmr::vector<unsigned char> nearHits; // Result of the widened test of listedExtent for each voxel of the row
+		std::pmr::vector<unsigned long long> layer; // Occupancy of the x layer being marked
+	};
+
+	// Function to return the scratch buffers of every worker of a run, each in the arena of its worker
+	static std::vector<Scratch> workerScratch(RunArena& arena);
+
+	// Function to find the cells a triangle of the mesh may touch
+	CellRange cellRange(size_t triangle) const;
+
+	// Function to test every cell of the x layer i against the mesh
+	void markCellDriven(size_t i, Scratch& scratch);
+
+	// Function to find the cells of every triangle and list the triangles overlapping each x layer:
+	// those of layer i are layerTriangles[layerStart[i], layerStart[i + 1])
+	void listLayerTriangles(ThreadPool& pool, std::pmr::vector<CellRange>& ranges, std::pmr::vector<size_t>& layerStart, std::pmr::vector<int>& layerTriangles) const;
+
+	// Function to test the given triangles against the cells of the x layer i inside their bounding boxes.
+	// When hits is given, every cell and triangle passing the widened test with nearExtent, the listedExtent of
+	// the voxel size, are appended to it as well, the triangle as ~triangle when it does not touch the cell itself.
+	void markTriangleDriven(size_t i, const int* triangles, size_t count, const std::pmr::vector<CellRange>& ranges, Scratch& scratch, std::pmr::vector<std::pair<size_t, int>>* hits = nullptr, Vec3f nearExtent = Vec3f());
+
+	// Cells of one x layer near the surface and the triangles near each, kept for refine(). A triangle that
+	// touches the cell is listed as its index, one that only passes the widened test as ~index; a cell
+	// listing no touching triangle is not occupied.
+	struct LayerCells
+	{
+		std::vector<size_t> cells; // Cell j * sizeZ + k of every listed cell, ascending
+		std::vector<size_t> start; // Triangles of cells[n] are triangles[start[n], start[n + 1])
+		std::vector<int> triangles;
+
+		// Fill from (cell, triangle) pairs, which are sorted on the way
+		void assign(std::pmr::vector<std::pair<size_t, int>>& hits);
+	};
+
+	// Function to list the triangles touching every surface cell of the current grid
+	void collectSurfaceCells(ThreadPool& pool);
+
+	// Function to return the half extent of the boxes for which LayerCells lists triangles: half the voxel size
+	// widened by far more than the rounding of the single-precision tests. refine() only tests a fine cell
+	// against the triangles listed for the coarse cell holding it, so a triangle that touches the fine cell has
+	// to be listed even where rounding at the coarse size decides that it misses the coarse cell.
+	Vec3f listedExtent(double voxelSize) const;
+
+	// Function to test a voxel against the mesh using the given scratch buffers
+	bool intersectsAnyTriangle(const Point3D& voxelCorner, Scratch& scratch);
+
+	// Function to return the position of cell (j, k) in a layer bitset
+	size_t cellIndex(size_t j, size_t k) const;
+
+	// Function to build the geometry of the grid, and of its coarse level when selected
+	void makeGeometry() const;
+
+	// Function to drop the geometry, which is rebuilt on demand
+	void clearGeometry();
+
+	// Function to build the quads or cells of a grid with cell (0, 0, 0) at origin with the selected meshing,
+	// grouped into chunks
+	VoxelGeometry buildGeometry(const VoxelGrid& grid, const Point3D& origin, double voxelSize, VoxelMeshStats& stats) const;
+
+	// Function to return the grid at twice the voxel size in which a cell is occupied when any of its eight
+	// cells of mGrid is
+	VoxelGrid downsampledGrid(ThreadPool& pool) const;
+
+	// Function to count the occupied cells of every x layer of a grid: with valuesPerCell values per cell,
+	// the values of layer i start at entry i, and the last entry is the total
+	std::vector<size_t> layerOffsets(ThreadPool& pool, const VoxelGrid& grid, size_t valuesPerCell) const;
+
+	// Function to build the cubes of every occupied cell of a grid, in x, y, z order, between the given cell boundaries
+	VoxelMeshStats makeCubeGeometry(const VoxelGrid& grid, const std::vector<float>& planesX, const std::vector<float>& planesY, const std::vector<float>& planesZ, std::vector<float>& vertices) const;
+
+	// Function to list the indices of every occupied cell of a grid, in x, y, z order
+	VoxelMeshStats makeInstanceGeometry(const VoxelGrid& grid, std::vector<unsigned short>& cells) const;
+
 	// Function to add vertices for a cuboid defined by two points
-	void addCubicalVetices(const Point3D& point1, const Point3D& point2, int voxelSize);
+	void addCubicalVetices(const Point3D& point1, const Point3D& point2, double voxelSize);
 
-	// Function to add a cube with a specified corner and voxel size
-	void addCube(const Point3D& voxelCorner, int voxelSize);
+	// Function to add a cube with the given lower and upper corners to a vertex buffer
+	void addCube(const Point3D& lower, const Point3D& upper, std::vector<float>& vertices) const;
 
-	// Function to add a quad (a face of a cube) defined by four points
-	void addQuad(const Point3D& p1, const Point3D& p2, const Point3D& p3, const Point3D& p4);
+	// Function to add a quad (a face of a cube) defined by four points to a vertex buffer
+	void addQuad(const Point3D& p1, const Point3D& p2, const Point3D& p3, const Point3D& p4, std::vector<float>& vertices) const;
 
 private:
-	int mVoxelSize; // Voxel size
-	std::vector<float> mVertices; // Vector to store vertices of cubes
+	double mVoxelSize; // Voxel size, the spacing of the cell lattice
+	VoxelizerOptions mOptions; // Traversal and triangle lookup
+	mutable VoxelGeometry mGeometry; // Quads or cells of mGrid, built on demand and shared with snapshots and geometry()
+	mutable bool mHasGeometry; // Set once mGeometry holds the geometry of mGrid
+	mutable VoxelMeshStats mMeshStats; // Counts and time of the last geometry build
 	std::vector<float> mColors; // Vector to store colors of cubes
 	std::vector<float>mNormals;
-	std::vector<Point3D> mV;  // Member variable for vertices
-	std::vector<Point3D> mC;  // Member variable for colors
-	std::vector<Point3D> mN;  // Member variable for normals
+	Mesh mMesh; // Triangles read from the STL file
+	TriangleGrid mTriangleGrid; // Bins of the mesh triangles, built when the uniform grid is selected
+	std::vector<SatKernel::TriangleSetup, CacheLineAllocator<SatKernel::TriangleSetup>> mTriangleSetups; // Separating axis setup of every mesh triangle, built for the cell-driven traversal
+	double mTriangleSetupSize; // Voxel size mTriangleSetups were built for; 0 when there are none
+	Scratch mScratch; // Buffers for intersectsAnyTriangle calls from outside a voxelization run
+	std::vector<float> mGridX; // Corner coordinates of the cells along x
+	std::vector<float> mGridY; // Corner coordinates of the cells along y
+	std::vector<float> mGridZ; // Corner coordinates of the cells along z
+	VoxelGrid mGrid; // One bit per cell, set when the cell touches the mesh
+	std::vector<LayerCells> mSurfaceCells; // Triangles near the surface cells of each layer of mGrid, built by refine()
+	std::vector<VoxelGrid> mLevels; // Coarser grids replaced by refine(), coarsest first
+	std::vector<double> mLevelSizes; // Voxel size of each of mLevels
 };
@@ -3,10 +3,17 @@
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
 #include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLTimerQuery>
+#include <QElapsedTimer>
+#include <memory>
 #include <vector>
+#include <QMatrix4x4>
 #include <QQuaternion>
+#include <QVector3D>
 #include "Model/Point3D.h" // Including header file for Point3D class
 #include "Model/Triangle.h" // Including header file for Triangle class
+#include "Model/VoxelGeometry.h" // Including header file for VoxelGeometry struct
 
 class QOpenGLTexture;
 class QOpenGLShader;
@@ -20,6 +27,11 @@ class OpenGLWindow : public QOpenGLWidget, protected QOpenGLFunctions
 signals:
 	void shapeUpdate();
 
+	// Time the GPU took to draw a frame, including any upload of changed geometry. It is read back without waiting,
+	// so it arrives while the next frame is painted. Where timer queries are unsupported, the interval between the
+	// starts of the last two frames instead, which while rotating is the time per frame.
+	void frameTimed(double milliseconds);
+
 public:
 	// Constructor
 	OpenGLWindow(const QColor& background, QWidget* parent);
@@ -39,7 +51,13 @@ public:
 	void selectColor(const QColor& color);
 
 	// Render voxels
-	void voxelRenderer(std::string fileName, int voxelSize);
+	void voxelRenderer(std::string fileName, double voxelSize);
+
+	// Show voxel geometry built elsewhere, e.g. by a background voxelization: its quads, or one cube per listed cell
+	void showVoxels(const VoxelGeometry& geometry);
+
+	// Whether cells can be drawn as instanced cubes, which takes OpenGL 3.3; known once the window was initialized
+	bool supportsInstancing() const;
 
 	// Read shader code from file
 	QString readShader(QString filePath);
@@ -55,14 +73,65 @@ private:
 	// Reset OpenGL settings
 	void reset();
 
+	// Voxels of one level of detail on the GPU: a buffer per chunk with the bounds of its quads or cells
+	struct ChunkBuffer
+	{
+		QOpenGLBuffer buffer; // Quads or cell indices of the chunk
+		QVector3D min; // Lower corner of the bounds
+		QVector3D max; // Upper corner of the bounds
+		int count = 0; // Vertices of the quads, or cells
+	};
+	struct ChunkLevel
+	{
+		std::vector<ChunkBuffer> chunks; // Buffers of the non-empty chunks
+		QVector3D origin; // Lower corner of cell (0, 0, 0)
+		float cellSize = 1.0f; // Width of a cell
+	};
+
+	// Copy the geometry into the GPU buffers and drop the CPU copy; called from paintGL after it changed
+	void uploadGeometry();
+
+	// Replace the buffers of a level by one per chunk of the geometry
+	void uploadChunks(const VoxelGeometry& geometry, ChunkLevel& level);
+
+	// Free the buffers of a level
+	void destroyChunks(ChunkLevel& level);
+
+	// Draw the chunks of a level inside the view volume of the matrix
+	void drawChunks(const ChunkLevel& level, const QMatrix4x4& matrix);
+
+	// Point the position attribute and the element array at the GPU buffers
+	void bindAttributes();
+
+	// Start timing a frame, first reporting the time of an earlier one that is known by now
+	void beginFrameTiming();
+
+	// Stop timing the frame
+	void endFrameTiming();
+
 	QOpenGLShader* mVshader = nullptr; // Vertex shader
 	QOpenGLShader* mFshader = nullptr; // Fragment shader
 	QOpenGLShaderProgram* mProgram = nullptr; // Shader program
+	QOpenGLShaderProgram* mInstanceProgram = nullptr; // Shader program placing a unit cube at each cell
 	QOpenGLBuffer mVbo; // Vertex buffer object
+	QOpenGLBuffer mIndexBuffer; // Edge indices of the STL wireframe on the GPU
+	QOpenGLVertexArrayObject mVao; // Attribute setup of the buffers; not created where vertex array objects are unsupported
+	bool mGeometryChanged = false; // Set when mVertices, mIndices and mVoxels hold geometry not uploaded yet
+	int mIndexCount = 0; // Indices in mIndexBuffer
+	bool mInstancing = false; // Set when the context runs the instanced cube shaders
+	QOpenGLBuffer mCubeBuffer; // Triangles of the unit cube drawn for every cell
+	QOpenGLVertexArrayObject mInstanceVao; // Attribute setup of the unit cube and the cells
+	bool mInstanced = false; // Set when the uploaded voxels are cells to draw as instanced cubes rather than quads
+	ChunkLevel mFine; // Voxels at the voxel size
+	ChunkLevel mCoarse; // Voxels at twice the voxel size, drawn once a cell gets smaller than a pixel; may be empty
 	int mVertexAttr; // Vertex attribute location
 	int mNormalAttr; // Normal attribute location
 	int mMatrixUniform; // Matrix uniform location
 	QColor mBackground; // Background color
+	QOpenGLTimerQuery mFrameQuery; // GPU time of a frame; not created where timer queries are unsupported
+	bool mFrameTiming = false; // Set while mFrameQuery times the frame being painted
+	bool mFrameQueryPending = false; // Set while the time of a finished frame has not been read back
+	QElapsedTimer mFrameInterval; // Time since the last frame started, reported without timer queries
 	
 	GLint m_posAttr = 0; // Attribute location for position
 	GLint m_colAttr = 0; // Attribute location for color
@@ -70,12 +139,9 @@ private:
 	GLint m_matrixUniform = 0; // Uniform location for matrix
 
 
-	std::vector<float> mVertices; // Vertices
-	std::vector<float> mColors; // Colors
-	std::vector<float> mNormals; // Normals
-	std::vector<Point3D> mV; // Vector of points for vertices
-	std::vector<Point3D> mC; // Vector of points for colors
-	std::vector<Point3D> mN; // Vector of points for normals
+	std::shared_ptr<const std::vector<float>> mVertices; // Vertices of the STL wireframe, until they are uploaded
+	std::vector<unsigned int> mIndices; // Edge indices of the STL wireframe, until they are uploaded
+	VoxelGeometry mVoxels; // Voxels, until they are uploaded; the buffers are shared with the voxelizer
 
 	int gridSize = 12; // Grid size
 	float zoomFactor = 1.0f; // Zoom factor
@@ -1,8 +1,15 @@
 #include "Controller/Visualizer.h"
 #include <QtWidgets/QApplication>
+#include <QSurfaceFormat>
 
 int main(int argc, char *argv[])
 {
+    // OpenGL 3.3 for the instanced voxel shaders, with the compatibility profile the other shaders and GL_QUADS need
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+
     QApplication a(argc, argv);
     Visualizer w;
     w.show();
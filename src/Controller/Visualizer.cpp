@@ -1,10 +1,13 @@
 #include<string>
+#include <QMessageBox>
 #include <QRandomGenerator>
+#include <QStatusBar>
 #include "Model/Voxelizer.h"
 #include "Model/stdafx.h"
 #include "Model/STLReader.h"
 #include "View/OpenGLWindow.h"
 #include "Controller/Visualizer.h"
+#include "Controller/VoxelizationJob.h"
 
 Visualizer::Visualizer()
 {
@@ -15,8 +18,11 @@ Visualizer::Visualizer()
 	mRenderButton->setVisible(false);
 	mSizeLabel->setVisible(false);
 	mSpinBox->setVisible(false);
+	mInstancedCheckBox->setVisible(false);
 	mVoxelizeButton->setVisible(false);
 	mColorDialogButton->setVisible(false);
+	mSaveButton->setVisible(false);
+	mProgressBar->setVisible(false);
 
 	// Assign random background color to buttons
 	setRandomBackgroundColor(mBrowseButton);
@@ -24,12 +30,32 @@ Visualizer::Visualizer()
 	setRandomBackgroundColor(mSpinBox);
 	setRandomBackgroundColor(mVoxelizeButton);
 	setRandomBackgroundColor(mColorDialogButton);
+	setRandomBackgroundColor(mSaveButton);
 
 	// Connect signals and slots
 	connect(mBrowseButton, &QPushButton::clicked, this, &Visualizer::openFileDialog);
 	connect(mRenderButton, &QPushButton::clicked, this, &Visualizer::renderSTL);
 	connect(mVoxelizeButton, &QPushButton::clicked, this, &Visualizer::voxelizeSTL);
 	connect(mColorDialogButton, &QPushButton::clicked, this, &Visualizer::onColorDialogButtonClicked);
+	connect(mSaveButton, &QPushButton::clicked, this, &Visualizer::saveVoxels);
+
+	// Voxelization runs in the background and reports back on this thread
+	mVoxelizationJob = new VoxelizationJob(this);
+	connect(mVoxelizationJob, &VoxelizationJob::progress, this, [this](double fraction) {
+		mProgressBar->setValue(static_cast<int>(fraction * 100.0));
+	});
+	connect(mVoxelizationJob, &VoxelizationJob::preview, this, &Visualizer::voxelizationPreview);
+	connect(mVoxelizationJob, &VoxelizationJob::finished, this, &Visualizer::voxelizationFinished);
+	connect(mVoxelizationJob, &VoxelizationJob::failed, this, &Visualizer::voxelizationFailed);
+	// A different voxel size makes the running voxelization pointless
+	connect(mSpinBox, &QDoubleSpinBox::valueChanged, this, &Visualizer::cancelVoxelization);
+
+	// Frame time counter, to check that rotating a large part stays smooth
+	mFrameTimeLabel = new QLabel(this);
+	statusBar()->addPermanentWidget(mFrameTimeLabel);
+	connect(mRenderer, &OpenGLWindow::frameTimed, this, [this](double milliseconds) {
+		mFrameTimeLabel->setText(tr("Frame: %1 ms").arg(milliseconds, 0, 'f', 2));
+	});
 
 }
 
@@ -79,14 +105,21 @@ void Visualizer::setupUi()
 	mGridLayout->addWidget(mSizeLabel, 25, 9, 2, 1);
 
 	// Spin Box for voxel size
-	mSpinBox = new QSpinBox(this);
-	// Set spin box properties
-	mSpinBox->setMinimum(5); // Set minimum value
+	mSpinBox = new QDoubleSpinBox(this);
+	// Set spin box properties; the voxel size need not be a whole number
+	mSpinBox->setDecimals(2);
+	mSpinBox->setMinimum(0.01); // Set minimum value
 	mSpinBox->setMaximum(100); // Set maximum value
-	mSpinBox->setValue(1); // Set default value
+	mSpinBox->setSingleStep(0.5);
+	mSpinBox->setValue(5); // Set default value
 	// Add to layout
 	mGridLayout->addWidget(mSpinBox, 28, 9, 2, 1);
 
+	// Check box for instanced voxel drawing, which uploads one cell index per voxel instead of quads
+	mInstancedCheckBox = new QCheckBox("Instanced", this);
+	// Add to layout
+	mGridLayout->addWidget(mInstancedCheckBox, 32, 9, 2, 1);
+
 	// Voxelize button
 	mVoxelizeButton = new QPushButton("Voxelize", this);
 	// Set button properties
@@ -96,6 +129,14 @@ void Visualizer::setupUi()
 	// Add to layout
 	mGridLayout->addWidget(mVoxelizeButton, 38, 9, 2, 1);
 
+	// Progress bar for the running voxelization
+	mProgressBar = new QProgressBar(this);
+	// Set progress bar properties
+	mProgressBar->setFixedWidth(150);
+	mProgressBar->setRange(0, 100);
+	// Add to layout
+	mGridLayout->addWidget(mProgressBar, 42, 9, 2, 1);
+
 	// Color dialog button
 	mColorDialogButton = new QPushButton("Color", this);
 	// Set button properties
@@ -105,9 +146,19 @@ void Visualizer::setupUi()
 	// Add to layout
 	mGridLayout->addWidget(mColorDialogButton, 48, 9, 2, 1);
 
+	// Save voxels button
+	mSaveButton = new QPushButton("Save Voxels", this);
+	// Set button properties
+	mSaveButton->setFixedSize(150, 50);
+	mSaveButton->setFont(font);
+	mSaveButton->setStyleSheet("border: 5px solid black;"); // Apply border style
+	// Add to layout
+	mGridLayout->addWidget(mSaveButton, 58, 9, 2, 1);
+
 	// Set font for labels
 	mSizeLabel->setFont(font);
 	mSpinBox->setFont(font);
+	mInstancedCheckBox->setFont(font);
 
 	// Set layout
 	mWidget = new QWidget(this);
@@ -136,7 +187,7 @@ void Visualizer::setRandomBackgroundColor(QPushButton* button)
 }
 
 // Set random background color to the spin box
-void Visualizer::setRandomBackgroundColor(QSpinBox* spinBox)
+void Visualizer::setRandomBackgroundColor(QDoubleSpinBox* spinBox)
 {
 	spinBox->setStyleSheet(QString("background-color: %1").arg(randomColor()));
 }
@@ -145,29 +196,43 @@ void Visualizer::setRandomBackgroundColor(QSpinBox* spinBox)
 void Visualizer::openFileDialog()
 {
 	// Show render button and hide other controls
+	cancelVoxelization();
 	mRenderButton->setVisible(true);
 	mSizeLabel->setVisible(false);
 	mSpinBox->setVisible(false);
+	mInstancedCheckBox->setVisible(false);
 	mVoxelizeButton->setVisible(false);
 	mColorDialogButton->setVisible(false);
+	mSaveButton->setVisible(false);
 
-	// Open file dialog to select STL file
-	QString qFileName = QFileDialog::getOpenFileName(this, tr("Open STL File"), "", tr("STL Files (*.stl)"));
+	// Open file dialog to select STL file or a voxel file saved earlier
+	QString qFileName = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("Models (*.stl *.vox);;STL Files (*.stl);;Voxel Files (*.vox)"));
 
 	if (!qFileName.isEmpty())
 	{
 		fileName = qFileName.toStdString();
 	}
+
+	// A voxel file is shown right away, there is nothing to render or voxelize first
+	if (qFileName.endsWith(".vox", Qt::CaseInsensitive))
+	{
+		mRenderButton->setVisible(false);
+		loadVoxels();
+	}
 }
 
 // Slot for rendering the STL file
 void Visualizer::renderSTL()
 {
 	// Show voxel size controls
+	cancelVoxelization();
 	mSizeLabel->setVisible(true);
 	mSpinBox->setVisible(true);
+	mInstancedCheckBox->setVisible(true);
+	mInstancedCheckBox->setEnabled(mRenderer->supportsInstancing());
 	mVoxelizeButton->setVisible(true);
 	mColorDialogButton->setVisible(false);
+	mSaveButton->setVisible(false);
 
 	// Call STL renderer in OpenGLWindow
 	mRenderer->STLRenderer(fileName);
@@ -176,14 +241,85 @@ void Visualizer::renderSTL()
 // Slot for voxelizing the STL file
 void Visualizer::voxelizeSTL()
 {
-	// Show color dialog button
+	// Get voxel size from spin box
+	double voxelSize = mSpinBox->value();
+
+	// Voxelize in the background; a request still running is dropped
+	mProgressBar->setValue(0);
+	mProgressBar->setVisible(true);
+	mVoxelizationTimer.start();
+	updateMeshing();
+	mVoxelizationJob->start(fileName, voxelSize);
+}
+
+// Slot for loading the selected voxel file
+void Visualizer::loadVoxels()
+{
+	// Decode in the background; a request still running is dropped
+	mProgressBar->setValue(0);
+	mProgressBar->setVisible(true);
+	mVoxelizationTimer.start();
+	updateMeshing();
+	mVoxelizationJob->load(fileName);
+}
+
+// Slot for saving the shown voxels
+void Visualizer::saveVoxels()
+{
+	QString qFileName = QFileDialog::getSaveFileName(this, tr("Save Voxels"), "", tr("Voxel Files (*.vox)"));
+	if (!qFileName.isEmpty() && !mVoxelizationJob->save(qFileName.toStdString()))
+	{
+		QMessageBox::warning(this, tr("Save Voxels"), tr("The voxel file cannot be written."));
+	}
+}
+
+// Instanced cubes need a renderer with OpenGL 3.3; otherwise the greedy quads are drawn
+void Visualizer::updateMeshing()
+{
+	bool instanced = mInstancedCheckBox->isChecked() && mRenderer->supportsInstancing();
+	mVoxelizationJob->setMeshing(instanced ? VoxelizerOptions::Meshing::Instances : VoxelizerOptions::Meshing::Greedy);
+}
+
+// Slot for the geometry of a coarser level, shown until the finer one is ready
+void Visualizer::voxelizationPreview(const VoxelGeometry& geometry)
+{
+	mRenderer->showVoxels(geometry);
+	statusBar()->showMessage(tr("Voxel size %1 ready, refining...").arg(geometry.voxelSize));
+}
+
+// Slot for the geometry of the finished voxelization
+void Visualizer::voxelizationFinished(const VoxelGeometry& geometry)
+{
+	mProgressBar->setVisible(false);
+
+	// Show color dialog and save buttons
 	mColorDialogButton->setVisible(true);
+	mSaveButton->setVisible(mVoxelizationJob->hasResult());
 
-	// Get voxel size from spin box
-	int voxelSize = mSpinBox->value();
+	mRenderer->showVoxels(geometry);
+
+	// Show how long it took and how often the result cache helped
+	VoxelCacheStats stats = mVoxelizationJob->cacheStats();
+	statusBar()->showMessage(tr("Voxels ready in %1 ms. Cache: %2 memory hits, %3 disk hits, %4 misses, %5 MB in memory")
+		.arg(mVoxelizationTimer.elapsed())
+		.arg(stats.memoryHits)
+		.arg(stats.diskHits)
+		.arg(stats.misses)
+		.arg(stats.memoryBytes >> 20));
+}
 
-	// Emit signal to voxelize STL in OpenGLWindow
-	emit mRenderer->voxelRenderer(fileName, voxelSize);
+// Slot for a voxelization that produced no voxels
+void Visualizer::voxelizationFailed(const QString& reason)
+{
+	mProgressBar->setVisible(false);
+	QMessageBox::warning(this, tr("Voxelizer"), reason);
+}
+
+// Slot for dropping the running voxelization
+void Visualizer::cancelVoxelization()
+{
+	mVoxelizationJob->cancel();
+	mProgressBar->setVisible(false);
 }
 
 void Visualizer::onColorDialogButtonClicked()
@@ -0,0 +1,269 @@
+#include <QStandardPaths>
+#include <QThread>
+#include "Controller/VoxelizationJob.h"
+#include "Model/Voxelizer.h"
+
+namespace
+{
+	// Default caps of the result cache
+	const size_t cacheMemoryBudget = size_t(512) << 20;
+	const unsigned long long cacheDiskBudget = 2ULL << 30;
+
+	// Halvings between the first, coarsest level of a voxelization and the requested voxel size
+	const int previewLevels = 2;
+
+	// Whether halving the voxel size from reaches to; halving a double is exact, so 1.6 reaches 0.4
+	bool reachesByHalving(double from, double to)
+	{
+		while (from > to)
+		{
+			from /= 2;
+		}
+		return from == to;
+	}
+
+	// Run settings without the callbacks of a request, for a voxelizer that outlives it
+	VoxelizerOptions withoutCallbacks(VoxelizerOptions options)
+	{
+		options.progress = nullptr;
+		options.cancel = nullptr;
+		return options;
+	}
+}
+
+VoxelizationJob::VoxelizationJob(QObject* parent) : QObject(parent)
+{
+	QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	mCache.reset(new VoxelCache(cacheMemoryBudget, directory.isEmpty() ? std::string() : (directory + "/voxels").toStdString(), cacheDiskBudget));
+}
+
+VoxelizationJob::~VoxelizationJob()
+{
+	cancel();
+	for (QThread* thread : mThreads)
+	{
+		thread->wait();
+		delete thread;
+	}
+}
+
+void VoxelizationJob::start(const std::string& fileName, double voxelSize)
+{
+	// The voxelizer of the last request goes along when halving its size reaches the new one. Only one thread may
+	// refine it, so it is moved out and comes back through postRefinable, also when the request is cancelled.
+	std::shared_ptr<Voxelizer> previous;
+	if (mRefinable && mRefinableFile == fileName && reachesByHalving(mRefinable->levelVoxelSize(mRefinable->levelCount() - 1), voxelSize))
+	{
+		previous = std::move(mRefinable);
+	}
+	run([this, fileName, voxelSize, previous](const VoxelizerOptions& options, quint64 request) {
+		return voxelize(fileName, voxelSize, previous, options, request);
+	});
+}
+
+void VoxelizationJob::load(const std::string& voxelFileName)
+{
+	run([voxelFileName](const VoxelizerOptions& options, quint64) {
+		std::shared_ptr<Voxelizer> voxelizer = Voxelizer::loadVoxelizer(voxelFileName, options);
+		if (voxelizer)
+		{
+			voxelizer->freeze();
+		}
+		return std::shared_ptr<const Voxelizer>(voxelizer);
+	});
+}
+
+std::shared_ptr<const Voxelizer> VoxelizationJob::voxelize(const std::string& fileName, double voxelSize, std::shared_ptr<Voxelizer> previous, const VoxelizerOptions& options, quint64 request)
+{
+	std::shared_ptr<const Voxelizer> cached = mCache->find(fileName, voxelSize, options);
+	if (cached)
+	{
+		if (previous)
+		{
+			postRefinable(request, fileName, previous);
+		}
+		return cached;
+	}
+
+	// Each level reports its share of the progress
+	int levels = 1;
+	double size = previous ? previous->levelVoxelSize(previous->levelCount() - 1) : voxelSize * (1 << previewLevels);
+	for (double levelSize = size; levelSize > voxelSize; levelSize /= 2)
+	{
+		levels++;
+	}
+	int level = previous ? 1 : 0;
+	VoxelizerOptions levelOptions = options;
+	levelOptions.progress = [&options, &level, levels](double fraction) {
+		options.progress((level + fraction) / levels);
+	};
+
+	std::shared_ptr<Voxelizer> voxelizer = previous;
+	if (voxelizer)
+	{
+		voxelizer->setOptions(levelOptions);
+	}
+	else
+	{
+		voxelizer = Voxelizer::getVoxelizer(fileName, size, levelOptions);
+	}
+	while (!voxelizer->cancelled() && voxelizer->levelVoxelSize(voxelizer->levelCount() - 1) > voxelSize)
+	{
+		postPreview(request, *voxelizer);
+		level++;
+		if (!voxelizer->refine())
+		{
+			break;
+		}
+	}
+	if (voxelizer->cancelled())
+	{
+		// A cancelled refine leaves the voxelizer at its last finished level, so a later request can go on from it
+		if (previous)
+		{
+			voxelizer->setOptions(withoutCallbacks(options));
+			postRefinable(request, fileName, voxelizer);
+		}
+		return nullptr;
+	}
+
+	// The cache gets a frozen copy, while the voxelizer itself is kept for refining further. It is stored
+	// under the key of a direct run, which holds because refining marks the same cells (Benchmarks
+	// refine-check compares the two), but only once it reached the requested size.
+	voxelizer->setOptions(withoutCallbacks(options));
+	std::shared_ptr<const Voxelizer> result = voxelizer->snapshot();
+	if (voxelizer->levelVoxelSize(voxelizer->levelCount() - 1) == voxelSize)
+	{
+		mCache->insert(fileName, voxelSize, options, result);
+	}
+	postRefinable(request, fileName, voxelizer);
+	return result;
+}
+
+void VoxelizationJob::postPreview(quint64 request, const Voxelizer& voxelizer)
+{
+	// The geometry shares the buffers of the voxelizer, so it is cheap to capture by value
+	VoxelGeometry geometry = voxelizer.geometry();
+	QMetaObject::invokeMethod(this, [this, request, geometry]() {
+		if (request == mRequest)
+		{
+			emit preview(geometry);
+		}
+	}, Qt::QueuedConnection);
+}
+
+void VoxelizationJob::postRefinable(quint64 request, const std::string& fileName, const std::shared_ptr<Voxelizer>& voxelizer)
+{
+	QMetaObject::invokeMethod(this, [this, request, fileName, voxelizer]() {
+		// A stale request still hands back the voxelizer it took, unless a later one has left its own meanwhile
+		if (request == mRequest || !mRefinable)
+		{
+			mRefinable = voxelizer;
+			mRefinableFile = fileName;
+		}
+	}, Qt::QueuedConnection);
+}
+
+void VoxelizationJob::run(const std::function<std::shared_ptr<const Voxelizer>(const VoxelizerOptions&, quint64)>& make)
+{
+	// The previous request keeps running until it notices the flag, but it can no longer report
+	cancel();
+	quint64 request = ++mRequest;
+	std::shared_ptr<std::atomic<bool>> cancelFlag = std::make_shared<std::atomic<bool>>(false);
+	mCancel = cancelFlag;
+
+	QThread* thread = QThread::create([this, make, request, cancelFlag, meshing = mMeshing]() {
+		VoxelizerOptions options;
+		options.meshing = meshing;
+		options.coarseLevel = true; // The view swaps it in when cells shrink below a pixel
+		options.cancel = cancelFlag.get();
+		options.progress = [this, request](double fraction) {
+			// Queued onto the GUI thread, where mRequest lives
+			QMetaObject::invokeMethod(this, [this, request, fraction]() {
+				if (request == mRequest)
+				{
+					emit progress(fraction);
+				}
+			}, Qt::QueuedConnection);
+		};
+
+		std::shared_ptr<const Voxelizer> voxelizer = make(options, request);
+		if (cancelFlag->load())
+		{
+			return;
+		}
+		if (!voxelizer)
+		{
+			QMetaObject::invokeMethod(this, [this, request]() {
+				if (request == mRequest)
+				{
+					mCancel.reset();
+					emit failed(tr("The voxel file cannot be read."));
+				}
+			}, Qt::QueuedConnection);
+			return;
+		}
+
+		// The quads were built with the result, so the GUI thread only takes over finished buffers
+		VoxelGeometry geometry = voxelizer->geometry();
+		QMetaObject::invokeMethod(this, [this, request, voxelizer, geometry]() {
+			if (request == mRequest)
+			{
+				mCancel.reset();
+				mResult = voxelizer;
+				emit finished(geometry);
+			}
+		}, Qt::QueuedConnection);
+	});
+
+	mThreads.append(thread);
+	connect(thread, &QThread::finished, this, [this, thread]() { threadFinished(thread); });
+	thread->start(QThread::LowPriority);
+}
+
+void VoxelizationJob::cancel()
+{
+	if (mCancel)
+	{
+		mCancel->store(true);
+		mCancel.reset();
+	}
+	// Whatever the old request still reports is stale from now on
+	++mRequest;
+}
+
+bool VoxelizationJob::isRunning() const
+{
+	return mCancel != nullptr;
+}
+
+bool VoxelizationJob::hasResult() const
+{
+	return mResult != nullptr;
+}
+
+bool VoxelizationJob::save(const std::string& voxelFileName) const
+{
+	return mResult && mResult->saveVoxels(voxelFileName);
+}
+
+void VoxelizationJob::setMeshing(VoxelizerOptions::Meshing meshing)
+{
+	mMeshing = meshing;
+}
+
+void VoxelizationJob::setCacheBudgets(size_t memoryBudget, unsigned long long diskBudget)
+{
+	mCache->setBudgets(memoryBudget, diskBudget);
+}
+
+VoxelCacheStats VoxelizationJob::cacheStats() const
+{
+	return mCache->stats();
+}
+
+void VoxelizationJob::threadFinished(QThread* thread)
+{
+	mThreads.removeOne(thread);
+	thread->deleteLater();
+}
@@ -1,6 +1,6 @@
 #include "Model/GeomContainer.h"
 
-GeomContainer::GeomContainer()
+GeomContainer::GeomContainer() : mMesh(nullptr)
 {
     // Constructor: Initialize member vectors
     mVertices.clear();
@@ -8,47 +8,60 @@ GeomContainer::GeomContainer()
     mNormals.clear();
 }
 
-GeomContainer::GeomContainer(std::vector<Point3D> inPoints) : mPoints(inPoints)
+GeomContainer::GeomContainer(const Mesh& inMesh) : mMesh(&inMesh)
 {
-    // Constructor with points: Initialize member vectors
+    // Constructor with a mesh: Initialize member vectors
     mVertices.clear();
     mColors.clear();
     mNormals.clear();
 }
 
-GeomContainer* GeomContainer::getContainer()
+std::unique_ptr<GeomContainer> GeomContainer::getContainer()
 {
-    // Factory method to create a GeomContainer instance
-    GeomContainer* geomContainer = new GeomContainer();
-    return geomContainer;
+    // Factory method to create a GeomContainer instance; the constructors are private, so no make_unique
+    return std::unique_ptr<GeomContainer>(new GeomContainer());
 }
 
-GeomContainer* GeomContainer::getContainer(std::vector<Point3D> inPoints)
+std::unique_ptr<GeomContainer> GeomContainer::getContainer(const Mesh& inMesh)
 {
-    // Factory method to create a GeomContainer instance with points
-    GeomContainer* geomContainer = new GeomContainer(inPoints);
-    return geomContainer;
+    // Factory method to create a GeomContainer instance with a mesh
+    return std::unique_ptr<GeomContainer>(new GeomContainer(inMesh));
 }
 
 void GeomContainer::makeTriangleVertices()
 {
-    // Clear existing vertices, colors, and normals
+    // Clear existing vertices, colors, normals and indices
     mVertices.clear();
     mColors.clear();
     mNormals.clear();
-
-    // Iterate over points and populate vectors
-    for (int i = 0; i < mPoints.size(); i++)
+    mIndices.clear();
+    if (mMesh == nullptr)
     {
-        mVertices.push_back(mPoints[i].x());
-        mVertices.push_back(mPoints[i].y());
-        mVertices.push_back(mPoints[i].z());
+        return;
+    }
 
+    // The welded vertices are shared by every triangle that uses them
+    mVertices = mMesh->positions();
+    mNormals = mMesh->normals();
+    mColors.reserve(mVertices.size());
+    for (size_t i = 0; i < mMesh->vertexCount(); i++)
+    {
         mColors.push_back(mColor.x());
         mColors.push_back(mColor.y());
         mColors.push_back(mColor.z());
+    }
 
-        mNormals.push_back(mPoints[i].normal());
+    // Outline every triangle with its three edges
+    const std::vector<unsigned int>& triangles = mMesh->indices();
+    mIndices.reserve(2 * triangles.size());
+    for (size_t i = 0; i < triangles.size(); i += 3)
+    {
+        mIndices.push_back(triangles[i]);
+        mIndices.push_back(triangles[i + 1]);
+        mIndices.push_back(triangles[i + 1]);
+        mIndices.push_back(triangles[i + 2]);
+        mIndices.push_back(triangles[i + 2]);
+        mIndices.push_back(triangles[i]);
     }
 }
 
@@ -91,20 +104,42 @@ void GeomContainer::makeQuadVertices(const Point3D& p1, const Point3D& p2, const
     mColors.push_back(mColor.z());
 }
 
-std::vector<float> GeomContainer::vertices()
+const std::vector<float>& GeomContainer::vertices() const
 {
     // Getter method for vertices
     return mVertices;
 }
 
-std::vector<float> GeomContainer::colors()
+const std::vector<float>& GeomContainer::colors() const
 {
     // Getter method for colors
     return mColors;
 }
 
-std::vector<float> GeomContainer::normals()
+const std::vector<float>& GeomContainer::normals() const
 {
     // Getter method for normals
     return mNormals;
+}
+
+const std::vector<unsigned int>& GeomContainer::indices() const
+{
+    // Getter method for edge indices
+    return mIndices;
+}
+
+std::vector<float> GeomContainer::releaseVertices()
+{
+    // Move the vertices out instead of copying them
+    std::vector<float> vertices;
+    vertices.swap(mVertices);
+    return vertices;
+}
+
+std::vector<unsigned int> GeomContainer::releaseIndices()
+{
+    // Move the edge indices out instead of copying them
+    std::vector<unsigned int> indices;
+    indices.swap(mIndices);
+    return indices;
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "Model/MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : mData(nullptr), mSize(0), mOpen(false)
+#ifdef _WIN32
+    , mFile(INVALID_HANDLE_VALUE), mMapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filePath)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    mFile = file;
+    mSize = static_cast<size_t>(fileSize.QuadPart);
+    if (mSize > 0)
+    {
+        mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMapping == nullptr)
+        {
+            close();
+            return false;
+        }
+        mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+        if (mData == nullptr)
+        {
+            close();
+            return false;
+        }
+    }
+#else
+    int file = ::open(filePath.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0)
+    {
+        ::close(file);
+        return false;
+    }
+    mSize = static_cast<size_t>(status.st_size);
+    if (mSize > 0)
+    {
+        void* mapping = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping == MAP_FAILED)
+        {
+            ::close(file);
+            mSize = 0;
+            return false;
+        }
+        // The file is read front to back
+        madvise(mapping, mSize, MADV_SEQUENTIAL);
+        mData = static_cast<const char*>(mapping);
+    }
+    // The mapping stays valid after the descriptor is closed
+    ::close(file);
+#endif
+
+    mOpen = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (mData != nullptr)
+    {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping != nullptr)
+    {
+        CloseHandle(mMapping);
+        mMapping = nullptr;
+    }
+    if (mFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData != nullptr)
+    {
+        munmap(const_cast<char*>(mData), mSize);
+    }
+#endif
+    mData = nullptr;
+    mSize = 0;
+    mOpen = false;
+}
+
+bool MappedFile::isOpen() const
+{
+    return mOpen;
+}
+
+const char* MappedFile::data() const
+{
+    return mData;
+}
+
+size_t MappedFile::size() const
+{
+    return mSize;
+}
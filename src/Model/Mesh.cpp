@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstring>
+#include "Model/Mesh.h"
+
+Mesh::Mesh()
+{
+}
+
+Mesh::~Mesh()
+{
+}
+
+void Mesh::clear()
+{
+    mPositions.clear();
+    mIndices.clear();
+    mNormals.clear();
+    mSlots.clear();
+}
+
+void Mesh::reserve(size_t triangleCount)
+{
+    mIndices.reserve(3 * triangleCount);
+    mNormals.reserve(3 * triangleCount);
+    // A closed mesh has about half as many vertices as triangles
+    mPositions.reserve(3 * (triangleCount / 2 + 3));
+}
+
+void Mesh::addTriangle(const float normal[3], const float p1[3], const float p2[3], const float p3[3])
+{
+    mIndices.push_back(weld(p1));
+    mIndices.push_back(weld(p2));
+    mIndices.push_back(weld(p3));
+    mNormals.insert(mNormals.end(), normal, normal + 3);
+}
+
+void Mesh::shrinkToFit()
+{
+    std::vector<unsigned int>().swap(mSlots);
+    mPositions.shrink_to_fit();
+    mIndices.shrink_to_fit();
+    mNormals.shrink_to_fit();
+}
+
+size_t Mesh::vertexCount() const
+{
+    return mPositions.size() / 3;
+}
+
+size_t Mesh::triangleCount() const
+{
+    return mIndices.size() / 3;
+}
+
+bool Mesh::empty() const
+{
+    return mIndices.empty();
+}
+
+const std::vector<float>& Mesh::positions() const
+{
+    return mPositions;
+}
+
+const std::vector<unsigned int>& Mesh::indices() const
+{
+    return mIndices;
+}
+
+const std::vector<float>& Mesh::normals() const
+{
+    return mNormals;
+}
+
+Point3D Mesh::vertex(size_t index) const
+{
+    const float* p = mPositions.data() + 3 * index;
+    return Point3D(p[0], p[1], p[2]);
+}
+
+Point3D Mesh::corner(size_t triangle, int index) const
+{
+    return vertex(mIndices[3 * triangle + index]);
+}
+
+const float* Mesh::cornerPosition(size_t triangle, int index) const
+{
+    return mPositions.data() + 3 * mIndices[3 * triangle + index];
+}
+
+Point3D Mesh::normal(size_t triangle) const
+{
+    const float* n = mNormals.data() + 3 * triangle;
+    return Point3D(n[0], n[1], n[2]);
+}
+
+void Mesh::bounds(Point3D& min, Point3D& max) const
+{
+    if (mPositions.empty())
+    {
+        return;
+    }
+    float lower[3] = { mPositions[0], mPositions[1], mPositions[2] };
+    float upper[3] = { mPositions[0], mPositions[1], mPositions[2] };
+    for (size_t i = 3; i < mPositions.size(); i += 3)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            lower[axis] = std::min(lower[axis], mPositions[i + axis]);
+            upper[axis] = std::max(upper[axis], mPositions[i + axis]);
+        }
+    }
+    min = Point3D(lower[0], lower[1], lower[2]);
+    max = Point3D(upper[0], upper[1], upper[2]);
+}
+
+size_t Mesh::memoryBytes() const
+{
+    return mPositions.capacity() * sizeof(float) + mIndices.capacity() * sizeof(unsigned int) +
+        mNormals.capacity() * sizeof(float) + mSlots.capacity() * sizeof(unsigned int);
+}
+
+size_t Mesh::hashPosition(const float p[3])
+{
+    unsigned int bits[3];
+    std::memcpy(bits, p, sizeof(bits));
+    unsigned long long h = bits[0] * 0x9E3779B97F4A7C15ULL;
+    h = (h ^ bits[1]) * 0xC2B2AE3D27D4EB4FULL;
+    h = (h ^ bits[2]) * 0x165667B19E3779F9ULL;
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+void Mesh::rehash(size_t slotCount)
+{
+    mSlots.assign(slotCount, 0);
+    size_t mask = slotCount - 1;
+    for (size_t vertex = 0; vertex < vertexCount(); vertex++)
+    {
+        size_t slot = hashPosition(mPositions.data() + 3 * vertex) & mask;
+        while (mSlots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        mSlots[slot] = static_cast<unsigned int>(vertex + 1);
+    }
+}
+
+unsigned int Mesh::weld(const float p[3])
+{
+    // Adding zero turns -0 into +0, so both weld to the same vertex
+    float key[3] = { p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f };
+
+    // Keep the table at most half full
+    if (2 * (vertexCount() + 1) > mSlots.size())
+    {
+        size_t slotCount = 1024;
+        while (slotCount < 4 * (vertexCount() + 1))
+        {
+            slotCount *= 2;
+        }
+        rehash(slotCount);
+    }
+
+    size_t mask = mSlots.size() - 1;
+    size_t slot = hashPosition(key) & mask;
+    while (mSlots[slot] != 0)
+    {
+        unsigned int vertex = mSlots[slot] - 1;
+        if (std::memcmp(mPositions.data() + 3 * vertex, key, sizeof(key)) == 0)
+        {
+            return vertex;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int vertex = static_cast<unsigned int>(vertexCount());
+    mPositions.insert(mPositions.end(), key, key + 3);
+    mSlots[slot] = vertex + 1;
+    return vertex;
+}
@@ -1,3 +1,4 @@
+#include <cmath>
 #include "../headers/Model/Point3D.h"
 
 // Default constructor
@@ -0,0 +1,29 @@
+#include "Model/RunArena.h"
+
+RunArena::RunArena(int workerCount) : mShared(initialBlockSize)
+{
+    for (int worker = 0; worker < workerCount; worker++)
+    {
+        mWorkers.emplace_back(new std::pmr::monotonic_buffer_resource(initialBlockSize));
+    }
+}
+
+RunArena::~RunArena()
+{
+    // The monotonic resources hand their blocks back as they are destroyed
+}
+
+std::pmr::memory_resource* RunArena::shared()
+{
+    return &mShared;
+}
+
+std::pmr::memory_resource* RunArena::worker(int worker)
+{
+    return mWorkers[worker].get();
+}
+
+int RunArena::workerCount() const
+{
+    return static_cast<int>(mWorkers.size());
+}
@@ -1,25 +1,200 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
-#include <sstream>
 #include "Model/STLReader.h"
+#include "Model/ThreadPool.h"
 #include "string"
 
 using namespace IOOperation;
 
+namespace
+{
+    // Facets tokenized from one chunk of an ASCII file: normal, p1, p2 and p3 per facet
+    struct AsciiChunk
+    {
+        std::vector<float> facets;
+    };
+
+    const size_t floatsPerFacet = 12;
+    const size_t maxFacetBytes = 1 << 20; // Longest ASCII facet readFacets accepts, whitespace included
+
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    // True when c is the lowercase letter of a keyword in either case; exporters write the keywords in both
+    inline bool sameLetter(char c, char letter)
+    {
+        return (c | 0x20) == letter;
+    }
+
+    inline bool isWord(const char* word, size_t length, const char* keyword, size_t keywordLength)
+    {
+        return length == keywordLength && (std::memcmp(word, keyword, keywordLength) == 0 || std::equal(word, word + length, keyword, sameLetter));
+    }
+
+    // Parse the next float after whitespace; returns the position after it, or nullptr if there is none
+    const char* parseFloat(const char* first, const char* last, float& value)
+    {
+        while (first < last && isSpace(*first))
+        {
+            first++;
+        }
+        // from_chars does not accept an explicit plus sign
+        if (first < last && *first == '+')
+        {
+            first++;
+        }
+        std::from_chars_result result = std::from_chars(first, last, value);
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    }
+
+    // Parse three floats into a point; returns the position after them, or nullptr on malformed input
+    const char* parsePoint(const char* first, const char* last, float point[3])
+    {
+        float x;
+        float y;
+        float z;
+        if ((first = parseFloat(first, last, x)) == nullptr ||
+            (first = parseFloat(first, last, y)) == nullptr ||
+            (first = parseFloat(first, last, z)) == nullptr)
+        {
+            return nullptr;
+        }
+        point[0] = x;
+        point[1] = y;
+        point[2] = z;
+        return first;
+    }
+
+    // Position right after the first "endfacet" at or after start, or size if there is none
+    size_t findFacetEnd(const char* data, size_t size, size_t start)
+    {
+        static const char keyword[] = "endfacet";
+        const size_t keywordLength = sizeof(keyword) - 1;
+        const char* found = std::search(data + start, data + size, keyword, keyword + keywordLength, sameLetter);
+        return found == data + size ? size : static_cast<size_t>(found - data) + keywordLength;
+    }
+
+    // Tokenize the facets of [first, last)
+    void parseAsciiChunk(const char* first, const char* last, AsciiChunk& chunk)
+    {
+        // Rough size estimate of an ASCII facet, to avoid most reallocations
+        size_t facetEstimate = (last - first) / 250 + 1;
+        chunk.facets.reserve(floatsPerFacet * facetEstimate);
+
+        // The normal followed by the corners of the facet being read
+        float facet[floatsPerFacet] = {};
+        int corner = 0;
+        const char* p = first;
+        while (p < last)
+        {
+            while (p < last && isSpace(*p))
+            {
+                p++;
+            }
+            const char* word = p;
+            while (p < last && !isSpace(*p))
+            {
+                p++;
+            }
+            size_t length = p - word;
+
+            if (isWord(word, length, "vertex", 6))
+            {
+                const char* next = parsePoint(p, last, facet + 3 + 3 * corner);
+                if (next == nullptr)
+                {
+                    continue;
+                }
+                p = next;
+                if (++corner == 3)
+                {
+                    chunk.facets.insert(chunk.facets.end(), facet, facet + floatsPerFacet);
+                    corner = 0;
+                }
+            }
+            else if (isWord(word, length, "normal", 6))
+            {
+                const char* next = parsePoint(p, last, facet);
+                if (next == nullptr)
+                {
+                    continue;
+                }
+                p = next;
+            }
+            else if (isWord(word, length, "facet", 5))
+            {
+                // A facet without a normal line gets a zero normal
+                std::fill(facet, facet + 3, 0.0f);
+                corner = 0;
+            }
+            else if (isWord(word, length, "solid", 5) || isWord(word, length, "endsolid", 8))
+            {
+                // The rest of the line is a free-form name
+                while (p < last && *p != '\n')
+                {
+                    p++;
+                }
+            }
+        }
+    }
+}
+
+StlFacetSpan::StlFacetSpan() : mFacets(nullptr), mCount(0)
+{
+}
+
+StlFacetSpan::StlFacetSpan(const StlFacet* facets, size_t count) : mFacets(facets), mCount(count)
+{
+}
+
+const StlFacet* StlFacetSpan::begin() const
+{
+    return mFacets;
+}
+
+const StlFacet* StlFacetSpan::end() const
+{
+    return mFacets + mCount;
+}
+
+size_t StlFacetSpan::size() const
+{
+    return mCount;
+}
+
+bool StlFacetSpan::empty() const
+{
+    return mCount == 0;
+}
+
+const StlFacet& StlFacetSpan::operator[](size_t index) const
+{
+    return mFacets[index];
+}
+
 // Default constructor
-STLReader::STLReader()
+STLReader::STLReader() : mThreadCount(0)
 {
 
 }
 
-// Constructor taking file path and vectors for vertices, colors, and normals
-STLReader::STLReader(std::string filePath, std::vector<Point3D>& vertices, std::vector<Point3D>& colors, std::vector<Point3D>& normals)
+STLReader::STLReader(int threadCount) : mThreadCount(threadCount)
 {
-    // Clear the vectors before reading
-    vertices.clear();
-    colors.clear();
-    normals.clear();
+}
+
+// Constructor taking file path and the mesh to fill
+STLReader::STLReader(std::string filePath, Mesh& mesh, int threadCount) : mThreadCount(threadCount)
+{
+    // Clear the mesh before reading
+    mesh.clear();
     // Read the STL file
-    readSTL(filePath, vertices, colors, normals);
+    readSTL(filePath, mesh);
+    // No more corners will be welded
+    mesh.shrinkToFit();
 }
 
 // Destructor
@@ -28,85 +203,234 @@ STLReader::~STLReader()
 
 }
 
-// Method to read STL file and populate vectors with vertices, colors, and normals
-void STLReader::readSTL(std::string filePath, std::vector<Point3D>& vertices, std::vector<Point3D>& colors, std::vector<Point3D>& normals)
+// Method to read STL file and populate the mesh
+void STLReader::readSTL(std::string filePath, Mesh& mesh)
 {
-    // Open the STL file
-    std::ifstream dataFile;
-    dataFile.open(filePath);
-    if (!dataFile.is_open())
+    // Binary files are read straight from the mapping, anything else is tokenized from it
+    if (mapBinary(filePath))
     {
-        // If file cannot be opened, return
+        readBinarySTL(mesh);
         return;
     }
+    if (mFile.isOpen())
+    {
+        readAsciiSTL(mFile.data(), mFile.size(), mesh);
+        mFile.close();
+    }
+}
+bool STLReader::isBinary(const char* data, size_t size)
+{
+    // 80-byte header, 32-bit facet count, 50 bytes per facet
+    if (size < 84)
+    {
+        return false;
+    }
+    unsigned int count = 0;
+    std::memcpy(&count, data + 80, sizeof(count));
+    unsigned long long binarySize = 84 + 50 * static_cast<unsigned long long>(count);
+    if (binarySize == size)
+    {
+        return true;
+    }
+
+    // ASCII files start with "solid" in any case, after optional whitespace. Some exporters start binary headers
+    // with it too, but those are padded with zero bytes, or have one in the facet count, where text has none.
+    bool text = std::find(data, data + 84, '\0') == data + 84;
+    size_t start = 0;
+    while (start < 80 && isSpace(data[start]))
+    {
+        start++;
+    }
+    if (text && 80 - start >= 5 && std::equal(data + start, data + start + 5, "solid", sameLetter))
+    {
+        return false;
+    }
+
+    // A binary file holds every facet its header counts, with bytes past them ignored. One that holds fewer is
+    // a truncated binary file only if it is not text: read as a count, four characters of an ASCII file
+    // without "solid" claim far more facets than it has.
+    return binarySize <= size || !text;
+}
+
+bool STLReader::mapBinary(std::string filePath)
+{
+    mFacets = StlFacetSpan();
+    if (!mFile.open(filePath) || !isBinary(mFile.data(), mFile.size()))
+    {
+        // ASCII files stay mapped for the tokenizer
+        return false;
+    }
+
+    // Trust the header count only as far as the file actually reaches
+    unsigned int count = 0;
+    std::memcpy(&count, mFile.data() + 80, sizeof(count));
+    size_t available = (mFile.size() - 84) / sizeof(StlFacet);
+    mFacets = StlFacetSpan(reinterpret_cast<const StlFacet*>(mFile.data() + 84), std::min<size_t>(count, available));
+    return true;
+}
+
+StlFacetSpan STLReader::facets() const
+{
+    return mFacets;
+}
+
+bool STLReader::readFacets(std::string filePath, size_t batchSize, const std::function<void(const float* facets, size_t count)>& callback)
+{
+    // Read through a buffer rather than the mapping, so memory stays bounded however large the file is
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    const size_t size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+    batchSize = std::max<size_t>(1, batchSize);
+
+    char header[84] = {};
+    file.read(header, std::min<size_t>(size, sizeof(header)));
+    if (isBinary(header, size))
+    {
+        // Trust the header count only as far as the file actually reaches
+        unsigned int count = 0;
+        std::memcpy(&count, header + 80, sizeof(count));
+        size_t remaining = std::min<size_t>(count, (size - 84) / sizeof(StlFacet));
+        std::vector<StlFacet> records(std::min(batchSize, remaining));
+        std::vector<float> batch(floatsPerFacet * records.size());
+        while (remaining > 0 && file)
+        {
+            size_t facetCount = std::min(batchSize, remaining);
+            file.read(reinterpret_cast<char*>(records.data()), facetCount * sizeof(StlFacet));
+            facetCount = static_cast<size_t>(file.gcount()) / sizeof(StlFacet);
+            for (size_t n = 0; n < facetCount; n++)
+            {
+                std::memcpy(batch.data() + floatsPerFacet * n, &records[n], floatsPerFacet * sizeof(float));
+            }
+            if (facetCount == 0)
+            {
+                break;
+            }
+            callback(batch.data(), facetCount);
+            remaining -= facetCount;
+        }
+        return true;
+    }
 
-    std::string line;
-    // Read each line of the file
-    while (std::getline(dataFile, line))
+    // Tokenize a window of one chunk per thread at a time, sized to hold about batchSize facets but at most
+    // 8 MB per chunk. The window ends after its last "endfacet"; the bytes behind it are carried over.
+    // Chunks of at least maxFacetBytes hold any facet of a well-formed file, so the window never has to grow.
+    ThreadPool pool(mThreadCount);
+    const size_t bytesPerFacet = 250;
+    const size_t chunkSize = std::min<size_t>(8 << 20, std::max<size_t>(maxFacetBytes, batchSize * bytesPerFacet / pool.threadCount()));
+    std::vector<char> window(chunkSize * pool.threadCount());
+    std::vector<AsciiChunk> chunks(pool.threadCount());
+    std::vector<size_t> boundaries;
+    size_t filled = std::min<size_t>(size, sizeof(header));
+    std::memcpy(window.data(), header, filled);
+    while (true)
     {
-        // Check if the line contains "normal" which indicates normal vectors
-        if (line.find("normal") != std::string::npos)
+        file.read(window.data() + filled, window.size() - filled);
+        filled += static_cast<size_t>(file.gcount());
+        bool last = !file;
+        if (filled == 0)
         {
-            std::istringstream iss(line);
-            std::string token;
-            float x;
-            float y;
-            float z;
-            iss >> token >> x >> y >> z;
-
-            // Create normal vector
-            Point3D normal(x, y, z);
-
-            // Add normal to the normals vector (for each vertex of the triangle)
-            normals.push_back(normal);
-            normals.push_back(normal);
-            normals.push_back(normal);
+            break;
         }
-        // Check if the line contains "vertex" which indicates vertex coordinates
-        if (line.find("vertex") != std::string::npos)
+
+        // A full window without an "endfacet" is not an STL file, or one with a facet too long to bound
+        static const char keyword[] = "endfacet";
+        const char* data = window.data();
+        size_t end = filled;
+        if (!last)
+        {
+            auto found = std::find_end(data, data + filled, keyword, keyword + sizeof(keyword) - 1, sameLetter);
+            if (found == data + filled)
+            {
+                return false;
+            }
+            end = static_cast<size_t>(found - data) + sizeof(keyword) - 1;
+        }
+
+        boundaries.assign(1, 0);
+        while (boundaries.size() <= chunks.size() && boundaries.back() < end)
         {
-            std::istringstream iss(line);
-            std::string token;
-            float x, y, z;
-            iss >> token >> x >> y >> z;
-
-            // Create first vertex
-            Point3D p1(x, y, z);
-            // Create first color (red)
-            Point3D c1(1.0f, 0.0f, 0.0f);
-
-            // Read next line for second vertex coordinates
-            std::getline(dataFile, line);
-            std::istringstream iss1(line);
-            std::string token1;
-            float x1, y1, z1;
-            iss1 >> token1 >> x1 >> y1 >> z1;
-
-            // Create second vertex
-            Point3D p2(x1, y1, z1);
-            // Create second color (red)
-            Point3D c2(1.0f, 0.0f, 0.0f);
-
-            // Read next line for third vertex coordinates
-            std::getline(dataFile, line);
-            std::istringstream iss2(line);
-            std::string token2;
-            float x2, y2, z2;
-            iss2 >> token2 >> x2 >> y2 >> z2;
-
-            // Create third vertex
-            Point3D p3(x2, y2, z2);
-            // Create third color (red)
-            Point3D c3(1.0f, 0.0f, 0.0f);
-
-            // Add vertices (forming a triangle) to the vertices vector
-            vertices.push_back(p1);
-            vertices.push_back(p2);
-            vertices.push_back(p3);
-            vertices.push_back(p1);
+            boundaries.push_back(findFacetEnd(data, end, std::min(end, boundaries.back() + chunkSize)));
+        }
+        pool.run(boundaries.size() - 1, [&](size_t chunk, int) {
+            chunks[chunk].facets.clear();
+            parseAsciiChunk(data + boundaries[chunk], data + boundaries[chunk + 1], chunks[chunk]);
+        });
+        for (size_t chunk = 0; chunk + 1 < boundaries.size(); chunk++)
+        {
+            const std::vector<float>& facets = chunks[chunk].facets;
+            size_t facetCount = facets.size() / floatsPerFacet;
+            for (size_t first = 0; first < facetCount; first += batchSize)
+            {
+                callback(facets.data() + floatsPerFacet * first, std::min(batchSize, facetCount - first));
+            }
+        }
 
+        if (last)
+        {
+            break;
         }
+        std::memmove(window.data(), window.data() + end, filled - end);
+        filled -= end;
     }
-    // Close the file after reading
-    dataFile.close();
-}
\ No newline at end of file
+    return true;
+}
+
+void STLReader::readBinarySTL(Mesh& mesh)
+{
+    // Size the mesh once from the facet count
+    mesh.reserve(mesh.triangleCount() + mFacets.size());
+
+    for (const StlFacet& facet : mFacets)
+    {
+        // The packed record is not aligned for float access, so copy it out first
+        float values[floatsPerFacet];
+        std::memcpy(values, &facet, sizeof(values));
+        mesh.addTriangle(values, values + 3, values + 6, values + 9);
+    }
+}
+
+void STLReader::readAsciiSTL(const char* data, size_t size, Mesh& mesh)
+{
+    ThreadPool pool(mThreadCount);
+
+    // Split the file into chunks that end right after an "endfacet", so no facet is cut in two
+    const size_t minimumChunkSize = 4 << 20;
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(size / minimumChunkSize, 4 * pool.threadCount()));
+    std::vector<size_t> boundaries(1, 0);
+    for (size_t chunk = 1; chunk < chunkCount; chunk++)
+    {
+        size_t boundary = findFacetEnd(data, size, std::max(boundaries.back(), size / chunkCount * chunk));
+        if (boundary < size)
+        {
+            boundaries.push_back(boundary);
+        }
+    }
+    boundaries.push_back(size);
+
+    // Tokenize the chunks in parallel, each into buffers of its own
+    std::vector<AsciiChunk> chunks(boundaries.size() - 1);
+    pool.run(chunks.size(), [&](size_t chunk, int) {
+        parseAsciiChunk(data + boundaries[chunk], data + boundaries[chunk + 1], chunks[chunk]);
+    });
+
+    // Weld the chunks in file order, so vertex numbering does not depend on the thread count
+    size_t floatCount = 0;
+    for (const AsciiChunk& chunk : chunks)
+    {
+        floatCount += chunk.facets.size();
+    }
+    mesh.reserve(mesh.triangleCount() + floatCount / floatsPerFacet);
+    for (AsciiChunk& chunk : chunks)
+    {
+        for (size_t i = 0; i < chunk.facets.size(); i += floatsPerFacet)
+        {
+            const float* facet = chunk.facets.data() + i;
+            mesh.addTriangle(facet, facet + 3, facet + 6, facet + 9);
+        }
+        std::vector<float>().swap(chunk.facets);
+    }
+}
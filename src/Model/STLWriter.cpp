@@ -0,0 +1,73 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include "Model/STLWriter.h"
+#include "Model/STLReader.h"
+
+using namespace IOOperation;
+
+namespace
+{
+    // Unit normal of the triangle p1, p2, p3; zero for a degenerate triangle
+    void facetNormal(const float* p1, const float* p2, const float* p3, float normal[3])
+    {
+        float u[3] = { p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+        float v[3] = { p3[0] - p1[0], p3[1] - p1[1], p3[2] - p1[2] };
+        normal[0] = u[1] * v[2] - u[2] * v[1];
+        normal[1] = u[2] * v[0] - u[0] * v[2];
+        normal[2] = u[0] * v[1] - u[1] * v[0];
+        float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            normal[axis] = length > 0.0f ? normal[axis] / length : 0.0f;
+        }
+    }
+
+    // Fill a facet record from three corners
+    void makeFacet(const float* p1, const float* p2, const float* p3, StlFacet& facet)
+    {
+        float values[12];
+        facetNormal(p1, p2, p3, values);
+        std::memcpy(values + 3, p1, 3 * sizeof(float));
+        std::memcpy(values + 6, p2, 3 * sizeof(float));
+        std::memcpy(values + 9, p3, 3 * sizeof(float));
+        std::memcpy(&facet, values, sizeof(values));
+        facet.attribute = 0;
+    }
+}
+
+bool STLWriter::writeQuads(const std::string& filePath, const std::vector<float>& vertices)
+{
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    // 80-byte header and facet count
+    size_t quadCount = vertices.size() / 12;
+    char header[80] = {};
+    std::strncpy(header, "binary STL of voxel quads", sizeof(header));
+    unsigned int facetCount = static_cast<unsigned int>(2 * quadCount);
+    file.write(header, sizeof(header));
+    file.write(reinterpret_cast<const char*>(&facetCount), sizeof(facetCount));
+
+    // Split every quad along its 0-2 diagonal, which keeps the winding; records go out in blocks
+    const size_t blockSize = 4096;
+    std::vector<StlFacet> block;
+    block.reserve(blockSize);
+    for (size_t quad = 0; quad < quadCount; quad++)
+    {
+        const float* corners = vertices.data() + 12 * quad;
+        block.emplace_back();
+        makeFacet(corners, corners + 3, corners + 6, block.back());
+        block.emplace_back();
+        makeFacet(corners, corners + 6, corners + 9, block.back());
+        if (block.size() >= blockSize || quad + 1 == quadCount)
+        {
+            file.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(StlFacet));
+            block.clear();
+        }
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cmath>
+#include "Model/SatKernel.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SAT_KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SAT_TARGET_AVX2
+#else
+#define SAT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define SAT_KERNEL_X86 0
+#endif
+
+namespace
+{
+    using SatKernel::TriangleSetup;
+
+    // Projection of the offset d onto axis a of a setup, summed in the order of the SIMD kernels
+    inline float project(const TriangleSetup& triangle, int a, Vec3f d)
+    {
+        return triangle.axisX[a] * d.x + triangle.axisY[a] * d.y + triangle.axisZ[a] * d.z;
+    }
+
+    // Center of the box [lower, upper], computed the same way by every kernel
+    inline Vec3f boxCenter(Vec3f lower, Vec3f upper)
+    {
+        return (lower + upper) * 0.5f;
+    }
+
+#if SAT_KERNEL_X86
+    // True when the box of the given center misses the triangle along any axis, eight axes at a time
+    SAT_TARGET_AVX2 inline bool separatedAvx2(const TriangleSetup& triangle, Vec3f center)
+    {
+        Vec3f offset = center - triangle.origin;
+        const __m256 dx = _mm256_set1_ps(offset.x);
+        const __m256 dy = _mm256_set1_ps(offset.y);
+        const __m256 dz = _mm256_set1_ps(offset.z);
+        for (int half = 0; half < 16; half += 8)
+        {
+            __m256 projection = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(triangle.axisX + half), dx),
+                _mm256_mul_ps(_mm256_load_ps(triangle.axisY + half), dy)), _mm256_mul_ps(_mm256_load_ps(triangle.axisZ + half), dz));
+            __m256 separated = _mm256_or_ps(_mm256_cmp_ps(projection, _mm256_load_ps(triangle.lower + half), _CMP_LT_OQ),
+                _mm256_cmp_ps(projection, _mm256_load_ps(triangle.upper + half), _CMP_GT_OQ));
+            if (_mm256_movemask_ps(separated) != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    SAT_TARGET_AVX2 bool boxIntersectsAnyAvx2(Vec3f center, const TriangleSetup* triangles, const int* indices, size_t count)
+    {
+        for (size_t n = 0; n < count; n++)
+        {
+            if (!separatedAvx2(triangles[indices ? indices[n] : n], center))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Eight boxes per step, one per lane, against the axes of one triangle
+    SAT_TARGET_AVX2 size_t triangleIntersectsBoxesAvx2(const TriangleSetup& triangle, const float* const mins[3], size_t count, double voxelSize, unsigned char* hits)
+    {
+        const __m256 size = _mm256_set1_ps(static_cast<float>(voxelSize));
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 origin[3] = { _mm256_set1_ps(triangle.origin.x), _mm256_set1_ps(triangle.origin.y), _mm256_set1_ps(triangle.origin.z) };
+
+        size_t n = 0;
+        for (; n + 8 <= count; n += 8)
+        {
+            __m256 offset[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                __m256 lower = _mm256_loadu_ps(mins[axis] + n);
+                __m256 upper = _mm256_add_ps(lower, size);
+                offset[axis] = _mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(lower, upper), half), origin[axis]);
+            }
+            __m256 separated = _mm256_setzero_ps();
+            for (int a = 0; a < SatKernel::axisCount; a++)
+            {
+                __m256 projection = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.axisX[a]), offset[0]),
+                    _mm256_mul_ps(_mm256_set1_ps(triangle.axisY[a]), offset[1])), _mm256_mul_ps(_mm256_set1_ps(triangle.axisZ[a]), offset[2]));
+                separated = _mm256_or_ps(separated, _mm256_or_ps(_mm256_cmp_ps(projection, _mm256_set1_ps(triangle.lower[a]), _CMP_LT_OQ),
+                    _mm256_cmp_ps(projection, _mm256_set1_ps(triangle.upper[a]), _CMP_GT_OQ)));
+            }
+            int lanes = ~_mm256_movemask_ps(separated);
+            for (int lane = 0; lane < 8; lane++)
+            {
+                hits[n + lane] = (lanes >> lane) & 1;
+            }
+        }
+        return n;
+    }
+#endif
+}
+
+bool SatKernel::hasAvx2()
+{
+    static const bool supported = []() {
+#if SAT_KERNEL_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        // The OS has to save the YMM registers (OSXSAVE, AVX and XCR0 bits 1-2)
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+#else
+        return false;
+#endif
+    }();
+    return supported;
+}
+
+SatKernel::TriangleSetup SatKernel::setupTriangle(Vec3f p1, Vec3f p2, Vec3f p3, Vec3f extent)
+{
+    TriangleSetup triangle = {};
+    triangle.origin = p1;
+
+    // Corners and edges relative to the first corner
+    const Vec3f corners[3] = { { 0.0f, 0.0f, 0.0f }, p2 - p1, p3 - p1 };
+    const Vec3f edges[3] = { p2 - p1, p3 - p2, p1 - p3 };
+    Vec3f axes[axisCount];
+    int a = 0;
+    for (const Vec3f& f : edges)
+    {
+        axes[a++] = { 0.0f, -f.z, f.y };
+        axes[a++] = { f.z, 0.0f, -f.x };
+        axes[a++] = { -f.y, f.x, 0.0f };
+    }
+    axes[a++] = { 1.0f, 0.0f, 0.0f };
+    axes[a++] = { 0.0f, 1.0f, 0.0f };
+    axes[a++] = { 0.0f, 0.0f, 1.0f };
+    axes[a++] = cross(edges[0], edges[1]);
+
+    for (a = 0; a < axisCount; a++)
+    {
+        triangle.axisX[a] = axes[a].x;
+        triangle.axisY[a] = axes[a].y;
+        triangle.axisZ[a] = axes[a].z;
+
+        // The box reaches r to either side of the projection of its center
+        float projections[3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            projections[corner] = project(triangle, a, corners[corner]);
+        }
+        float r = dot(extent, absolute(axes[a]));
+        triangle.lower[a] = std::min({ projections[0], projections[1], projections[2] }) - r;
+        triangle.upper[a] = std::max({ projections[0], projections[1], projections[2] }) + r;
+    }
+    return triangle;
+}
+
+bool SatKernel::boxIntersectsTriangle(const TriangleSetup& triangle, Vec3f center)
+{
+    Vec3f offset = center - triangle.origin;
+    for (int a = 0; a < axisCount; a++)
+    {
+        float projection = project(triangle, a, offset);
+        if (projection < triangle.lower[a] || projection > triangle.upper[a]) return false;
+    }
+    return true;
+}
+
+bool SatKernel::boxIntersectsAny(const Point3D& min, const Point3D& max, const TriangleSetup* triangles, const int* indices, size_t count, bool vectorize)
+{
+    Vec3f center = boxCenter(toVec3f(min), toVec3f(max));
+
+#if SAT_KERNEL_X86
+    if (vectorize && hasAvx2())
+    {
+        return boxIntersectsAnyAvx2(center, triangles, indices, count);
+    }
+#endif
+
+    for (size_t n = 0; n < count; n++)
+    {
+        if (boxIntersectsTriangle(triangles[indices ? indices[n] : n], center))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SatKernel::triangleIntersectsBoxes(const TriangleSetup& triangle, const float* minX, const float* minY, const float* minZ, size_t count, double voxelSize, unsigned char* hits, bool vectorize)
+{
+    const float* const mins[3] = { minX, minY, minZ };
+    const float size = static_cast<float>(voxelSize);
+
+    size_t n = 0;
+#if SAT_KERNEL_X86
+    if (vectorize && hasAvx2())
+    {
+        n = triangleIntersectsBoxesAvx2(triangle, mins, count, voxelSize, hits);
+    }
+#endif
+
+    for (; n < count; n++)
+    {
+        Vec3f lower = { mins[0][n], mins[1][n], mins[2][n] };
+        hits[n] = boxIntersectsTriangle(triangle, boxCenter(lower, lower + Vec3f{ size, size, size })) ? 1 : 0;
+    }
+}
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include "Model/StreamingVoxelizer.h"
+#include "Model/STLReader.h"
+#include "Model/VoxelFile.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const size_t floatsPerFacet = 12; // Normal, p1, p2 and p3 as delivered by STLReader::readFacets
+    const size_t floatsPerTriangle = 9; // p1, p2 and p3 as stored in the spill files
+    const size_t bytesPerBatchTriangle = 96; // Corners, cell range and layer list entries of a batch triangle
+    const size_t chunkSize = 4096; // Triangles per task when cell ranges are computed in parallel
+    const size_t readBatchTriangles = 1 << 16; // Facets per batch read from the STL file
+
+    // Removes the spill directory of a run however the run ends
+    struct SpillDirectory
+    {
+        fs::path path;
+
+        ~SpillDirectory()
+        {
+            std::error_code error;
+            fs::remove_all(path, error);
+        }
+    };
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+StreamingVoxelizer::StreamingVoxelizer(size_t memoryBudget, const VoxelizerOptions& options, const std::string& spillDirectory)
+    : mMemoryBudget(memoryBudget), mOptions(options), mSpillDirectory(spillDirectory), mVoxelSize(1.0),
+      mLayerWords(0), mSlabLayers(0), mBatchTriangles(0), mSpillTriangles(0)
+{
+}
+
+bool StreamingVoxelizer::run(const std::string& stlPath, double voxelSize, const std::string& outputPath)
+{
+    mError.clear();
+    mStats = StreamingStats();
+    mVoxelSize = voxelSize;
+    if (mOptions.fill != VoxelizerOptions::Fill::Surface)
+    {
+        // The parity rays of the solid fill cross every slab, so they need the whole grid at once
+        mError = "solid fill is not supported out of core";
+        return false;
+    }
+    if (voxelSize <= 0.0)
+    {
+        mError = "voxel size must be positive";
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    double minCorner[3];
+    double maxCorner[3];
+    if (!readBounds(stlPath, minCorner, maxCorner))
+    {
+        return false;
+    }
+    mStats.boundsSeconds = secondsSince(start);
+    mGridX = Voxelizer::gridSteps(minCorner[0], maxCorner[0], voxelSize);
+    mGridY = Voxelizer::gridSteps(minCorner[1], maxCorner[1], voxelSize);
+    mGridZ = Voxelizer::gridSteps(minCorner[2], maxCorner[2], voxelSize);
+
+    // Half of the budget holds the layers of a slab, a quarter each the triangle batch and the spill buffers
+    mLayerWords = (mGridY.size() * mGridZ.size() + 63) / 64;
+    size_t layerBytes = mLayerWords * sizeof(unsigned long long);
+    mSlabLayers = (mMemoryBudget / 2 / layerBytes) / 8 * 8;
+    if (mSlabLayers < 8)
+    {
+        mError = "memory budget too small: a slab of 8 layers takes " + std::to_string(8 * layerBytes >> 20) + " MB";
+        return false;
+    }
+    mSlabLayers = std::min(mSlabLayers, (mGridX.size() + 7) / 8 * 8);
+    size_t slabCount = (mGridX.size() + mSlabLayers - 1) / mSlabLayers;
+    mBatchTriangles = std::max<size_t>(1024, mMemoryBudget / 4 / bytesPerBatchTriangle);
+    mSpillTriangles = std::max<size_t>(64, mMemoryBudget / 4 / slabCount / (floatsPerTriangle * sizeof(float)));
+    mSpillTriangles = std::min<size_t>(mSpillTriangles, (4 << 20) / (floatsPerTriangle * sizeof(float)));
+    mStats.slabCount = slabCount;
+    mStats.slabLayers = mSlabLayers;
+    mStats.batchTriangles = mBatchTriangles;
+    mStats.memoryBytes = std::max(readBatchTriangles * (floatsPerFacet * sizeof(float) + sizeof(Voxelizer::CellRange)) + slabCount * mSpillTriangles * floatsPerTriangle * sizeof(float),
+        mSlabLayers * layerBytes + mBatchTriangles * bytesPerBatchTriangle);
+
+    // Spill files live in a directory of their own, removed when the run ends
+    SpillDirectory spill;
+    fs::path parent = mSpillDirectory.empty() ? fs::temp_directory_path() : fs::path(mSpillDirectory);
+    spill.path = parent / ("voxelize-spill-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "-" + std::to_string(reinterpret_cast<size_t>(this)));
+    std::error_code error;
+    if (!fs::create_directories(spill.path, error))
+    {
+        mError = "cannot create spill directory " + spill.path.string();
+        return false;
+    }
+    std::vector<std::string> slabPaths(slabCount);
+    for (size_t slab = 0; slab < slabCount; slab++)
+    {
+        slabPaths[slab] = (spill.path / ("slab-" + std::to_string(slab) + ".bin")).string();
+    }
+
+    ThreadPool pool(mOptions.threadCount);
+    start = std::chrono::steady_clock::now();
+    if (!spillTriangles(stlPath, slabPaths, pool))
+    {
+        return false;
+    }
+    mStats.spillSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    IOOperation::VoxelFileWriter writer;
+    const double origin[3] = { mGridX.front(), mGridY.front(), mGridZ.front() };
+    if (!writer.open(outputPath, mGridX.size(), mGridY.size(), mGridZ.size(), origin, voxelSize))
+    {
+        mError = "cannot create " + outputPath;
+        return false;
+    }
+
+    // Mark one slab at a time and append its bricks; its spill file is no longer needed afterwards
+    std::vector<unsigned long long> layers;
+    for (size_t slab = 0; slab < slabCount; slab++)
+    {
+        size_t first = slab * mSlabLayers;
+        size_t count = std::min(mGridX.size(), first + mSlabLayers) - first;
+        layers.assign(count * mLayerWords, 0);
+        if (!markSlab(slab, slabPaths[slab], pool, layers))
+        {
+            return false;
+        }
+        writer.writeLayers(first, count, layers.data());
+        fs::remove(slabPaths[slab], error);
+        if (mOptions.progress)
+        {
+            mOptions.progress(double(slab + 1) / slabCount);
+        }
+    }
+    mStats.brickCount = writer.brickCount();
+    mStats.voxelCount = writer.voxelCount();
+    if (!writer.close())
+    {
+        mError = "cannot write " + outputPath;
+        return false;
+    }
+    mStats.voxelizeSeconds = secondsSince(start);
+    return true;
+}
+
+const std::string& StreamingVoxelizer::error() const
+{
+    return mError;
+}
+
+StreamingStats StreamingVoxelizer::stats() const
+{
+    return mStats;
+}
+
+bool StreamingVoxelizer::readBounds(const std::string& stlPath, double minCorner[3], double maxCorner[3])
+{
+    float lower[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float upper[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+    IOOperation::STLReader reader(mOptions.threadCount);
+    bool opened = reader.readFacets(stlPath, readBatchTriangles, [&](const float* facets, size_t count) {
+        for (size_t n = 0; n < count; n++)
+        {
+            const float* corners = facets + floatsPerFacet * n + 3;
+            for (int c = 0; c < 9; c++)
+            {
+                lower[c % 3] = std::min(lower[c % 3], corners[c]);
+                upper[c % 3] = std::max(upper[c % 3], corners[c]);
+            }
+        }
+        mStats.triangleCount += count;
+    });
+    if (!opened || mStats.triangleCount == 0)
+    {
+        mError = opened ? "no triangles read from " + stlPath : "cannot open or parse " + stlPath;
+        return false;
+    }
+    std::copy(lower, lower + 3, minCorner);
+    std::copy(upper, upper + 3, maxCorner);
+    return true;
+}
+
+bool StreamingVoxelizer::spillTriangles(const std::string& stlPath, const std::vector<std::string>& slabPaths, ThreadPool& pool)
+{
+    std::vector<std::vector<float>> buffers(slabPaths.size());
+    bool written = true;
+    auto flush = [&](size_t slab) {
+        // Append and close again, so the number of slabs is not limited by open file handles
+        std::ofstream file(slabPaths[slab], std::ios::binary | std::ios::app);
+        file.write(reinterpret_cast<const char*>(buffers[slab].data()), buffers[slab].size() * sizeof(float));
+        written = written && static_cast<bool>(file);
+        buffers[slab].clear();
+    };
+
+    std::vector<Voxelizer::CellRange> ranges;
+    IOOperation::STLReader reader(mOptions.threadCount);
+    bool opened = reader.readFacets(stlPath, readBatchTriangles, [&](const float* facets, size_t count) {
+        if (cancelled() || !written)
+        {
+            return;
+        }
+        ranges.resize(count);
+        pool.run((count + chunkSize - 1) / chunkSize, [&](size_t chunk, int) {
+            size_t end = std::min(count, (chunk + 1) * chunkSize);
+            for (size_t n = chunk * chunkSize; n < end; n++)
+            {
+                const float* p = facets + floatsPerFacet * n + 3;
+                ranges[n] = Voxelizer::cellRange(Point3D(p[0], p[1], p[2]), Point3D(p[3], p[4], p[5]), Point3D(p[6], p[7], p[8]), mGridX, mGridY, mGridZ, mVoxelSize);
+            }
+        });
+
+        // A triangle goes to every slab its layers reach
+        for (size_t n = 0; n < count; n++)
+        {
+            const Voxelizer::CellRange& range = ranges[n];
+            if (range.first[0] >= range.last[0])
+            {
+                continue;
+            }
+            const float* corners = facets + floatsPerFacet * n + 3;
+            for (size_t slab = range.first[0] / mSlabLayers; slab <= (range.last[0] - 1) / mSlabLayers; slab++)
+            {
+                buffers[slab].insert(buffers[slab].end(), corners, corners + floatsPerTriangle);
+                mStats.spilledTriangles++;
+                if (buffers[slab].size() >= mSpillTriangles * floatsPerTriangle)
+                {
+                    flush(slab);
+                }
+            }
+        }
+    });
+    for (size_t slab = 0; slab < buffers.size() && written; slab++)
+    {
+        if (!buffers[slab].empty())
+        {
+            flush(slab);
+        }
+    }
+
+    if (!opened)
+    {
+        mError = "cannot open or parse " + stlPath;
+        return false;
+    }
+    if (!written)
+    {
+        mError = "cannot write spill files, is the disk full?";
+        return false;
+    }
+    if (cancelled())
+    {
+        mError = "cancelled";
+        return false;
+    }
+    return true;
+}
+
+bool StreamingVoxelizer::markSlab(size_t slab, const std::string& slabPath, ThreadPool& pool, std::vector<unsigned long long>& layers)
+{
+    size_t first = slab * mSlabLayers;
+    size_t layerCount = layers.size() / mLayerWords;
+    std::vector<Scratch> scratch(pool.threadCount());
+    Batch batch;
+
+    // A slab that no triangle reaches has no file and stays empty
+    std::error_code error;
+    size_t slabTriangles = static_cast<size_t>(fs::file_size(slabPath, error)) / (floatsPerTriangle * sizeof(float));
+    size_t batchTriangles = error ? 0 : std::min(mBatchTriangles, slabTriangles);
+    std::ifstream file(slabPath, std::ios::binary);
+    while (file && batchTriangles > 0)
+    {
+        if (cancelled())
+        {
+            mError = "cancelled";
+            return false;
+        }
+        batch.corners.resize(batchTriangles * floatsPerTriangle);
+        file.read(reinterpret_cast<char*>(batch.corners.data()), batch.corners.size() * sizeof(float));
+        size_t count = static_cast<size_t>(file.gcount()) / (floatsPerTriangle * sizeof(float));
+        if (count == 0)
+        {
+            break;
+        }
+
+        // Cell ranges, then the triangles of each slab layer, as in Voxelizer::createBoundingBoxGrid
+        batch.ranges.resize(count);
+        pool.run((count + chunkSize - 1) / chunkSize, [&](size_t chunk, int) {
+            size_t end = std::min(count, (chunk + 1) * chunkSize);
+            for (size_t n = chunk * chunkSize; n < end; n++)
+            {
+                const float* p = batch.corners.data() + floatsPerTriangle * n;
+                batch.ranges[n] = Voxelizer::cellRange(Point3D(p[0], p[1], p[2]), Point3D(p[3], p[4], p[5]), Point3D(p[6], p[7], p[8]), mGridX, mGridY, mGridZ, mVoxelSize);
+            }
+        });
+        batch.layerStart.assign(layerCount + 1, 0);
+        for (size_t n = 0; n < count; n++)
+        {
+            for (size_t i = std::max(first, batch.ranges[n].first[0]); i < std::min(first + layerCount, batch.ranges[n].last[0]); i++)
+            {
+                batch.layerStart[i - first + 1]++;
+            }
+        }
+        for (size_t l = 1; l < batch.layerStart.size(); l++)
+        {
+            batch.layerStart[l] += batch.layerStart[l - 1];
+        }
+        batch.layerTriangles.resize(batch.layerStart.back());
+        std::vector<size_t> fill(batch.layerStart.begin(), batch.layerStart.end() - 1);
+        for (size_t n = 0; n < count; n++)
+        {
+            for (size_t i = std::max(first, batch.ranges[n].first[0]); i < std::min(first + layerCount, batch.ranges[n].last[0]); i++)
+            {
+                batch.layerTriangles[fill[i - first]++] = static_cast<unsigned int>(n);
+            }
+        }
+
+        // Every layer has a bitset of its own, so the layers are marked concurrently
+        pool.run(layerCount, [&](size_t l, int worker) {
+            markLayer(slab, l, batch, scratch[worker], layers.data() + l * mLayerWords);
+        });
+    }
+    return true;
+}
+
+void StreamingVoxelizer::markLayer(size_t slab, size_t l, const Batch& batch, Scratch& scratch, unsigned long long* layer) const
+{
+    // The same row tests as Voxelizer::markTriangleDriven, so both mark the same cells
+    const size_t i = slab * mSlabLayers + l;
+    const size_t nz = mGridZ.size();
+    const float half = static_cast<float>(mVoxelSize * 0.5);
+    const Vec3f halfExtent = { half, half, half };
+    for (size_t n = batch.layerStart[l]; n < batch.layerStart[l + 1]; n++)
+    {
+        size_t t = batch.layerTriangles[n];
+        const Voxelizer::CellRange& range = batch.ranges[t];
+        const float* p = batch.corners.data() + floatsPerTriangle * t;
+        SatKernel::TriangleSetup setup = SatKernel::setupTriangle(toVec3f(p), toVec3f(p + 3), toVec3f(p + 6), halfExtent);
+
+        size_t rowLength = range.last[2] - range.first[2];
+        scratch.minX.assign(rowLength, mGridX[i]);
+        scratch.minZ.assign(mGridZ.begin() + range.first[2], mGridZ.begin() + range.last[2]);
+        scratch.hits.resize(rowLength);
+        for (size_t j = range.first[1]; j < range.last[1]; j++)
+        {
+            scratch.minY.assign(rowLength, mGridY[j]);
+            SatKernel::triangleIntersectsBoxes(setup, scratch.minX.data(), scratch.minY.data(), scratch.minZ.data(), rowLength, mVoxelSize, scratch.hits.data(), mOptions.vectorize);
+            for (size_t k = 0; k < rowLength; k++)
+            {
+                if (scratch.hits[k])
+                {
+                    size_t cell = j * nz + range.first[2] + k;
+                    layer[cell / 64] |= 1ULL << (cell % 64);
+                }
+            }
+        }
+    }
+}
+
+bool StreamingVoxelizer::cancelled() const
+{
+    return mOptions.cancel != nullptr && mOptions.cancel->load(std::memory_order_relaxed);
+}
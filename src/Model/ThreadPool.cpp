@@ -0,0 +1,141 @@
+#include "Model/ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount) : mTask(nullptr), mBatch(0), mBusy(0), mStop(false)
+{
+    int count = threadCount > 0 ? threadCount : defaultThreadCount();
+    for (int worker = 0; worker < count; worker++)
+    {
+        mQueues.emplace_back(new Queue());
+    }
+    // Worker 0 is whichever thread calls run()
+    for (int worker = 1; worker < count; worker++)
+    {
+        mThreads.emplace_back(&ThreadPool::workerLoop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (std::thread& thread : mThreads)
+    {
+        thread.join();
+    }
+}
+
+int ThreadPool::threadCount() const
+{
+    return static_cast<int>(mQueues.size());
+}
+
+int ThreadPool::defaultThreadCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? static_cast<int>(count) : 1;
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t, int)>& task)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    // Hand every worker a contiguous block of indices so neighbouring tasks start on the same thread
+    size_t workers = mQueues.size();
+    for (size_t worker = 0; worker < workers; worker++)
+    {
+        size_t begin = taskCount * worker / workers;
+        size_t end = taskCount * (worker + 1) / workers;
+        std::lock_guard<std::mutex> lock(mQueues[worker]->mutex);
+        for (size_t index = begin; index < end; index++)
+        {
+            mQueues[worker]->tasks.push_back(index);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = &task;
+        mBusy = static_cast<int>(mThreads.size());
+        mBatch++;
+    }
+    mWake.notify_all();
+
+    drain(0, task);
+
+    // Wait until no worker can still be inside the task
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mBusy == 0; });
+    mTask = nullptr;
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+    unsigned long long seenBatch = 0;
+    while (true)
+    {
+        const std::function<void(size_t, int)>* task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [this, seenBatch] { return mStop || mBatch != seenBatch; });
+            if (mStop)
+            {
+                return;
+            }
+            seenBatch = mBatch;
+            task = mTask;
+        }
+
+        drain(worker, *task);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBusy--;
+        }
+        mDone.notify_one();
+    }
+}
+
+void ThreadPool::drain(int worker, const std::function<void(size_t, int)>& task)
+{
+    size_t index = 0;
+    while (nextTask(worker, index))
+    {
+        task(index, worker);
+    }
+}
+
+bool ThreadPool::nextTask(int worker, size_t& index)
+{
+    // Own queue first, in index order
+    {
+        Queue& own = *mQueues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the far end of another worker's block, starting with the next worker
+    size_t workers = mQueues.size();
+    for (size_t offset = 1; offset < workers; offset++)
+    {
+        Queue& victim = *mQueues[(worker + offset) % workers];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
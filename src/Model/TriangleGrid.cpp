@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cmath>
+#include "Model/TriangleGrid.h"
+
+namespace
+{
+    // Upper bound for the number of bins along one axis
+    const int MAX_BINS_PER_AXIS = 128;
+}
+
+TriangleGrid::TriangleGrid() : mPadding(0.0)
+{
+    clear();
+}
+
+TriangleGrid::~TriangleGrid()
+{
+}
+
+void TriangleGrid::clear()
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        mOrigin[axis] = 0.0;
+        mBinSize[axis] = 1.0;
+        mDims[axis] = 0;
+    }
+    mBinStart.clear();
+    mBinTriangles.clear();
+    mTriangleMin.clear();
+    mTriangleMax.clear();
+}
+
+bool TriangleGrid::empty() const
+{
+    return mTriangleMin.empty();
+}
+
+void TriangleGrid::build(const Mesh& mesh)
+{
+    clear();
+    if (mesh.empty())
+    {
+        return;
+    }
+
+    // Bounding box of every triangle and of the whole mesh
+    double sceneMin[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    double sceneMax[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    mTriangleMin.reserve(mesh.triangleCount());
+    mTriangleMax.reserve(mesh.triangleCount());
+    for (size_t t = 0; t < mesh.triangleCount(); t++)
+    {
+        Point3D p1 = mesh.corner(t, 0);
+        Point3D p2 = mesh.corner(t, 1);
+        Point3D p3 = mesh.corner(t, 2);
+        Point3D lower(std::min({ p1.x(), p2.x(), p3.x() }), std::min({ p1.y(), p2.y(), p3.y() }), std::min({ p1.z(), p2.z(), p3.z() }));
+        Point3D upper(std::max({ p1.x(), p2.x(), p3.x() }), std::max({ p1.y(), p2.y(), p3.y() }), std::max({ p1.z(), p2.z(), p3.z() }));
+        mTriangleMin.push_back(lower);
+        mTriangleMax.push_back(upper);
+
+        sceneMin[0] = std::min(sceneMin[0], lower.x());
+        sceneMin[1] = std::min(sceneMin[1], lower.y());
+        sceneMin[2] = std::min(sceneMin[2], lower.z());
+        sceneMax[0] = std::max(sceneMax[0], upper.x());
+        sceneMax[1] = std::max(sceneMax[1], upper.y());
+        sceneMax[2] = std::max(sceneMax[2], upper.z());
+    }
+
+    // The padding only has to absorb rounding in the exact triangle test, so it is tiny compared to the mesh
+    double largestCoordinate = 0.0;
+    double largestExtent = 0.0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        largestCoordinate = std::max({ largestCoordinate, std::fabs(sceneMin[axis]), std::fabs(sceneMax[axis]) });
+        largestExtent = std::max(largestExtent, sceneMax[axis] - sceneMin[axis]);
+    }
+    mPadding = 1e-6 * (1.0 + largestCoordinate);
+
+    // Aim for about one triangle per bin; flat axes get a single bin
+    double volume = 1.0;
+    int spannedAxes = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = sceneMax[axis] - sceneMin[axis];
+        if (extent > 1e-9 * largestExtent)
+        {
+            volume *= extent;
+            spannedAxes++;
+        }
+    }
+    double binSize = spannedAxes > 0 ? std::pow(volume / mesh.triangleCount(), 1.0 / spannedAxes) : 1.0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = sceneMax[axis] - sceneMin[axis];
+        int dims = binSize > 0.0 ? static_cast<int>(std::ceil(extent / binSize)) : 1;
+        mDims[axis] = std::max(1, std::min(dims, MAX_BINS_PER_AXIS));
+        mOrigin[axis] = sceneMin[axis];
+        mBinSize[axis] = extent > 0.0 ? extent / mDims[axis] : 1.0;
+    }
+
+    // Count the triangles of every bin, then fill the bins in a second pass
+    mBinStart.assign(static_cast<size_t>(mDims[0]) * mDims[1] * mDims[2] + 1, 0);
+    for (size_t t = 0; t < mTriangleMin.size(); t++)
+    {
+        int lo[3];
+        int hi[3];
+        binRange(mTriangleMin[t], mTriangleMax[t], lo, hi);
+        for (int ix = lo[0]; ix <= hi[0]; ix++)
+            for (int iy = lo[1]; iy <= hi[1]; iy++)
+                for (int iz = lo[2]; iz <= hi[2]; iz++)
+                    mBinStart[binIndex(ix, iy, iz) + 1]++;
+    }
+    for (size_t bin = 1; bin < mBinStart.size(); bin++)
+    {
+        mBinStart[bin] += mBinStart[bin - 1];
+    }
+
+    mBinTriangles.resize(mBinStart.back());
+    std::vector<int> fill(mBinStart.begin(), mBinStart.end() - 1);
+    for (size_t t = 0; t < mTriangleMin.size(); t++)
+    {
+        int lo[3];
+        int hi[3];
+        binRange(mTriangleMin[t], mTriangleMax[t], lo, hi);
+        for (int ix = lo[0]; ix <= hi[0]; ix++)
+            for (int iy = lo[1]; iy <= hi[1]; iy++)
+                for (int iz = lo[2]; iz <= hi[2]; iz++)
+                    mBinTriangles[fill[binIndex(ix, iy, iz)]++] = static_cast<int>(t);
+    }
+}
+
+void TriangleGrid::query(const Point3D& min, const Point3D& max, std::pmr::vector<int>& candidates) const
+{
+    candidates.clear();
+    if (empty())
+    {
+        return;
+    }
+
+    int lo[3];
+    int hi[3];
+    binRange(min, max, lo, hi);
+
+    double boxMin[3] = { min.x() - mPadding, min.y() - mPadding, min.z() - mPadding };
+    double boxMax[3] = { max.x() + mPadding, max.y() + mPadding, max.z() + mPadding };
+
+    for (int ix = lo[0]; ix <= hi[0]; ix++)
+    {
+        for (int iy = lo[1]; iy <= hi[1]; iy++)
+        {
+            for (int iz = lo[2]; iz <= hi[2]; iz++)
+            {
+                int bin = binIndex(ix, iy, iz);
+                for (int i = mBinStart[bin]; i < mBinStart[bin + 1]; i++)
+                {
+                    int t = mBinTriangles[i];
+                    const Point3D& triangleMin = mTriangleMin[t];
+                    const Point3D& triangleMax = mTriangleMax[t];
+
+                    // A triangle spanning several queried bins is reported only from the first of them
+                    if (std::max(lo[0], binCoordinate(triangleMin.x() - mPadding, 0)) != ix ||
+                        std::max(lo[1], binCoordinate(triangleMin.y() - mPadding, 1)) != iy ||
+                        std::max(lo[2], binCoordinate(triangleMin.z() - mPadding, 2)) != iz)
+                    {
+                        continue;
+                    }
+
+                    if (triangleMax.x() < boxMin[0] || triangleMin.x() > boxMax[0] ||
+                        triangleMax.y() < boxMin[1] || triangleMin.y() > boxMax[1] ||
+                        triangleMax.z() < boxMin[2] || triangleMin.z() > boxMax[2])
+                    {
+                        continue;
+                    }
+
+                    candidates.push_back(t);
+                }
+            }
+        }
+    }
+}
+
+void TriangleGrid::binRange(const Point3D& min, const Point3D& max, int lo[3], int hi[3]) const
+{
+    lo[0] = binCoordinate(min.x() - mPadding, 0);
+    lo[1] = binCoordinate(min.y() - mPadding, 1);
+    lo[2] = binCoordinate(min.z() - mPadding, 2);
+    hi[0] = binCoordinate(max.x() + mPadding, 0);
+    hi[1] = binCoordinate(max.y() + mPadding, 1);
+    hi[2] = binCoordinate(max.z() + mPadding, 2);
+}
+
+int TriangleGrid::binCoordinate(double value, int axis) const
+{
+    double coordinate = std::floor((value - mOrigin[axis]) / mBinSize[axis]);
+    if (coordinate < 0.0)
+    {
+        return 0;
+    }
+    if (coordinate >= mDims[axis] - 1)
+    {
+        return mDims[axis] - 1;
+    }
+    return static_cast<int>(coordinate);
+}
+
+int TriangleGrid::binIndex(int ix, int iy, int iz) const
+{
+    return (ix * mDims[1] + iy) * mDims[2] + iz;
+}
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+#include "Model/VoxelCache.h"
+#include "Model/MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    unsigned long long rotateLeft(unsigned long long word, int bits)
+    {
+        return (word << bits) | (word >> (64 - bits));
+    }
+}
+
+VoxelCache::VoxelCache(size_t memoryBudget, const std::string& directory, unsigned long long diskBudget)
+    : mMemoryBudget(memoryBudget), mDirectory(diskBudget > 0 ? directory : std::string()), mDiskBudget(diskBudget), mTemporaryCount(0)
+{
+    if (!mDirectory.empty())
+    {
+        std::error_code error;
+        fs::create_directories(mDirectory, error);
+        std::lock_guard<std::mutex> lock(mMutex);
+        trimDisk();
+    }
+}
+
+std::shared_ptr<const Voxelizer> VoxelCache::get(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options)
+{
+    std::shared_ptr<const Voxelizer> cached = find(stlPath, voxelSize, options);
+    if (cached)
+    {
+        return cached;
+    }
+
+    std::shared_ptr<Voxelizer> voxelizer = Voxelizer::getVoxelizer(stlPath, voxelSize, options);
+    if (voxelizer->cancelled())
+    {
+        return voxelizer;
+    }
+    voxelizer->freeze();
+    insert(stlPath, voxelSize, options, voxelizer);
+    return voxelizer;
+}
+
+std::shared_ptr<const Voxelizer> VoxelCache::find(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options)
+{
+    std::string key;
+    std::string fileName;
+    if (keys(stlPath, voxelSize, options, key, fileName))
+    {
+        std::shared_ptr<const Voxelizer> cached = findInMemory(key);
+        if (cached)
+        {
+            return cached;
+        }
+
+        std::error_code error;
+        fs::path filePath = fs::path(mDirectory) / fileName;
+        if (!mDirectory.empty() && fs::exists(filePath, error))
+        {
+            std::shared_ptr<Voxelizer> voxelizer = Voxelizer::loadVoxelizer(filePath.string(), options);
+            if (voxelizer)
+            {
+                // Mark the file as recently used, so the disk cap evicts it last
+                fs::last_write_time(filePath, fs::file_time_type::clock::now(), error);
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    mStats.diskHits++;
+                }
+                voxelizer->freeze();
+                addToMemory(key, voxelizer);
+                return voxelizer;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats.misses++;
+    return nullptr;
+}
+
+void VoxelCache::insert(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options, const std::shared_ptr<const Voxelizer>& voxelizer)
+{
+    // Results of unreadable files and empty meshes have nothing to be found by
+    std::string key;
+    std::string fileName;
+    if (!keys(stlPath, voxelSize, options, key, fileName) || voxelizer->grid().sizeX() == 0)
+    {
+        return;
+    }
+    if (!mDirectory.empty())
+    {
+        addToDisk(fileName, *voxelizer);
+    }
+    addToMemory(key, voxelizer);
+}
+
+void VoxelCache::setBudgets(size_t memoryBudget, unsigned long long diskBudget)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMemoryBudget = memoryBudget;
+    mDiskBudget = diskBudget;
+    trimMemory();
+    if (!mDirectory.empty())
+    {
+        trimDisk();
+    }
+}
+
+void VoxelCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mIndex.clear();
+    mStats.entryCount = 0;
+    mStats.memoryBytes = 0;
+}
+
+VoxelCacheStats VoxelCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+unsigned long long VoxelCache::hashFile(const std::string& filePath)
+{
+    MappedFile file;
+    if (!file.open(filePath))
+    {
+        return 0;
+    }
+
+    // FNV-1a over whole words, rotated so the high bits of every word reach the low bits of the hash
+    const unsigned long long prime = 0x100000001b3ULL;
+    unsigned long long hash = 0xcbf29ce484222325ULL ^ file.size();
+    size_t wordCount = file.size() / sizeof(unsigned long long);
+    for (size_t w = 0; w < wordCount; w++)
+    {
+        unsigned long long word;
+        std::memcpy(&word, file.data() + w * sizeof(word), sizeof(word));
+        hash = rotateLeft((hash ^ word) * prime, 29);
+    }
+    for (size_t b = wordCount * sizeof(unsigned long long); b < file.size(); b++)
+    {
+        hash = (hash ^ static_cast<unsigned char>(file.data()[b])) * prime;
+    }
+
+    // Final avalanche of MurmurHash3
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash != 0 ? hash : 1;
+}
+
+unsigned long long VoxelCache::stlHash(const std::string& stlPath)
+{
+    // Hashing reads the whole file, while asking for its size and time does not. A file rewritten with the same
+    // size within the resolution of the modification time keeps its old hash.
+    std::error_code error;
+    unsigned long long size = fs::file_size(stlPath, error);
+    fs::file_time_type modified = error ? fs::file_time_type() : fs::last_write_time(stlPath, error);
+    if (error)
+    {
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto found = mHashes.find(stlPath);
+        if (found != mHashes.end() && found->second.size == size && found->second.modified == modified)
+        {
+            return found->second.hash;
+        }
+    }
+
+    // Hashed without holding mMutex, so other requests go on meanwhile
+    unsigned long long hash = hashFile(stlPath);
+    if (hash != 0)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mHashes[stlPath] = { size, modified, hash };
+    }
+    return hash;
+}
+
+bool VoxelCache::keys(const std::string& stlPath, double voxelSize, const VoxelizerOptions& options, std::string& key, std::string& fileName)
+{
+    unsigned long long hash = stlHash(stlPath);
+    if (hash == 0)
+    {
+        return false;
+    }
+
+    // The grid depends on the fill only; the quads held in memory also depend on the meshing and the coarse level
+    // The voxel size is written with every digit it needs to read back exactly
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%.17g-%s", hash, voxelSize, options.fill == VoxelizerOptions::Fill::Solid ? "solid" : "surface");
+    fileName = std::string(name) + ".vox";
+    key = std::string(name) + "-" + std::to_string(static_cast<int>(options.meshing)) + (options.coarseLevel ? "-lod" : "");
+    return true;
+}
+
+std::shared_ptr<const Voxelizer> VoxelCache::findInMemory(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mIndex.find(key);
+    if (found == mIndex.end())
+    {
+        return nullptr;
+    }
+    mEntries.splice(mEntries.begin(), mEntries, found->second);
+    mStats.memoryHits++;
+    return found->second->voxelizer;
+}
+
+void VoxelCache::addToMemory(const std::string& key, const std::shared_ptr<const Voxelizer>& voxelizer)
+{
+    size_t bytes = voxelizer->memoryBytes();
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Another thread may have made the same result meanwhile
+    auto found = mIndex.find(key);
+    if (found != mIndex.end())
+    {
+        mStats.memoryBytes -= found->second->bytes;
+        mEntries.erase(found->second);
+        mIndex.erase(found);
+        mStats.entryCount = mEntries.size();
+    }
+    if (bytes > mMemoryBudget)
+    {
+        return;
+    }
+    mEntries.push_front({ key, voxelizer, bytes });
+    mIndex[key] = mEntries.begin();
+    mStats.memoryBytes += bytes;
+    trimMemory();
+}
+
+void VoxelCache::addToDisk(const std::string& fileName, const Voxelizer& voxelizer)
+{
+    // Write under a name of its own and rename, so a file being written is never read or evicted
+    fs::path filePath = fs::path(mDirectory) / fileName;
+    fs::path temporaryPath = filePath;
+    temporaryPath += ".part" + std::to_string(mTemporaryCount++);
+    std::error_code error;
+    if (!voxelizer.saveVoxels(temporaryPath.string()))
+    {
+        fs::remove(temporaryPath, error);
+        return;
+    }
+    fs::rename(temporaryPath, filePath, error);
+    if (error)
+    {
+        fs::remove(temporaryPath, error);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    trimDisk();
+}
+
+void VoxelCache::trimMemory()
+{
+    while (mStats.memoryBytes > mMemoryBudget && !mEntries.empty())
+    {
+        mStats.memoryBytes -= mEntries.back().bytes;
+        mIndex.erase(mEntries.back().key);
+        mEntries.pop_back();
+    }
+    mStats.entryCount = mEntries.size();
+}
+
+void VoxelCache::trimDisk()
+{
+    struct CacheFile
+    {
+        fs::path path;
+        fs::file_time_type time;
+        unsigned long long bytes;
+    };
+    std::vector<CacheFile> files;
+    unsigned long long total = 0;
+    std::error_code error;
+    for (fs::directory_iterator it(mDirectory, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->path().extension() == ".vox" && it->is_regular_file(error))
+        {
+            CacheFile file = { it->path(), it->last_write_time(error), it->file_size(error) };
+            files.push_back(file);
+            total += file.bytes;
+        }
+    }
+
+    // Oldest first
+    std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.time < b.time; });
+    for (size_t f = 0; f < files.size() && total > mDiskBudget; f++)
+    {
+        if (fs::remove(files[f].path, error))
+        {
+            total -= files[f].bytes;
+        }
+    }
+    mStats.diskBytes = total;
+}
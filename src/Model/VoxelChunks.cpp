@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include "Model/VoxelChunks.h"
+#include "Model/ThreadPool.h"
+
+namespace
+{
+    const size_t elementsPerTask = 65536;
+
+    // Key of the chunk holding cell (i, j, k); keys ascend in x, y, z order of the chunks
+    unsigned long long chunkKey(size_t i, size_t j, size_t k)
+    {
+        const size_t c = VoxelChunks::chunkCells;
+        return (static_cast<unsigned long long>(i / c) << 42) | (static_cast<unsigned long long>(j / c) << 21) | (k / c);
+    }
+
+    // Reorder the elements of width values each so those of equal key are contiguous, in ascending key order,
+    // and return the range of every key. The elements are swapped into place, so no second buffer is needed.
+    template <class T>
+    std::vector<VoxelChunk> groupByKey(std::vector<T>& values, size_t width, const std::vector<unsigned long long>& keys)
+    {
+        // Number the chunks in order of appearance and count their elements
+        std::unordered_map<unsigned long long, unsigned int> slots;
+        std::vector<unsigned long long> slotKeys;
+        std::vector<size_t> counts;
+        std::vector<unsigned int> buckets(keys.size());
+        for (size_t e = 0; e < keys.size(); e++)
+        {
+            // Neighbouring elements mostly share a chunk, which saves the lookup
+            if (e > 0 && keys[e] == keys[e - 1])
+            {
+                buckets[e] = buckets[e - 1];
+            }
+            else
+            {
+                auto slot = slots.emplace(keys[e], static_cast<unsigned int>(slotKeys.size()));
+                if (slot.second)
+                {
+                    slotKeys.push_back(keys[e]);
+                    counts.push_back(0);
+                }
+                buckets[e] = slot.first->second;
+            }
+            counts[buckets[e]]++;
+        }
+
+        // Renumber them in key order
+        std::vector<unsigned int> order(slotKeys.size());
+        for (unsigned int s = 0; s < order.size(); s++)
+        {
+            order[s] = s;
+        }
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return slotKeys[a] < slotKeys[b]; });
+        std::vector<unsigned int> rank(order.size());
+        std::vector<size_t> offsets(order.size() + 1, 0);
+        for (unsigned int r = 0; r < order.size(); r++)
+        {
+            rank[order[r]] = r;
+            offsets[r + 1] = offsets[r] + counts[order[r]];
+        }
+        for (unsigned int& bucket : buckets)
+        {
+            bucket = rank[bucket];
+        }
+
+        // Swap every element into the next free place of its chunk
+        std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+        for (unsigned int b = 0; b < next.size(); b++)
+        {
+            while (next[b] < offsets[b + 1])
+            {
+                size_t e = next[b];
+                unsigned int target = buckets[e];
+                if (target == b)
+                {
+                    next[b]++;
+                    continue;
+                }
+                size_t place = next[target]++;
+                std::swap_ranges(values.begin() + e * width, values.begin() + (e + 1) * width, values.begin() + place * width);
+                std::swap(buckets[e], buckets[place]);
+            }
+        }
+
+        std::vector<VoxelChunk> chunks(order.size());
+        for (size_t b = 0; b < chunks.size(); b++)
+        {
+            chunks[b].first = offsets[b];
+            chunks[b].count = offsets[b + 1] - offsets[b];
+        }
+        return chunks;
+    }
+
+    // Cell index along an axis of a coordinate of the lattice, rounded down and clamped at 0
+    size_t cellOf(double value, double origin, double voxelSize)
+    {
+        return static_cast<size_t>(std::max(0.0, std::floor((value - origin) / voxelSize)));
+    }
+}
+
+std::vector<VoxelChunk> VoxelChunks::groupQuads(std::vector<float>& vertices, const Point3D& origin, double voxelSize, int threadCount)
+{
+    ThreadPool pool(threadCount);
+    size_t quadCount = vertices.size() / 12;
+    std::vector<unsigned long long> keys(quadCount);
+    pool.run((quadCount + elementsPerTask - 1) / elementsPerTask, [&](size_t task, int) {
+        size_t end = std::min(quadCount, (task + 1) * elementsPerTask);
+        for (size_t q = task * elementsPerTask; q < end; q++)
+        {
+            const float* quad = vertices.data() + q * 12;
+            double center[3] = { 0.0, 0.0, 0.0 };
+            for (int v = 0; v < 4; v++)
+            {
+                center[0] += quad[3 * v];
+                center[1] += quad[3 * v + 1];
+                center[2] += quad[3 * v + 2];
+            }
+            keys[q] = chunkKey(cellOf(center[0] / 4, origin.x(), voxelSize), cellOf(center[1] / 4, origin.y(), voxelSize), cellOf(center[2] / 4, origin.z(), voxelSize));
+        }
+    });
+    std::vector<VoxelChunk> chunks = groupByKey(vertices, 12, keys);
+
+    pool.run(chunks.size(), [&](size_t c, int) {
+        VoxelChunk& chunk = chunks[c];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            chunk.min[axis] = std::numeric_limits<float>::max();
+            chunk.max[axis] = std::numeric_limits<float>::lowest();
+        }
+        for (size_t v = chunk.first * 4; v < (chunk.first + chunk.count) * 4; v++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                chunk.min[axis] = std::min(chunk.min[axis], vertices[3 * v + axis]);
+                chunk.max[axis] = std::max(chunk.max[axis], vertices[3 * v + axis]);
+            }
+        }
+    });
+    return chunks;
+}
+
+std::vector<VoxelChunk> VoxelChunks::groupCells(std::vector<unsigned short>& cells, const Point3D& origin, double voxelSize, int threadCount)
+{
+    ThreadPool pool(threadCount);
+    size_t cellCount = cells.size() / 4;
+    std::vector<unsigned long long> keys(cellCount);
+    pool.run((cellCount + elementsPerTask - 1) / elementsPerTask, [&](size_t task, int) {
+        size_t end = std::min(cellCount, (task + 1) * elementsPerTask);
+        for (size_t n = task * elementsPerTask; n < end; n++)
+        {
+            keys[n] = chunkKey(cells[4 * n], cells[4 * n + 1], cells[4 * n + 2]);
+        }
+    });
+    std::vector<VoxelChunk> chunks = groupByKey(cells, 4, keys);
+
+    // The cells of a chunk span from its lowest to its highest cell index along each axis
+    const double corner[3] = { origin.x(), origin.y(), origin.z() };
+    pool.run(chunks.size(), [&](size_t c, int) {
+        VoxelChunk& chunk = chunks[c];
+        size_t lower[3] = { 65535, 65535, 65535 };
+        size_t upper[3] = { 0, 0, 0 };
+        for (size_t n = chunk.first; n < chunk.first + chunk.count; n++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                lower[axis] = std::min<size_t>(lower[axis], cells[4 * n + axis]);
+                upper[axis] = std::max<size_t>(upper[axis], cells[4 * n + axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            chunk.min[axis] = static_cast<float>(corner[axis] + lower[axis] * voxelSize);
+            chunk.max[axis] = static_cast<float>(corner[axis] + (upper[axis] + 1) * voxelSize);
+        }
+    });
+    return chunks;
+}
@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "Model/VoxelFile.h"
+#include "Model/ThreadPool.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace IOOperation;
+
+namespace
+{
+    const unsigned int voxelFileVersion = 2;
+    const size_t brickCells = 512;
+    const size_t brickRecordBytes = 9; // Brick y, brick z and the encoding
+
+    // Index of the lowest set bit of a non-zero word
+    int lowestBit(unsigned long long word)
+    {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        _BitScanForward64(&bit, word);
+        return static_cast<int>(bit);
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    template <typename T>
+    void append(std::vector<unsigned char>& buffer, const T& value)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    // Whether the grid of a header can be addressed: every dimension at least 1 with the cell count and the
+    // cells of a layer within size_t, and a finite, positive voxel size at a finite origin
+    bool validGrid(const VoxelFileHeader& header)
+    {
+        const unsigned long long limit = std::numeric_limits<size_t>::max();
+        const unsigned long long nx = header.size[0];
+        const unsigned long long ny = header.size[1];
+        const unsigned long long nz = header.size[2];
+        if (nx == 0 || ny == 0 || nz == 0 || nx > limit || ny > limit / nz || nx > limit / (ny * nz))
+        {
+            return false;
+        }
+        for (double coordinate : header.origin)
+        {
+            if (!std::isfinite(coordinate))
+            {
+                return false;
+            }
+        }
+        return std::isfinite(header.voxelSize) && header.voxelSize > 0.0;
+    }
+
+    // Copy a value out of the mapping, which gives no alignment guarantee
+    template <typename T>
+    T load(const char* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+}
+
+VoxelFileWriter::VoxelFileWriter() : mHeader(), mLayerWords(0), mOffset(0)
+{
+}
+
+VoxelFileWriter::~VoxelFileWriter()
+{
+    if (mFile.is_open())
+    {
+        close();
+    }
+}
+
+bool VoxelFileWriter::open(const std::string& filePath, size_t nx, size_t ny, size_t nz, const double origin[3], double voxelSize, unsigned int flags)
+{
+    mFile.open(filePath, std::ios::binary | std::ios::trunc);
+    if (!mFile)
+    {
+        return false;
+    }
+
+    mHeader = VoxelFileHeader();
+    std::memcpy(mHeader.magic, "VOXL", 4);
+    mHeader.version = voxelFileVersion;
+    mHeader.size[0] = nx;
+    mHeader.size[1] = ny;
+    mHeader.size[2] = nz;
+    std::copy(origin, origin + 3, mHeader.origin);
+    mHeader.voxelSize = voxelSize;
+    mHeader.flags = flags;
+    mLayerWords = (ny * nz + 63) / 64;
+    mDirectory.assign((nx + 7) / 8, 0);
+
+    // The counts and the directory offset are patched in by close()
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+    mOffset = sizeof(mHeader);
+    return static_cast<bool>(mFile);
+}
+
+void VoxelFileWriter::writeLayers(size_t firstLayer, size_t layerCount, const unsigned long long* layers)
+{
+    const size_t nz = mHeader.size[2];
+    for (size_t group = 0; group < layerCount; group += 8)
+    {
+        // Gather the set bits of up to 8 layers into the bricks they fall in
+        mBricks.clear();
+        size_t groupEnd = std::min(layerCount, group + 8);
+        for (size_t layer = group; layer < groupEnd; layer++)
+        {
+            const unsigned long long* words = layers + layer * mLayerWords;
+            for (size_t word = 0; word < mLayerWords; word++)
+            {
+                for (unsigned long long bits = words[word]; bits != 0; bits &= bits - 1)
+                {
+                    size_t cell = word * 64 + lowestBit(bits);
+                    size_t j = cell / nz;
+                    size_t k = cell % nz;
+                    Brick& brick = mBricks[(static_cast<unsigned long long>(j / 8) << 32) | (k / 8)];
+                    brick.planes[layer - group] |= 1ULL << ((j % 8) * 8 + k % 8);
+                    mHeader.voxelCount++;
+                }
+            }
+        }
+        if (mBricks.empty())
+        {
+            continue;
+        }
+
+        // Encode the chunk with its bricks in y, z order
+        mKeys.clear();
+        for (const auto& entry : mBricks)
+        {
+            mKeys.push_back(entry.first);
+        }
+        std::sort(mKeys.begin(), mKeys.end());
+        mBuffer.clear();
+        append(mBuffer, static_cast<unsigned int>(mKeys.size()));
+        for (unsigned long long key : mKeys)
+        {
+            encodeBrick(key, mBricks[key]);
+        }
+
+        mDirectory[(firstLayer + group) / 8] = mOffset;
+        mFile.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+        mOffset += mBuffer.size();
+        mHeader.brickCount += mKeys.size();
+    }
+}
+
+void VoxelFileWriter::writeGrid(const VoxelGrid& grid)
+{
+    std::vector<unsigned long long> layers(8 * grid.layerWords());
+    for (size_t first = 0; first < grid.sizeX(); first += 8)
+    {
+        size_t count = std::min<size_t>(8, grid.sizeX() - first);
+        for (size_t layer = 0; layer < count; layer++)
+        {
+            grid.getLayer(first + layer, layers.data() + layer * grid.layerWords());
+        }
+        writeLayers(first, count, layers.data());
+    }
+}
+
+void VoxelFileWriter::encodeBrick(unsigned long long key, const Brick& brick)
+{
+    append(mBuffer, static_cast<unsigned int>(key >> 32));
+    append(mBuffer, static_cast<unsigned int>(key & 0xffffffffULL));
+
+    size_t occupied = 0;
+    for (unsigned long long plane : brick.planes)
+    {
+        occupied += std::bitset<64>(plane).count();
+    }
+    if (occupied == brickCells)
+    {
+        mBuffer.push_back(static_cast<unsigned char>(BrickEncoding::Full));
+        return;
+    }
+
+    // Runs over the cells in bitmask order; a run longer than 255 goes on after a zero-length run of the other value
+    unsigned char runs[2 * brickCells];
+    size_t runCount = 0;
+    bool value = false;
+    size_t length = 0;
+    for (size_t cell = 0; cell < brickCells; cell++)
+    {
+        bool bit = ((brick.planes[cell / 64] >> (cell % 64)) & 1) != 0;
+        if (bit != value)
+        {
+            runs[runCount++] = static_cast<unsigned char>(length);
+            value = bit;
+            length = 0;
+        }
+        else if (length == 255)
+        {
+            runs[runCount++] = 255;
+            runs[runCount++] = 0;
+            length = 0;
+        }
+        length++;
+    }
+    runs[runCount++] = static_cast<unsigned char>(length);
+
+    // Keep whichever of the runs and the bitmask is smaller
+    if (sizeof(unsigned short) + runCount < sizeof(brick.planes))
+    {
+        mBuffer.push_back(static_cast<unsigned char>(BrickEncoding::Runs));
+        append(mBuffer, static_cast<unsigned short>(runCount));
+        mBuffer.insert(mBuffer.end(), runs, runs + runCount);
+    }
+    else
+    {
+        mBuffer.push_back(static_cast<unsigned char>(BrickEncoding::Bitmask));
+        for (unsigned long long plane : brick.planes)
+        {
+            append(mBuffer, plane);
+        }
+    }
+}
+
+bool VoxelFileWriter::close()
+{
+    mHeader.directoryOffset = mOffset;
+    mFile.write(reinterpret_cast<const char*>(mDirectory.data()), mDirectory.size() * sizeof(unsigned long long));
+    mFile.seekp(0);
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+    bool written = static_cast<bool>(mFile);
+    mFile.close();
+    mBricks.clear();
+    return written;
+}
+
+size_t VoxelFileWriter::layerWords() const
+{
+    return mLayerWords;
+}
+
+unsigned long long VoxelFileWriter::brickCount() const
+{
+    return mHeader.brickCount;
+}
+
+unsigned long long VoxelFileWriter::voxelCount() const
+{
+    return mHeader.voxelCount;
+}
+
+VoxelFileReader::VoxelFileReader() : mHeader(), mLayerWords(0), mChunkCount(0)
+{
+}
+
+VoxelFileReader::~VoxelFileReader()
+{
+}
+
+bool VoxelFileReader::open(const std::string& filePath)
+{
+    close();
+    if (!mFile.open(filePath) || mFile.size() < sizeof(VoxelFileHeader))
+    {
+        close();
+        return false;
+    }
+    std::memcpy(&mHeader, mFile.data(), sizeof(mHeader));
+    if (std::memcmp(mHeader.magic, "VOXL", 4) != 0 || mHeader.version != voxelFileVersion || !validGrid(mHeader))
+    {
+        close();
+        return false;
+    }
+
+    // The directory must hold an offset for every chunk
+    unsigned long long chunkCount = (mHeader.size[0] + 7) / 8;
+    bool valid = mHeader.directoryOffset >= sizeof(VoxelFileHeader) && mHeader.directoryOffset <= mFile.size() &&
+        (mFile.size() - mHeader.directoryOffset) / sizeof(unsigned long long) >= chunkCount;
+    if (!valid)
+    {
+        close();
+        return false;
+    }
+    mChunkCount = static_cast<size_t>(chunkCount);
+    size_t layerCells = static_cast<size_t>(mHeader.size[1] * mHeader.size[2]);
+    mLayerWords = layerCells / 64 + (layerCells % 64 != 0 ? 1 : 0);
+    return true;
+}
+
+void VoxelFileReader::close()
+{
+    mFile.close();
+    mHeader = VoxelFileHeader();
+    mLayerWords = 0;
+    mChunkCount = 0;
+}
+
+const VoxelFileHeader& VoxelFileReader::header() const
+{
+    return mHeader;
+}
+
+size_t VoxelFileReader::layerWords() const
+{
+    return mLayerWords;
+}
+
+bool VoxelFileReader::readChunk(size_t chunk, unsigned long long* layers) const
+{
+    if (chunk >= mChunkCount)
+    {
+        return false;
+    }
+    const size_t ny = static_cast<size_t>(mHeader.size[1]);
+    const size_t nz = static_cast<size_t>(mHeader.size[2]);
+    size_t layerCount = std::min<size_t>(8, static_cast<size_t>(mHeader.size[0]) - 8 * chunk);
+    std::fill(layers, layers + layerCount * mLayerWords, 0);
+
+    unsigned long long offset = load<unsigned long long>(mFile.data() + mHeader.directoryOffset + chunk * sizeof(unsigned long long));
+    if (offset == 0)
+    {
+        return true;
+    }
+
+    // Every read is checked against the start of the directory, so a damaged file cannot read past the mapping.
+    // open() made sure the directory starts after the header, so subtracting cannot wrap where adding could.
+    const char* end = mFile.data() + mHeader.directoryOffset;
+    if (offset < sizeof(VoxelFileHeader) || offset > mHeader.directoryOffset - 4)
+    {
+        return false;
+    }
+    const char* p = mFile.data() + offset;
+    unsigned int brickCount = load<unsigned int>(p);
+    p += 4;
+
+    unsigned long long planes[8];
+    for (unsigned int n = 0; n < brickCount; n++)
+    {
+        if (end - p < static_cast<ptrdiff_t>(brickRecordBytes))
+        {
+            return false;
+        }
+        size_t by = load<unsigned int>(p);
+        size_t bz = load<unsigned int>(p + 4);
+        BrickEncoding encoding = static_cast<BrickEncoding>(p[8]);
+        p += brickRecordBytes;
+
+        // A brick has to start inside the grid; only its cells past the far edge are dropped below
+        if (by >= (ny + 7) / 8 || bz >= (nz + 7) / 8)
+        {
+            return false;
+        }
+
+        if (encoding == BrickEncoding::Full)
+        {
+            std::fill(planes, planes + 8, ~0ULL);
+        }
+        else if (encoding == BrickEncoding::Bitmask)
+        {
+            if (end - p < static_cast<ptrdiff_t>(sizeof(planes)))
+            {
+                return false;
+            }
+            std::memcpy(planes, p, sizeof(planes));
+            p += sizeof(planes);
+        }
+        else if (encoding == BrickEncoding::Runs)
+        {
+            if (end - p < 2)
+            {
+                return false;
+            }
+            size_t runCount = load<unsigned short>(p);
+            p += 2;
+            if (end - p < static_cast<ptrdiff_t>(runCount))
+            {
+                return false;
+            }
+            std::fill(planes, planes + 8, 0);
+            size_t cell = 0;
+            for (size_t run = 0; run < runCount; run++)
+            {
+                size_t length = static_cast<unsigned char>(p[run]);
+                if (cell + length > brickCells)
+                {
+                    return false;
+                }
+                // Odd runs are the occupied ones
+                for (size_t c = cell; run % 2 == 1 && c < cell + length; c++)
+                {
+                    planes[c / 64] |= 1ULL << (c % 64);
+                }
+                cell += length;
+            }
+            p += runCount;
+        }
+        else
+        {
+            return false;
+        }
+
+        // Scatter the brick into the layers, dropping the cells past the edge of the grid
+        for (size_t x = 0; x < layerCount; x++)
+        {
+            for (unsigned long long bits = planes[x]; bits != 0; bits &= bits - 1)
+            {
+                int bit = lowestBit(bits);
+                size_t j = 8 * by + bit / 8;
+                size_t k = 8 * bz + bit % 8;
+                if (j < ny && k < nz)
+                {
+                    size_t cell = j * nz + k;
+                    layers[x * mLayerWords + cell / 64] |= 1ULL << (cell % 64);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool VoxelFileReader::readGrid(VoxelGrid& grid, int threadCount, VoxelGrid::Storage storage) const
+{
+    grid.reset(static_cast<size_t>(mHeader.size[0]), static_cast<size_t>(mHeader.size[1]), static_cast<size_t>(mHeader.size[2]), storage);
+    ThreadPool pool(threadCount);
+    std::vector<std::vector<unsigned long long>> layers(pool.threadCount(), std::vector<unsigned long long>(8 * mLayerWords));
+    std::atomic<bool> valid(true);
+    pool.run(mChunkCount, [&](size_t chunk, int worker) {
+        unsigned long long* chunkLayers = layers[worker].data();
+        if (!readChunk(chunk, chunkLayers))
+        {
+            valid = false;
+            return;
+        }
+        size_t layerCount = std::min<size_t>(8, grid.sizeX() - 8 * chunk);
+        for (size_t x = 0; x < layerCount; x++)
+        {
+            grid.setLayer(8 * chunk + x, chunkLayers + x * mLayerWords);
+        }
+    });
+    return valid;
+}
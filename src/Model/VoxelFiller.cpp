@@ -0,0 +1,301 @@
+#include <algorithm>
+#include "Model/VoxelFiller.h"
+#include "Model/ThreadPool.h"
+
+namespace
+{
+    // Rows of the x parity volume swept by one task
+    const size_t blockRows = 16;
+
+    // Inclusive prefix XOR of the bits of a word, lowest bit first
+    unsigned long long prefixXor(unsigned long long word)
+    {
+        word ^= word << 1;
+        word ^= word << 2;
+        word ^= word << 4;
+        word ^= word << 8;
+        word ^= word << 16;
+        word ^= word << 32;
+        return word;
+    }
+
+    // Call hit(m, n, crossing) for every ray along the axis through (centres[u][m], centres[v][n]),
+    // m in [uFirst, uLast) and n in [vFirst, vLast), that passes through the triangle; u and v follow the axis cyclically.
+    // Rays through a shared edge or vertex are counted for exactly one of the triangles meeting there.
+    template <class Hit>
+    void rasterize(const double p[3][3], int axis, const std::vector<double>* centres, size_t uFirst, size_t uLast, size_t vFirst, size_t vLast, Hit hit)
+    {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        // The axis component of the normal is twice the signed area of the projected triangle
+        double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        double normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        if (normal[axis] == 0.0)
+        {
+            return;
+        }
+
+        // Walk the projection counter-clockwise
+        const double* q[3] = { p[0], p[1], p[2] };
+        if (normal[axis] < 0.0)
+        {
+            std::swap(q[1], q[2]);
+        }
+
+        const std::vector<double>& us = centres[u];
+        const std::vector<double>& vs = centres[v];
+        double minU = std::min({ p[0][u], p[1][u], p[2][u] });
+        double maxU = std::max({ p[0][u], p[1][u], p[2][u] });
+        double minV = std::min({ p[0][v], p[1][v], p[2][v] });
+        double maxV = std::max({ p[0][v], p[1][v], p[2][v] });
+        size_t mFirst = std::max<size_t>(uFirst, std::lower_bound(us.begin(), us.end(), minU) - us.begin());
+        size_t mLast = std::min<size_t>(uLast, std::upper_bound(us.begin(), us.end(), maxU) - us.begin());
+        size_t nFirst = std::max<size_t>(vFirst, std::lower_bound(vs.begin(), vs.end(), minV) - vs.begin());
+        size_t nLast = std::min<size_t>(vLast, std::upper_bound(vs.begin(), vs.end(), maxV) - vs.begin());
+
+        for (size_t m = mFirst; m < mLast; m++)
+        {
+            for (size_t n = nFirst; n < nLast; n++)
+            {
+                double pu = us[m];
+                double pv = vs[n];
+                bool inside = true;
+                for (int edge = 0; edge < 3 && inside; edge++)
+                {
+                    const double* from = q[edge];
+                    const double* to = q[(edge + 1) % 3];
+                    double du = to[u] - from[u];
+                    double dv = to[v] - from[v];
+                    double side = du * (pv - from[v]) - dv * (pu - from[u]);
+                    // A ray exactly on an edge belongs to the triangle for one edge direction only
+                    inside = side > 0.0 || (side == 0.0 && (dv > 0.0 || (dv == 0.0 && du > 0.0)));
+                }
+                if (inside)
+                {
+                    double crossing = p[0][axis] - (normal[u] * (pu - p[0][u]) + normal[v] * (pv - p[0][v])) / normal[axis];
+                    hit(m, n, crossing);
+                }
+            }
+        }
+    }
+
+    // OR the lowest count bits of a word into a bitset, starting at bit offset
+    void orBits(unsigned long long* words, size_t offset, unsigned long long bits, size_t count)
+    {
+        if (bits == 0)
+        {
+            return;
+        }
+        size_t shift = offset % 64;
+        words[offset / 64] |= bits << shift;
+        if (shift != 0 && shift + count > 64)
+        {
+            words[offset / 64 + 1] |= bits >> (64 - shift);
+        }
+    }
+}
+
+VoxelFiller::VoxelFiller(const Mesh& mesh, const std::vector<float>& cornersX, const std::vector<float>& cornersY, const std::vector<float>& cornersZ, double voxelSize, int threadCount)
+    : mMesh(mesh), mThreadCount(threadCount)
+{
+    const std::vector<float>* corners[3] = { &cornersX, &cornersY, &cornersZ };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (float corner : *corners[axis])
+        {
+            mCentres[axis].push_back(corner + 0.5 * voxelSize);
+        }
+    }
+}
+
+void VoxelFiller::triangleCorners(size_t triangle, double corners[3][3]) const
+{
+    for (int corner = 0; corner < 3; corner++)
+    {
+        Point3D p = mMesh.corner(triangle, corner);
+        corners[corner][0] = p.x();
+        corners[corner][1] = p.y();
+        corners[corner][2] = p.z();
+    }
+}
+
+void VoxelFiller::centreRange(int axis, double min, double max, size_t& first, size_t& last) const
+{
+    const std::vector<double>& centres = mCentres[axis];
+    first = std::lower_bound(centres.begin(), centres.end(), min) - centres.begin();
+    last = std::upper_bound(centres.begin(), centres.end(), max) - centres.begin();
+}
+
+size_t VoxelFiller::toggleIndex(int axis, double crossing) const
+{
+    const std::vector<double>& centres = mCentres[axis];
+    return std::upper_bound(centres.begin(), centres.end(), crossing) - centres.begin();
+}
+
+void VoxelFiller::fill(VoxelGrid& grid) const
+{
+    const size_t nx = grid.sizeX();
+    const size_t ny = grid.sizeY();
+    const size_t nz = grid.sizeZ();
+    if (nx == 0 || ny == 0 || nz == 0 || mMesh.empty())
+    {
+        return;
+    }
+
+    // Parity bits are kept with every y row starting on a fresh word, so rows combine word by word
+    const size_t rowWords = (nz + 63) / 64;
+    const size_t layerSize = ny * rowWords;
+    const unsigned long long lastWordMask = nz % 64 == 0 ? ~0ULL : (1ULL << (nz % 64)) - 1;
+    const size_t triangleCount = mMesh.triangleCount();
+    ThreadPool pool(mThreadCount);
+
+    // List the triangles reaching the centres of each x layer and of each block of y rows
+    std::vector<size_t> ranges(4 * triangleCount);
+    pool.run((triangleCount + 4095) / 4096, [&](size_t chunk, int) {
+        size_t end = std::min(triangleCount, (chunk + 1) * 4096);
+        for (size_t t = chunk * 4096; t < end; t++) {
+            double p[3][3];
+            triangleCorners(t, p);
+            centreRange(0, std::min({ p[0][0], p[1][0], p[2][0] }), std::max({ p[0][0], p[1][0], p[2][0] }), ranges[4 * t], ranges[4 * t + 1]);
+            centreRange(1, std::min({ p[0][1], p[1][1], p[2][1] }), std::max({ p[0][1], p[1][1], p[2][1] }), ranges[4 * t + 2], ranges[4 * t + 3]);
+        }
+    });
+    size_t blockCount = (ny + blockRows - 1) / blockRows;
+    std::vector<size_t> layerStart(nx + 1, 0);
+    std::vector<size_t> blockStart(blockCount + 1, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (size_t i = ranges[4 * t]; i < ranges[4 * t + 1]; i++)
+        {
+            layerStart[i + 1]++;
+        }
+        if (ranges[4 * t + 2] < ranges[4 * t + 3])
+        {
+            for (size_t block = ranges[4 * t + 2] / blockRows; block <= (ranges[4 * t + 3] - 1) / blockRows; block++)
+            {
+                blockStart[block + 1]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < nx; i++)
+    {
+        layerStart[i + 1] += layerStart[i];
+    }
+    for (size_t block = 0; block < blockCount; block++)
+    {
+        blockStart[block + 1] += blockStart[block];
+    }
+    std::vector<int> layerTriangles(layerStart.back());
+    std::vector<int> blockTriangles(blockStart.back());
+    std::vector<size_t> layerFill(layerStart.begin(), layerStart.end() - 1);
+    std::vector<size_t> blockFill(blockStart.begin(), blockStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (size_t i = ranges[4 * t]; i < ranges[4 * t + 1]; i++)
+        {
+            layerTriangles[layerFill[i]++] = static_cast<int>(t);
+        }
+        if (ranges[4 * t + 2] < ranges[4 * t + 3])
+        {
+            for (size_t block = ranges[4 * t + 2] / blockRows; block <= (ranges[4 * t + 3] - 1) / blockRows; block++)
+            {
+                blockTriangles[blockFill[block]++] = static_cast<int>(t);
+            }
+        }
+    }
+    std::vector<size_t>().swap(ranges);
+
+    // Rays along x: each block of y rows toggles its own rows of every layer, then sweeps them along x
+    std::vector<unsigned long long> insideX(nx * layerSize, 0);
+    pool.run(blockCount, [&](size_t block, int) {
+        size_t firstRow = block * blockRows;
+        size_t lastRow = std::min(ny, firstRow + blockRows);
+        for (size_t n = blockStart[block]; n < blockStart[block + 1]; n++) {
+            double p[3][3];
+            triangleCorners(blockTriangles[n], p);
+            rasterize(p, 0, mCentres, firstRow, lastRow, 0, nz, [&](size_t j, size_t k, double crossing) {
+                size_t i = toggleIndex(0, crossing);
+                if (i < nx) {
+                    insideX[i * layerSize + j * rowWords + k / 64] ^= 1ULL << (k % 64);
+                }
+            });
+        }
+        for (size_t i = 1; i < nx; i++) {
+            const unsigned long long* before = insideX.data() + (i - 1) * layerSize;
+            unsigned long long* layer = insideX.data() + i * layerSize;
+            for (size_t word = firstRow * rowWords; word < lastRow * rowWords; word++) {
+                layer[word] ^= before[word];
+            }
+        }
+    });
+
+    // Rays along y and z stay inside their x layer, so every layer is finished on its own
+    struct LayerBuffers
+    {
+        std::vector<unsigned long long> insideY;
+        std::vector<unsigned long long> insideZ;
+        std::vector<unsigned long long> filled;
+    };
+    std::vector<LayerBuffers> buffers(pool.threadCount());
+    pool.run(nx, [&](size_t i, int worker) {
+        LayerBuffers& buffer = buffers[worker];
+        buffer.insideY.assign(layerSize, 0);
+        buffer.insideZ.assign(layerSize, 0);
+        buffer.filled.assign(grid.layerWords(), 0);
+
+        for (size_t n = layerStart[i]; n < layerStart[i + 1]; n++) {
+            double p[3][3];
+            triangleCorners(layerTriangles[n], p);
+            // Rays along z through (x_i, y_j)
+            rasterize(p, 2, mCentres, i, i + 1, 0, ny, [&](size_t, size_t j, double crossing) {
+                size_t k = toggleIndex(2, crossing);
+                if (k < nz) {
+                    buffer.insideZ[j * rowWords + k / 64] ^= 1ULL << (k % 64);
+                }
+            });
+            // Rays along y through (x_i, z_k)
+            rasterize(p, 1, mCentres, 0, nz, i, i + 1, [&](size_t k, size_t, double crossing) {
+                size_t j = toggleIndex(1, crossing);
+                if (j < ny) {
+                    buffer.insideY[j * rowWords + k / 64] ^= 1ULL << (k % 64);
+                }
+            });
+        }
+
+        // Sweep the z toggles along each row, carrying the parity from word to word
+        for (size_t j = 0; j < ny; j++) {
+            unsigned long long carry = 0;
+            for (size_t word = 0; word < rowWords; word++) {
+                unsigned long long& bits = buffer.insideZ[j * rowWords + word];
+                bits = prefixXor(bits) ^ carry;
+                carry = (bits >> 63) ? ~0ULL : 0;
+            }
+        }
+        // Sweep the y toggles from row to row
+        for (size_t j = 1; j < ny; j++) {
+            for (size_t word = 0; word < rowWords; word++) {
+                buffer.insideY[j * rowWords + word] ^= buffer.insideY[(j - 1) * rowWords + word];
+            }
+        }
+
+        // Majority vote of the three axes, packed into the grid's layer layout
+        const unsigned long long* insideLayerX = insideX.data() + i * layerSize;
+        for (size_t j = 0; j < ny; j++) {
+            for (size_t word = 0; word < rowWords; word++) {
+                size_t index = j * rowWords + word;
+                unsigned long long x = insideLayerX[index];
+                unsigned long long y = buffer.insideY[index];
+                unsigned long long z = buffer.insideZ[index];
+                unsigned long long vote = (x & y) | (x & z) | (y & z);
+                size_t count = word + 1 < rowWords ? 64 : nz - 64 * word;
+                if (word + 1 == rowWords) {
+                    vote &= lastWordMask;
+                }
+                orBits(buffer.filled.data(), j * nz + 64 * word, vote, count);
+            }
+        }
+        grid.setLayer(i, buffer.filled.data());
+    });
+}
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include "Model/VoxelGrid.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    size_t bitCount(unsigned long long word)
+    {
+        return std::bitset<64>(word).count();
+    }
+
+    // Index of the lowest set bit of a non-zero word
+    int lowestBit(unsigned long long word)
+    {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        _BitScanForward64(&bit, word);
+        return static_cast<int>(bit);
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+}
+
+VoxelGrid::VoxelGrid() : mSparse(false), mLayerWords(0)
+{
+    mSize[0] = mSize[1] = mSize[2] = 0;
+}
+
+VoxelGrid::VoxelGrid(size_t nx, size_t ny, size_t nz, Storage storage) : VoxelGrid()
+{
+    reset(nx, ny, nz, storage);
+}
+
+VoxelGrid::~VoxelGrid()
+{
+}
+
+VoxelGrid::VoxelGrid(const VoxelGrid& other) : VoxelGrid()
+{
+    *this = other;
+}
+
+VoxelGrid& VoxelGrid::operator=(const VoxelGrid& other)
+{
+    if (this != &other)
+    {
+        std::copy(other.mSize, other.mSize + 3, mSize);
+        mSparse = other.mSparse;
+        mLayerWords = other.mLayerWords;
+        mDense = other.mDense;
+        mSlabs = other.mSlabs;
+        mSlabLocks.reset(new std::mutex[mSlabs.size()]);
+    }
+    return *this;
+}
+
+void VoxelGrid::reset(size_t nx, size_t ny, size_t nz, Storage storage)
+{
+    mSize[0] = nx;
+    mSize[1] = ny;
+    mSize[2] = nz;
+    mLayerWords = (ny * nz + 63) / 64;
+
+    if (storage == Storage::Automatic)
+    {
+        storage = nx * mLayerWords * sizeof(unsigned long long) <= denseLimitBytes ? Storage::Dense : Storage::Sparse;
+    }
+    mSparse = storage == Storage::Sparse;
+
+    std::vector<unsigned long long>().swap(mDense);
+    std::vector<std::unordered_map<unsigned long long, Brick>>().swap(mSlabs);
+    if (mSparse)
+    {
+        mSlabs.resize((nx + 7) / 8);
+    }
+    else
+    {
+        mDense.assign(nx * mLayerWords, 0);
+    }
+    mSlabLocks.reset(new std::mutex[mSlabs.size()]);
+}
+
+size_t VoxelGrid::sizeX() const
+{
+    return mSize[0];
+}
+
+size_t VoxelGrid::sizeY() const
+{
+    return mSize[1];
+}
+
+size_t VoxelGrid::sizeZ() const
+{
+    return mSize[2];
+}
+
+bool VoxelGrid::isSparse() const
+{
+    return mSparse;
+}
+
+unsigned long long VoxelGrid::brickKey(size_t j, size_t k)
+{
+    return (static_cast<unsigned long long>(j >> 3) << 32) | (k >> 3);
+}
+
+bool VoxelGrid::isOccupied(size_t i, size_t j, size_t k) const
+{
+    if (i >= mSize[0] || j >= mSize[1] || k >= mSize[2])
+    {
+        return false;
+    }
+    if (!mSparse)
+    {
+        size_t cell = j * mSize[2] + k;
+        return (mDense[i * mLayerWords + cell / 64] >> (cell % 64)) & 1;
+    }
+
+    const std::unordered_map<unsigned long long, Brick>& slab = mSlabs[i >> 3];
+    auto brick = slab.find(brickKey(j, k));
+    if (brick == slab.end())
+    {
+        return false;
+    }
+    return (brick->second.planes[i & 7] >> ((j & 7) * 8 + (k & 7))) & 1;
+}
+
+void VoxelGrid::set(size_t i, size_t j, size_t k)
+{
+    if (i >= mSize[0] || j >= mSize[1] || k >= mSize[2])
+    {
+        return;
+    }
+    if (!mSparse)
+    {
+        size_t cell = j * mSize[2] + k;
+        mDense[i * mLayerWords + cell / 64] |= 1ULL << (cell % 64);
+        return;
+    }
+
+    // A new brick starts out empty
+    Brick& brick = mSlabs[i >> 3].emplace(brickKey(j, k), Brick()).first->second;
+    brick.planes[i & 7] |= 1ULL << ((j & 7) * 8 + (k & 7));
+}
+
+size_t VoxelGrid::count() const
+{
+    size_t total = 0;
+    for (unsigned long long word : mDense)
+    {
+        total += bitCount(word);
+    }
+    for (const auto& slab : mSlabs)
+    {
+        for (const auto& brick : slab)
+        {
+            for (unsigned long long plane : brick.second.planes)
+            {
+                total += bitCount(plane);
+            }
+        }
+    }
+    return total;
+}
+
+size_t VoxelGrid::layerWords() const
+{
+    return mLayerWords;
+}
+
+void VoxelGrid::getLayer(size_t i, unsigned long long* words) const
+{
+    if (!mSparse)
+    {
+        std::memcpy(words, mDense.data() + i * mLayerWords, mLayerWords * sizeof(unsigned long long));
+        return;
+    }
+
+    std::fill(words, words + mLayerWords, 0ULL);
+    for (const auto& brick : mSlabs[i >> 3])
+    {
+        unsigned long long plane = brick.second.planes[i & 7];
+        size_t j0 = static_cast<size_t>(brick.first >> 32) * 8;
+        size_t k0 = static_cast<size_t>(brick.first & 0xFFFFFFFFULL) * 8;
+        while (plane != 0)
+        {
+            int bit = lowestBit(plane);
+            plane &= plane - 1;
+            size_t cell = (j0 + bit / 8) * mSize[2] + k0 + bit % 8;
+            words[cell / 64] |= 1ULL << (cell % 64);
+        }
+    }
+}
+
+void VoxelGrid::setLayer(size_t i, const unsigned long long* words)
+{
+    if (!mSparse)
+    {
+        // Every layer starts on a fresh word, so layers never share a word
+        unsigned long long* layer = mDense.data() + i * mLayerWords;
+        for (size_t word = 0; word < mLayerWords; word++)
+        {
+            layer[word] |= words[word];
+        }
+        return;
+    }
+
+    // The eight layers of a slab share its bricks
+    std::lock_guard<std::mutex> lock(mSlabLocks[i >> 3]);
+    std::unordered_map<unsigned long long, Brick>& slab = mSlabs[i >> 3];
+    unsigned long long lastKey = ~0ULL;
+    Brick* brick = nullptr;
+    for (size_t word = 0; word < mLayerWords; word++)
+    {
+        unsigned long long bits = words[word];
+        while (bits != 0)
+        {
+            int bit = lowestBit(bits);
+            bits &= bits - 1;
+            size_t cell = word * 64 + bit;
+            size_t j = cell / mSize[2];
+            size_t k = cell % mSize[2];
+            // Neighbouring cells of a row mostly fall into the same brick
+            unsigned long long key = brickKey(j, k);
+            if (key != lastKey)
+            {
+                brick = &slab.emplace(key, Brick()).first->second;
+                lastKey = key;
+            }
+            brick->planes[i & 7] |= 1ULL << ((j & 7) * 8 + (k & 7));
+        }
+    }
+}
+
+size_t VoxelGrid::memoryBytes() const
+{
+    size_t bytes = mDense.capacity() * sizeof(unsigned long long);
+    for (const auto& slab : mSlabs)
+    {
+        // Each brick sits in a hash node next to its key and a link, plus one bucket pointer
+        bytes += slab.size() * (sizeof(Brick) + 2 * sizeof(unsigned long long) + sizeof(void*)) + slab.bucket_count() * sizeof(void*);
+    }
+    return bytes;
+}
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <chrono>
+#include "Model/VoxelMesher.h"
+#include "Model/ThreadPool.h"
+
+double VoxelMeshStats::reduction() const
+{
+    return vertexCount > 0 ? double(cubeVertexCount) / vertexCount : 1.0;
+}
+
+VoxelMesher::VoxelMesher(const VoxelGrid& grid, const std::vector<float>& planesX, const std::vector<float>& planesY, const std::vector<float>& planesZ, int threadCount)
+    : mGrid(grid), mThreadCount(threadCount)
+{
+    mPlanes[0] = &planesX;
+    mPlanes[1] = &planesY;
+    mPlanes[2] = &planesZ;
+}
+
+VoxelMeshStats VoxelMesher::mesh(Mode mode, std::vector<float>& vertices) const
+{
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(mThreadCount);
+
+    // Mesh the slabs in parallel, each into a buffer of its own
+    size_t slabCount = (mGrid.sizeX() + slabDepth - 1) / slabDepth;
+    std::vector<std::vector<float>> slabVertices(slabCount);
+    pool.run(slabCount, [&](size_t slab, int) {
+        meshSlab(mode, slab * slabDepth, std::min(mGrid.sizeX(), (slab + 1) * slabDepth), slabVertices[slab]);
+    });
+
+    // Join the slabs in x order
+    size_t first = vertices.size();
+    std::vector<size_t> offsets(slabCount + 1, first);
+    for (size_t slab = 0; slab < slabCount; slab++)
+    {
+        offsets[slab + 1] = offsets[slab] + slabVertices[slab].size();
+    }
+    vertices.resize(offsets.back());
+    pool.run(slabCount, [&](size_t slab, int) {
+        std::copy(slabVertices[slab].begin(), slabVertices[slab].end(), vertices.begin() + offsets[slab]);
+        std::vector<float>().swap(slabVertices[slab]);
+    });
+
+    VoxelMeshStats stats;
+    stats.voxelCount = mGrid.count();
+    stats.cubeVertexCount = 24 * stats.voxelCount;
+    stats.vertexCount = (vertices.size() - first) / 3;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void VoxelMesher::meshSlab(Mode mode, size_t first, size_t last, std::vector<float>& vertices) const
+{
+    const size_t ny = mGrid.sizeY();
+    const size_t nz = mGrid.sizeZ();
+    const size_t nx = mGrid.sizeX();
+
+    // Layers first - 1 to last - 1; layers outside the grid stay empty
+    std::vector<std::vector<unsigned long long>> layers(last - first + 1, std::vector<unsigned long long>(mGrid.layerWords(), 0));
+    for (size_t i = first > 0 ? first - 1 : 0; i < last; i++)
+    {
+        mGrid.getLayer(i, layers[i + 1 - first].data());
+    }
+    std::vector<unsigned long long> empty(mGrid.layerWords(), 0);
+    auto occupied = [&](const std::vector<unsigned long long>& layer, size_t j, size_t k) {
+        size_t cell = j * nz + k;
+        return (layer[cell / 64] >> (cell % 64)) & 1;
+    };
+    auto sign = [](bool before, bool after) -> signed char {
+        return after && !before ? -1 : (before && !after ? 1 : 0);
+    };
+
+    const float* planesX = mPlanes[0]->data();
+    const float* planesY = mPlanes[1]->data();
+    const float* planesZ = mPlanes[2]->data();
+    FaceMask mask;
+
+    // Faces between x layers a - 1 and a; the last slab also closes the grid at x = nx
+    mask.rows = ny;
+    mask.cols = nz;
+    size_t lastPlane = last == nx ? nx : last - 1;
+    for (size_t a = first; a <= lastPlane; a++)
+    {
+        const std::vector<unsigned long long>& before = layers[a - first];
+        const std::vector<unsigned long long>& after = a < last ? layers[a + 1 - first] : empty;
+        mask.faces.assign(ny * nz, 0);
+        for (size_t j = 0; j < ny; j++)
+        {
+            for (size_t k = 0; k < nz; k++)
+            {
+                mask.faces[j * nz + k] = sign(occupied(before, j, k), occupied(after, j, k));
+            }
+        }
+        emitFaces(mode, mask, 0, planesX[a], 1, planesY, 2, planesZ, vertices);
+    }
+
+    // Faces between rows b - 1 and b of every layer of the slab, merged across the layers
+    mask.rows = last - first;
+    mask.cols = nz;
+    for (size_t b = 0; b <= ny; b++)
+    {
+        mask.faces.assign(mask.rows * nz, 0);
+        for (size_t i = first; i < last; i++)
+        {
+            const std::vector<unsigned long long>& layer = layers[i + 1 - first];
+            for (size_t k = 0; k < nz; k++)
+            {
+                bool before = b > 0 && occupied(layer, b - 1, k);
+                bool after = b < ny && occupied(layer, b, k);
+                mask.faces[(i - first) * nz + k] = sign(before, after);
+            }
+        }
+        emitFaces(mode, mask, 1, planesY[b], 0, planesX + first, 2, planesZ, vertices);
+    }
+
+    // Faces between columns c - 1 and c of every layer of the slab
+    mask.rows = last - first;
+    mask.cols = ny;
+    for (size_t c = 0; c <= nz; c++)
+    {
+        mask.faces.assign(mask.rows * ny, 0);
+        for (size_t i = first; i < last; i++)
+        {
+            const std::vector<unsigned long long>& layer = layers[i + 1 - first];
+            for (size_t j = 0; j < ny; j++)
+            {
+                bool before = c > 0 && occupied(layer, j, c - 1);
+                bool after = c < nz && occupied(layer, j, c);
+                mask.faces[(i - first) * ny + j] = sign(before, after);
+            }
+        }
+        emitFaces(mode, mask, 2, planesZ[c], 0, planesX + first, 1, planesY, vertices);
+    }
+}
+
+void VoxelMesher::emitFaces(Mode mode, FaceMask& mask, int axis, float coordinate, int rowAxis, const float* rowPlanes, int colAxis, const float* colPlanes, std::vector<float>& vertices) const
+{
+    for (size_t r = 0; r < mask.rows; r++)
+    {
+        signed char* row = mask.faces.data() + r * mask.cols;
+        for (size_t c = 0; c < mask.cols; c++)
+        {
+            signed char facing = row[c];
+            if (facing == 0)
+            {
+                continue;
+            }
+            if (mode == Mode::CulledFaces)
+            {
+                addQuad(axis, coordinate, facing, rowAxis, rowPlanes[r], rowPlanes[r + 1], colAxis, colPlanes[c], colPlanes[c + 1], vertices);
+                continue;
+            }
+
+            // Widen along the row, then grow downwards while every face below matches
+            size_t width = 1;
+            while (c + width < mask.cols && row[c + width] == facing)
+            {
+                width++;
+            }
+            size_t height = 1;
+            while (r + height < mask.rows)
+            {
+                const signed char* below = mask.faces.data() + (r + height) * mask.cols + c;
+                if (std::any_of(below, below + width, [facing](signed char f) { return f != facing; }))
+                {
+                    break;
+                }
+                height++;
+            }
+            for (size_t h = 0; h < height; h++)
+            {
+                std::fill_n(mask.faces.data() + (r + h) * mask.cols + c, width, 0);
+            }
+            addQuad(axis, coordinate, facing, rowAxis, rowPlanes[r], rowPlanes[r + height], colAxis, colPlanes[c], colPlanes[c + width], vertices);
+            c += width - 1;
+        }
+    }
+}
+
+void VoxelMesher::addQuad(int axis, float coordinate, int sign, int rowAxis, float row0, float row1, int colAxis, float col0, float col1, std::vector<float>& vertices)
+{
+    float corners[4][3];
+    const float rows[4] = { row0, row1, row1, row0 };
+    const float cols[4] = { col0, col0, col1, col1 };
+    for (int n = 0; n < 4; n++)
+    {
+        corners[n][axis] = coordinate;
+        corners[n][rowAxis] = rows[n];
+        corners[n][colAxis] = cols[n];
+    }
+
+    // Corners 0, 1, 2, 3 turn counter-clockwise around +axis when the row axis follows the face axis
+    bool counterClockwise = (rowAxis == (axis + 1) % 3) == (sign > 0);
+    const int order[2][4] = { { 0, 3, 2, 1 }, { 0, 1, 2, 3 } };
+    for (int n : order[counterClockwise])
+    {
+        vertices.insert(vertices.end(), corners[n], corners[n] + 3);
+    }
+}
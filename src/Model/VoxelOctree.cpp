@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include "Model/VoxelOctree.h"
+#include "Model/ThreadPool.h"
+
+namespace
+{
+    // Spread the low 21 bits of v to every third bit
+    unsigned long long spreadBits(unsigned long long v)
+    {
+        v &= 0x1fffff;
+        v = (v | (v << 32)) & 0x1f00000000ffffULL;
+        v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+        v = (v | (v << 8)) & 0x100f00f00f00f00fULL;
+        v = (v | (v << 4)) & 0x10c30c30c30c30c3ULL;
+        v = (v | (v << 2)) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    // Gather every third bit of v into the low 21 bits
+    size_t compactBits(unsigned long long v)
+    {
+        v &= 0x1249249249249249ULL;
+        v = (v | (v >> 2)) & 0x10c30c30c30c30c3ULL;
+        v = (v | (v >> 4)) & 0x100f00f00f00f00fULL;
+        v = (v | (v >> 8)) & 0x1f0000ff0000ffULL;
+        v = (v | (v >> 16)) & 0x1f00000000ffffULL;
+        v = (v | (v >> 32)) & 0x1fffff;
+        return static_cast<size_t>(v);
+    }
+
+    // Morton code of a cell: x in bit 0, y in bit 1 and z in bit 2 of every group of three
+    unsigned long long mortonCode(size_t i, size_t j, size_t k)
+    {
+        return spreadBits(i) | (spreadBits(j) << 1) | (spreadBits(k) << 2);
+    }
+
+    // Number of octants of a mask below octant
+    size_t octantsBelow(unsigned char mask, int octant)
+    {
+        return std::bitset<8>(mask & ((1u << octant) - 1)).count();
+    }
+
+    // Ray parameter at which a ray enters the cube [lower, lower + size] along every axis, 0 when it starts inside;
+    // false when it misses the cube or the cube lies behind it
+    bool enterCube(const double origin[3], const double direction[3], const double lower[3], double size, double& entry)
+    {
+        double enter = 0.0;
+        double leave = std::numeric_limits<double>::infinity();
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (direction[axis] == 0.0)
+            {
+                if (origin[axis] < lower[axis] || origin[axis] > lower[axis] + size)
+                {
+                    return false;
+                }
+                continue;
+            }
+            double t0 = (lower[axis] - origin[axis]) / direction[axis];
+            double t1 = (lower[axis] + size - origin[axis]) / direction[axis];
+            enter = std::max(enter, std::min(t0, t1));
+            leave = std::min(leave, std::max(t0, t1));
+        }
+        entry = enter;
+        return enter <= leave;
+    }
+}
+
+VoxelOctree::VoxelOctree() : mDepth(1), mVoxelSize(1.0), mLevelStart(2, 0), mCellCount(0)
+{
+    mSize[0] = mSize[1] = mSize[2] = 0;
+}
+
+VoxelOctree::VoxelOctree(const VoxelGrid& grid, const Point3D& origin, double voxelSize, int threadCount, const TriangleLookup& triangles)
+    : mDepth(1), mOrigin(origin), mVoxelSize(voxelSize), mCellCount(0)
+{
+    mSize[0] = grid.sizeX();
+    mSize[1] = grid.sizeY();
+    mSize[2] = grid.sizeZ();
+    size_t largest = std::max({ mSize[0], mSize[1], mSize[2] });
+    while ((size_t(1) << mDepth) < largest)
+    {
+        mDepth++;
+    }
+
+    // Morton codes of the occupied cells, layer by layer, then in Morton order
+    ThreadPool pool(threadCount);
+    std::vector<std::vector<unsigned long long>> layerCodes(mSize[0]);
+    pool.run(mSize[0], [&](size_t i, int) {
+        std::vector<unsigned long long> layer(grid.layerWords());
+        grid.getLayer(i, layer.data());
+        for (size_t w = 0; w < layer.size(); w++)
+        {
+            for (unsigned long long bits = layer[w]; bits != 0; bits &= bits - 1)
+            {
+                size_t cell = w * 64 + std::bitset<64>((bits & (~bits + 1)) - 1).count();
+                layerCodes[i].push_back(mortonCode(i, cell / mSize[2], cell % mSize[2]));
+            }
+        }
+    });
+    std::vector<unsigned long long> codes;
+    for (std::vector<unsigned long long>& layer : layerCodes)
+    {
+        codes.insert(codes.end(), layer.begin(), layer.end());
+        layer = std::vector<unsigned long long>();
+    }
+    std::sort(codes.begin(), codes.end());
+    mCellCount = codes.size();
+
+    // Levels bottom up: the parents of a sorted level are its codes without the last octant, still sorted,
+    // and the children of every parent are consecutive
+    std::vector<std::vector<Node>> levels(mDepth);
+    std::vector<unsigned long long> children = codes;
+    for (int level = mDepth - 1; level >= 0; level--)
+    {
+        std::vector<unsigned long long> parents;
+        std::vector<Node>& nodes = levels[level];
+        for (size_t n = 0; n < children.size(); n++)
+        {
+            unsigned long long parent = children[n] >> 3;
+            if (parents.empty() || parents.back() != parent)
+            {
+                parents.push_back(parent);
+                nodes.push_back({ static_cast<unsigned int>(n), 0, { 0, 0, 0 } });
+            }
+            nodes.back().childMask |= 1 << (children[n] & 7);
+        }
+        children.swap(parents);
+    }
+
+    // Root first; child indices within a level become indices into the whole array
+    mLevelStart.assign(mDepth + 1, 0);
+    for (int level = 0; level < mDepth; level++)
+    {
+        mLevelStart[level + 1] = mLevelStart[level] + levels[level].size();
+    }
+    mNodes.reserve(mLevelStart[mDepth]);
+    for (int level = 0; level < mDepth; level++)
+    {
+        for (Node node : levels[level])
+        {
+            if (level + 1 < mDepth)
+            {
+                node.firstChild += static_cast<unsigned int>(mLevelStart[level + 1]);
+            }
+            mNodes.push_back(node);
+        }
+        levels[level] = std::vector<Node>();
+    }
+
+    if (!triangles)
+    {
+        return;
+    }
+
+    // Triangle lists in chunks of cells, joined in cell order
+    const size_t chunkSize = 4096;
+    std::vector<std::vector<int>> chunkTriangles((mCellCount + chunkSize - 1) / chunkSize);
+    mTriangleStart.assign(mCellCount + 1, 0);
+    pool.run(chunkTriangles.size(), [&](size_t chunk, int) {
+        size_t end = std::min(mCellCount, (chunk + 1) * chunkSize);
+        for (size_t n = chunk * chunkSize; n < end; n++)
+        {
+            size_t before = chunkTriangles[chunk].size();
+            triangles(compactBits(codes[n]), compactBits(codes[n] >> 1), compactBits(codes[n] >> 2), chunkTriangles[chunk]);
+            mTriangleStart[n + 1] = chunkTriangles[chunk].size() - before;
+        }
+    });
+    for (size_t n = 0; n < mCellCount; n++)
+    {
+        mTriangleStart[n + 1] += mTriangleStart[n];
+    }
+    mTriangles.reserve(mTriangleStart[mCellCount]);
+    for (const std::vector<int>& chunk : chunkTriangles)
+    {
+        mTriangles.insert(mTriangles.end(), chunk.begin(), chunk.end());
+    }
+}
+
+int VoxelOctree::depth() const
+{
+    return mDepth;
+}
+
+const std::vector<VoxelOctree::Node>& VoxelOctree::nodes() const
+{
+    return mNodes;
+}
+
+size_t VoxelOctree::levelStart(int level) const
+{
+    return mLevelStart[level];
+}
+
+size_t VoxelOctree::cellCount() const
+{
+    return mCellCount;
+}
+
+bool VoxelOctree::hasTriangles() const
+{
+    return !mTriangleStart.empty();
+}
+
+bool VoxelOctree::isOccupied(size_t i, size_t j, size_t k) const
+{
+    return cellNumber(i, j, k) < mCellCount;
+}
+
+const int* VoxelOctree::triangles(size_t i, size_t j, size_t k, size_t& count) const
+{
+    size_t cell = cellNumber(i, j, k);
+    if (cell >= mCellCount || mTriangleStart.empty())
+    {
+        count = 0;
+        return nullptr;
+    }
+    count = mTriangleStart[cell + 1] - mTriangleStart[cell];
+    return mTriangles.data() + mTriangleStart[cell];
+}
+
+bool VoxelOctree::raycast(const Point3D& origin, const Point3D& direction, size_t cell[3], double& distance) const
+{
+    if (mNodes.empty())
+    {
+        return false;
+    }
+
+    // In cell units the ray keeps its parameter
+    double start[3] = { (origin.x() - mOrigin.x()) / mVoxelSize, (origin.y() - mOrigin.y()) / mVoxelSize, (origin.z() - mOrigin.z()) / mVoxelSize };
+    double step[3] = { direction.x() / mVoxelSize, direction.y() / mVoxelSize, direction.z() / mVoxelSize };
+
+    // Depth first, nearest octant first: octants along a ray never overlap, so the first cell reached is the nearest
+    struct Visit
+    {
+        size_t node;
+        size_t corner[3]; // Lowest cell of the node
+        int level;
+    };
+    struct Octant
+    {
+        double entry;
+        int octant;
+    };
+    double rootCorner[3] = { 0.0, 0.0, 0.0 };
+    double entry;
+    if (!enterCube(start, step, rootCorner, double(size_t(1) << mDepth), entry))
+    {
+        return false;
+    }
+    std::vector<Visit> stack(1, { 0, { 0, 0, 0 }, 0 });
+    while (!stack.empty())
+    {
+        Visit visit = stack.back();
+        stack.pop_back();
+        const Node& node = mNodes[visit.node];
+        size_t half = size_t(1) << (mDepth - 1 - visit.level);
+
+        Octant octants[8];
+        int count = 0;
+        for (int c = 0; c < 8; c++)
+        {
+            if (node.childMask & (1 << c))
+            {
+                double lower[3] = { double(visit.corner[0] + (c & 1) * half), double(visit.corner[1] + ((c >> 1) & 1) * half), double(visit.corner[2] + ((c >> 2) & 1) * half) };
+                if (enterCube(start, step, lower, double(half), entry))
+                {
+                    octants[count++] = { entry, c };
+                }
+            }
+        }
+        std::sort(octants, octants + count, [](const Octant& a, const Octant& b) { return a.entry < b.entry; });
+
+        if (visit.level == mDepth - 1)
+        {
+            if (count > 0)
+            {
+                int c = octants[0].octant;
+                cell[0] = visit.corner[0] + (c & 1);
+                cell[1] = visit.corner[1] + ((c >> 1) & 1);
+                cell[2] = visit.corner[2] + ((c >> 2) & 1);
+                distance = octants[0].entry;
+                return true;
+            }
+            continue;
+        }
+        for (int n = count - 1; n >= 0; n--)
+        {
+            int c = octants[n].octant;
+            Visit child = { node.firstChild + octantsBelow(node.childMask, c),
+                { visit.corner[0] + (c & 1) * half, visit.corner[1] + ((c >> 1) & 1) * half, visit.corner[2] + ((c >> 2) & 1) * half },
+                visit.level + 1 };
+            stack.push_back(child);
+        }
+    }
+    return false;
+}
+
+VoxelGrid VoxelOctree::levelGrid(int level) const
+{
+    // Lowest cell of every node of a level, in node order, found level by level from the root
+    std::vector<size_t> corners;
+    if (!mNodes.empty())
+    {
+        corners.assign(3, 0);
+    }
+    for (int l = 0; l < level; l++)
+    {
+        std::vector<size_t> next;
+        for (size_t n = 0; n < corners.size() / 3; n++)
+        {
+            unsigned char mask = mNodes[mLevelStart[l] + n].childMask;
+            for (int c = 0; c < 8; c++)
+            {
+                if (mask & (1 << c))
+                {
+                    next.push_back(corners[3 * n] * 2 + (c & 1));
+                    next.push_back(corners[3 * n + 1] * 2 + ((c >> 1) & 1));
+                    next.push_back(corners[3 * n + 2] * 2 + ((c >> 2) & 1));
+                }
+            }
+        }
+        corners.swap(next);
+    }
+
+    size_t span = size_t(1) << (mDepth - level);
+    VoxelGrid grid((mSize[0] + span - 1) / span, (mSize[1] + span - 1) / span, (mSize[2] + span - 1) / span);
+    for (size_t n = 0; n < corners.size() / 3; n++)
+    {
+        grid.set(corners[3 * n], corners[3 * n + 1], corners[3 * n + 2]);
+    }
+    return grid;
+}
+
+size_t VoxelOctree::memoryBytes() const
+{
+    return mNodes.capacity() * sizeof(Node) + mLevelStart.capacity() * sizeof(size_t) + mTriangleStart.capacity() * sizeof(size_t) + mTriangles.capacity() * sizeof(int);
+}
+
+size_t VoxelOctree::cellNumber(size_t i, size_t j, size_t k) const
+{
+    if (mNodes.empty() || i >= mSize[0] || j >= mSize[1] || k >= mSize[2])
+    {
+        return mCellCount;
+    }
+    size_t node = 0;
+    for (int level = 0; level < mDepth; level++)
+    {
+        int shift = mDepth - 1 - level;
+        int octant = int((i >> shift) & 1) | int(((j >> shift) & 1) << 1) | int(((k >> shift) & 1) << 2);
+        unsigned char mask = mNodes[node].childMask;
+        if (!(mask & (1 << octant)))
+        {
+            return mCellCount;
+        }
+        node = mNodes[node].firstChild + octantsBelow(mask, octant);
+    }
+    return node;
+}
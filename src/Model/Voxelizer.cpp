@@ -1,231 +1,988 @@
 #include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <iterator>
 #include <limits>
+#include <new>
 #include <cmath>
 #include "Model/Voxelizer.h" // Including header file for Voxelizer class
 #include "Model/STLReader.h" // Including header file for STLReader class
 #include "Model/GeomContainer.h" // Including header file for GeomContainer class
+#include "Model/ThreadPool.h" // Including header file for ThreadPool class
+#include "Model/VoxelChunks.h" // Including header file for the VoxelChunks functions
+#include "Model/VoxelFiller.h" // Including header file for VoxelFiller class
+#include "Model/VoxelFile.h" // Including header file for VoxelFileReader and VoxelFileWriter classes
 
-Voxelizer::Voxelizer(std::string fileName, int inVoxelSize) : mVoxelSize(inVoxelSize)
+Voxelizer::Voxelizer(std::string fileName, double inVoxelSize, const VoxelizerOptions& inOptions) : mVoxelSize(inVoxelSize), mOptions(inOptions), mHasGeometry(false), mTriangleSetupSize(0.0)
 {
     // Call makeCubes to process the STL file and create cubes
     makeCubes(fileName);
 }
 
+Voxelizer::Voxelizer(double inVoxelSize, const VoxelizerOptions& inOptions) : mVoxelSize(inVoxelSize), mOptions(inOptions), mHasGeometry(false), mTriangleSetupSize(0.0)
+{
+}
+
 Voxelizer::~Voxelizer()
 {
     // Destructor
 }
 
-Voxelizer* Voxelizer::getVoxelizer(std::string fileName, int voxelSize)
+Voxelizer::Ptr Voxelizer::getVoxelizer(std::string fileName, double voxelSize, const VoxelizerOptions& options)
 {
     // Factory method to create a Voxelizer instance
-    Voxelizer* voxelizer = new Voxelizer(fileName, voxelSize);
+    return Ptr(new Voxelizer(fileName, voxelSize, options));
+}
+
+Voxelizer::Ptr Voxelizer::loadVoxelizer(std::string voxelFileName, const VoxelizerOptions& options)
+{
+    IOOperation::VoxelFileReader reader;
+    if (!reader.open(voxelFileName)) {
+        return nullptr;
+    }
+    const IOOperation::VoxelFileHeader& header = reader.header();
+    Ptr voxelizer(new Voxelizer(header.voxelSize, options));
+    if ((header.flags & IOOperation::voxelFileSolid) != 0) {
+        voxelizer->mOptions.fill = VoxelizerOptions::Fill::Solid;
+    }
+
+    // The same lattice gridSteps lays from the mesh bounds. A damaged header can still claim more cells than
+    // fit in memory, which fails the load rather than the caller.
+    try {
+        voxelizer->mGridX = latticeSteps(header.origin[0], header.size[0], header.voxelSize);
+        voxelizer->mGridY = latticeSteps(header.origin[1], header.size[1], header.voxelSize);
+        voxelizer->mGridZ = latticeSteps(header.origin[2], header.size[2], header.voxelSize);
+        if (!reader.readGrid(voxelizer->mGrid, options.threadCount, options.storage)) {
+            return nullptr;
+        }
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
     return voxelizer;
 }
 
-std::vector<float> Voxelizer::vertices() const
+bool Voxelizer::saveVoxels(const std::string& voxelFileName) const
+{
+    IOOperation::VoxelFileWriter writer;
+    const double origin[3] = { mGridX.empty() ? 0.0 : mGridX.front(), mGridY.empty() ? 0.0 : mGridY.front(), mGridZ.empty() ? 0.0 : mGridZ.front() };
+    unsigned int flags = mOptions.fill == VoxelizerOptions::Fill::Solid ? IOOperation::voxelFileSolid : 0;
+    if (!writer.open(voxelFileName, mGrid.sizeX(), mGrid.sizeY(), mGrid.sizeZ(), origin, mVoxelSize, flags)) {
+        return false;
+    }
+    writer.writeGrid(mGrid);
+    return writer.close();
+}
+
+void Voxelizer::release(Voxelizer* voxelizer)
+{
+    delete voxelizer;
+}
+
+const std::vector<float>& Voxelizer::vertices() const
 {
     // Getter method for the vertices
-    return mVertices;
+    if (!mHasGeometry) {
+        makeGeometry();
+    }
+    return *mGeometry.vertices;
 }
 
-std::vector<float> Voxelizer::colors() const
+const std::vector<float>& Voxelizer::colors() const
 {
     // Getter method for the colors
     return mColors;
 }
 
-std::vector<float> Voxelizer::normals() const
+const std::vector<unsigned short>& Voxelizer::instances() const
 {
-    // Getter method for the colors
+    // Getter method for the cell indices
+    if (!mHasGeometry) {
+        makeGeometry();
+    }
+    return *mGeometry.cells;
+}
+
+VoxelGeometry Voxelizer::geometry() const
+{
+    // The buffers are shared, not copied
+    if (!mHasGeometry) {
+        makeGeometry();
+    }
+    return mGeometry;
+}
+
+const std::vector<float>& Voxelizer::normals() const
+{
+    // Getter method for the normals
     return mNormals;
 }
 
+const Mesh& Voxelizer::mesh() const
+{
+    // Getter method for the mesh
+    return mMesh;
+}
+
+const VoxelGrid& Voxelizer::grid() const
+{
+    // Getter method for the occupied cells
+    return mGrid;
+}
+
+Point3D Voxelizer::cellCorner(size_t i, size_t j, size_t k) const
+{
+    return Point3D(mGridX[i], mGridY[j], mGridZ[k]);
+}
+
+bool Voxelizer::refine()
+{
+    if (mMesh.empty() || cancelled()) {
+        return false;
+    }
+    ThreadPool pool(mOptions.threadCount);
+    if (mSurfaceCells.size() != mGrid.sizeX()) {
+        collectSurfaceCells(pool);
+    }
+    RunArena arena(pool.threadCount());
+
+    // The finer lattice starts at the same corner, and its corner 2i is computed from the same product as coarse
+    // corner i, so every fine cell lies exactly in the coarse cell i / 2, j / 2, k / 2
+    double fineSize = mVoxelSize / 2;
+    Point3D minCorner(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    Point3D maxCorner(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    mMesh.bounds(minCorner, maxCorner);
+    std::vector<float> fineX = gridSteps(minCorner.x(), maxCorner.x(), fineSize);
+    std::vector<float> fineY = gridSteps(minCorner.y(), maxCorner.y(), fineSize);
+    std::vector<float> fineZ = gridSteps(minCorner.z(), maxCorner.z(), fineSize);
+
+    // A fine cell is only tested against the triangles whose fine cell range holds it, as in a run at the finer size
+    std::pmr::vector<CellRange> ranges(mMesh.triangleCount(), arena.shared());
+    const size_t chunkSize = 4096;
+    pool.run((ranges.size() + chunkSize - 1) / chunkSize, [&](size_t chunk, int) {
+        size_t end = std::min(ranges.size(), (chunk + 1) * chunkSize);
+        for (size_t t = chunk * chunkSize; t < end; t++) {
+            ranges[t] = cellRange(mMesh.corner(t, 0), mMesh.corner(t, 1), mMesh.corner(t, 2), fineX, fineY, fineZ, fineSize);
+        }
+    });
+
+    // The coarse grid becomes the previous level
+    mLevels.push_back(mGrid);
+    mLevelSizes.push_back(mVoxelSize);
+    mGrid.reset(fineX.size(), fineY.size(), fineZ.size(), mOptions.storage);
+    std::vector<LayerCells> fineCells(fineX.size());
+
+    // Coarse layer i is split into the fine layers 2i and 2i + 1, which no other task writes
+    struct Split
+    {
+        explicit Split(std::pmr::memory_resource* memory) : hits{ std::pmr::vector<std::pair<size_t, int>>(memory), std::pmr::vector<std::pair<size_t, int>>(memory) }, pairs(memory), layer(memory) {
+        }
+
+        std::pmr::vector<std::pair<size_t, int>> hits[2]; // Fine cell and triangle of each fine layer
+        std::pmr::vector<std::pair<int, size_t>> pairs; // Triangle and coarse cell of every surface cell of the layer
+        std::pmr::vector<unsigned long long> layer;
+        float minX[8], minY[8], minZ[8];
+        size_t cells[8];
+        int layers[8];
+        unsigned char touched[8];
+        unsigned char near[8];
+    };
+    std::vector<Split> splits;
+    for (int worker = 0; worker < arena.workerCount(); worker++) {
+        splits.emplace_back(arena.worker(worker));
+    }
+    const float fineHalf = static_cast<float>(fineSize * 0.5);
+    const Vec3f fineExtent = { fineHalf, fineHalf, fineHalf };
+    const Vec3f fineNearExtent = listedExtent(fineSize);
+    size_t coarseZ = mGridZ.size();
+    size_t coarseLayers = mGridX.size();
+    std::atomic<size_t> layersDone(0);
+    pool.run(coarseLayers, [&](size_t i, int worker) {
+        if (cancelled()) {
+            return;
+        }
+        Split& split = splits[worker];
+        split.hits[0].clear();
+        split.hits[1].clear();
+        // Triangle by triangle, so each is set up once for all the coarse cells of the layer it touched
+        // Every listed triangle, also those only near the coarse cell, since rounding at the coarse size may have
+        // missed one that touches a fine cell
+        const LayerCells& coarse = mSurfaceCells[i];
+        split.pairs.clear();
+        for (size_t n = 0; n < coarse.cells.size(); n++) {
+            for (size_t t = coarse.start[n]; t < coarse.start[n + 1]; t++) {
+                int triangle = coarse.triangles[t];
+                split.pairs.push_back({ triangle < 0 ? ~triangle : triangle, coarse.cells[n] });
+            }
+        }
+        std::sort(split.pairs.begin(), split.pairs.end());
+        SatKernel::TriangleSetup setup;
+        SatKernel::TriangleSetup nearSetup;
+        for (size_t p = 0; p < split.pairs.size(); p++) {
+            int triangle = split.pairs[p].first;
+            if (p == 0 || triangle != split.pairs[p - 1].first) {
+                const Vec3f p1 = toVec3f(mMesh.cornerPosition(triangle, 0));
+                const Vec3f p2 = toVec3f(mMesh.cornerPosition(triangle, 1));
+                const Vec3f p3 = toVec3f(mMesh.cornerPosition(triangle, 2));
+                setup = SatKernel::setupTriangle(p1, p2, p3, fineExtent);
+                nearSetup = SatKernel::setupTriangle(p1, p2, p3, fineNearExtent);
+            }
+
+            // The children of the coarse cell inside the triangle's fine cell range
+            size_t j = split.pairs[p].second / coarseZ;
+            size_t k = split.pairs[p].second % coarseZ;
+            const CellRange& range = ranges[triangle];
+            size_t count = 0;
+            for (size_t fi = std::max(2 * i, range.first[0]); fi < std::min(2 * i + 2, range.last[0]); fi++) {
+                for (size_t fj = std::max(2 * j, range.first[1]); fj < std::min(2 * j + 2, range.last[1]); fj++) {
+                    for (size_t fk = std::max(2 * k, range.first[2]); fk < std::min(2 * k + 2, range.last[2]); fk++) {
+                        split.minX[count] = fineX[fi];
+                        split.minY[count] = fineY[fj];
+                        split.minZ[count] = fineZ[fk];
+                        split.layers[count] = static_cast<int>(fi - 2 * i);
+                        split.cells[count] = fj * fineZ.size() + fk;
+                        count++;
+                    }
+                }
+            }
+            if (count == 0) {
+                continue;
+            }
+            SatKernel::triangleIntersectsBoxes(setup, split.minX, split.minY, split.minZ, count, fineSize, split.touched, mOptions.vectorize);
+            SatKernel::triangleIntersectsBoxes(nearSetup, split.minX, split.minY, split.minZ, count, fineSize, split.near, mOptions.vectorize);
+            for (size_t c = 0; c < count; c++) {
+                if (split.near[c]) {
+                    split.hits[split.layers[c]].push_back({ split.cells[c], split.touched[c] ? triangle : ~triangle });
+                }
+            }
+        }
+
+        for (size_t half = 0; half < 2 && 2 * i + half < fineX.size(); half++) {
+            LayerCells& fine = fineCells[2 * i + half];
+            split.layer.assign(mGrid.layerWords(), 0);
+            for (const std::pair<size_t, int>& hit : split.hits[half]) {
+                if (hit.second >= 0) {
+                    split.layer[hit.first / 64] |= 1ULL << (hit.first % 64);
+                }
+            }
+            fine.assign(split.hits[half]);
+            mGrid.setLayer(2 * i + half, split.layer.data());
+        }
+
+        size_t done = ++layersDone;
+        if (mOptions.progress && done * 100 / coarseLayers != (done - 1) * 100 / coarseLayers) {
+            mOptions.progress(double(done) / coarseLayers);
+        }
+    });
+
+    // A cancelled split leaves the fine level unfinished, so the coarse one comes back and can be refined later
+    if (cancelled()) {
+        mGrid = mLevels.back();
+        mLevels.pop_back();
+        mLevelSizes.pop_back();
+        return false;
+    }
+    mVoxelSize = fineSize;
+    mGridX.swap(fineX);
+    mGridY.swap(fineY);
+    mGridZ.swap(fineZ);
+    mSurfaceCells.swap(fineCells);
+    clearGeometry();
+    if (mOptions.fill == VoxelizerOptions::Fill::Solid) {
+        VoxelFiller filler(mMesh, mGridX, mGridY, mGridZ, mVoxelSize, mOptions.threadCount);
+        filler.fill(mGrid);
+    }
+    return true;
+}
+
+size_t Voxelizer::levelCount() const
+{
+    return mLevels.size() + 1;
+}
+
+const VoxelGrid& Voxelizer::level(size_t index) const
+{
+    return index < mLevels.size() ? mLevels[index] : mGrid;
+}
+
+double Voxelizer::levelVoxelSize(size_t index) const
+{
+    return index < mLevelSizes.size() ? mLevelSizes[index] : mVoxelSize;
+}
+
+VoxelOctree Voxelizer::octree(bool withTriangles)
+{
+    Point3D origin = mGrid.sizeX() > 0 ? cellCorner(0, 0, 0) : Point3D();
+    if (!withTriangles || mMesh.empty()) {
+        return VoxelOctree(mGrid, origin, mVoxelSize, mOptions.threadCount);
+    }
+    if (mSurfaceCells.size() != mGrid.sizeX()) {
+        ThreadPool pool(mOptions.threadCount);
+        collectSurfaceCells(pool);
+    }
+    return VoxelOctree(mGrid, origin, mVoxelSize, mOptions.threadCount, [this](size_t i, size_t j, size_t k, std::vector<int>& triangles) {
+        const LayerCells& layer = mSurfaceCells[i];
+        size_t cell = cellIndex(j, k);
+        auto found = std::lower_bound(layer.cells.begin(), layer.cells.end(), cell);
+        if (found != layer.cells.end() && *found == cell) {
+            size_t n = found - layer.cells.begin();
+            std::copy_if(layer.triangles.begin() + layer.start[n], layer.triangles.begin() + layer.start[n + 1], std::back_inserter(triangles), [](int triangle) {
+                return triangle >= 0;
+            });
+        }
+    });
+}
+
+Voxelizer::Ptr Voxelizer::snapshot() const
+{
+    if (!mHasGeometry) {
+        makeGeometry();
+    }
+    VoxelizerOptions options = mOptions;
+    options.progress = nullptr;
+    options.cancel = nullptr;
+    Ptr copy(new Voxelizer(mVoxelSize, options));
+    copy->mGridX = mGridX;
+    copy->mGridY = mGridY;
+    copy->mGridZ = mGridZ;
+    copy->mGrid = mGrid;
+    // The geometry never changes once built, so the copy shares it
+    copy->mGeometry = mGeometry;
+    copy->mMeshStats = mMeshStats;
+    copy->mHasGeometry = true;
+    return copy;
+}
+
+void Voxelizer::freeze()
+{
+    if (!mHasGeometry) {
+        makeGeometry();
+    }
+    mMesh = Mesh();
+    mTriangleGrid = TriangleGrid();
+    mTriangleSetups = std::vector<SatKernel::TriangleSetup, CacheLineAllocator<SatKernel::TriangleSetup>>();
+    mTriangleSetupSize = 0.0;
+    mScratch = Scratch();
+    mSurfaceCells = std::vector<LayerCells>();
+    mOptions.progress = nullptr;
+    mOptions.cancel = nullptr;
+}
+
+size_t Voxelizer::memoryBytes() const
+{
+    size_t bytes = mMesh.memoryBytes() + mGrid.memoryBytes() + (mColors.capacity() + mNormals.capacity()) * sizeof(float);
+    for (const VoxelGeometry* geometry = &mGeometry; geometry != nullptr; geometry = geometry->coarse.get()) {
+        bytes += geometry->vertices ? geometry->vertices->capacity() * sizeof(float) : 0;
+        bytes += geometry->cells ? geometry->cells->capacity() * sizeof(unsigned short) : 0;
+        bytes += geometry->chunks ? geometry->chunks->capacity() * sizeof(VoxelChunk) : 0;
+    }
+    for (const VoxelGrid& level : mLevels) {
+        bytes += level.memoryBytes();
+    }
+    for (const LayerCells& layer : mSurfaceCells) {
+        bytes += (layer.cells.capacity() + layer.start.capacity()) * sizeof(size_t) + layer.triangles.capacity() * sizeof(int);
+    }
+    return bytes;
+}
+
+VoxelMeshStats Voxelizer::meshStats() const
+{
+    return mMeshStats;
+}
+
+bool Voxelizer::cancelled() const
+{
+    return mOptions.cancel != nullptr && mOptions.cancel->load(std::memory_order_relaxed);
+}
+
 /// <summary>
 /// 3D Grid for Voxels
 /// </summary>
-/// <param name="vertices"></param>
-void Voxelizer::createBoundingBoxGrid(const std::vector<Point3D>& vertices) {
+/// <param name="mesh"></param>
+void Voxelizer::createBoundingBoxGrid(const Mesh& mesh) {
     // Determine the bounding box of the mesh
     Point3D minCorner(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
     Point3D maxCorner(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    mesh.bounds(minCorner, maxCorner);
+
+    // Create the 3D grid based on the bounding box and voxel size
+    mGridX = gridSteps(minCorner.x(), maxCorner.x(), mVoxelSize);
+    mGridY = gridSteps(minCorner.y(), maxCorner.y(), mVoxelSize);
+    mGridZ = gridSteps(minCorner.z(), maxCorner.z(), mVoxelSize);
+
+    // Layers are marked concurrently, each into a bitset of its worker, and then stored in the grid
+    mGrid.reset(mGridX.size(), mGridY.size(), mGridZ.size(), mOptions.storage);
+    mSurfaceCells.clear();
+    clearGeometry();
+
+    ThreadPool pool(mOptions.threadCount);
+    RunArena arena(pool.threadCount());
+
+    // For the triangle-driven traversal, list the triangles overlapping each layer
+    std::pmr::vector<CellRange> ranges(arena.shared());
+    std::pmr::vector<size_t> layerStart(arena.shared());
+    std::pmr::vector<int> layerTriangles(arena.shared());
+    if (mOptions.traversal == VoxelizerOptions::Traversal::TriangleDriven) {
+        listLayerTriangles(pool, ranges, layerStart, layerTriangles);
+    }
+    else if (mTriangleSetupSize != mVoxelSize) {
+        makeTriangles();
+    }
+
+    std::vector<Scratch> scratch = workerScratch(arena);
+    std::atomic<size_t> layersDone(0);
+    pool.run(mGridX.size(), [&](size_t i, int worker) {
+        if (cancelled()) {
+            return;
+        }
+        scratch[worker].layer.assign(mGrid.layerWords(), 0);
+        if (mOptions.traversal == VoxelizerOptions::Traversal::TriangleDriven) {
+            markTriangleDriven(i, layerTriangles.data() + layerStart[i], layerStart[i + 1] - layerStart[i], ranges, scratch[worker]);
+        }
+        else {
+            markCellDriven(i, scratch[worker]);
+        }
+        mGrid.setLayer(i, scratch[worker].layer.data());
 
-    for (const auto& vertex : vertices) {
-        minCorner.setX(std::min(minCorner.x(), vertex.x()));
-        minCorner.setY(std::min(minCorner.y(), vertex.y()));
-        minCorner.setZ(std::min(minCorner.z(), vertex.z()));
+        // Report whenever another percent of the layers is done
+        size_t done = ++layersDone;
+        if (mOptions.progress && done * 100 / mGridX.size() != (done - 1) * 100 / mGridX.size()) {
+            mOptions.progress(double(done) / mGridX.size());
+        }
+    });
 
-        maxCorner.setX(std::max(maxCorner.x(), vertex.x()));
-        maxCorner.setY(std::max(maxCorner.y(), vertex.y()));
-        maxCorner.setZ(std::max(maxCorner.z(), vertex.z()));
+    // Fill the inside of the surface shell by ray parity, without any further triangle tests per cell
+    if (mOptions.fill == VoxelizerOptions::Fill::Solid && !cancelled()) {
+        VoxelFiller filler(mMesh, mGridX, mGridY, mGridZ, mVoxelSize, mOptions.threadCount);
+        filler.fill(mGrid);
     }
+}
 
-    // Create the 3D grid based on the bounding box and voxel size
-    for (float x = minCorner.x(); x <= maxCorner.x(); x += mVoxelSize) {
-        for (float y = minCorner.y(); y <= maxCorner.y(); y += mVoxelSize) {
-            for (float z = minCorner.z(); z <= maxCorner.z(); z += mVoxelSize) {
-                Point3D voxelCorner(x, y, z);
-                // Check if the voxel intersects with any triangle and store it if it does
-                if (intersectsAnyTriangle(voxelCorner)) {
-                    addCube(voxelCorner, mVoxelSize);
+void Voxelizer::listLayerTriangles(ThreadPool& pool, std::pmr::vector<CellRange>& ranges, std::pmr::vector<size_t>& layerStart, std::pmr::vector<int>& layerTriangles) const {
+    ranges.resize(mMesh.triangleCount());
+    const size_t chunkSize = 4096;
+    pool.run((ranges.size() + chunkSize - 1) / chunkSize, [&](size_t chunk, int) {
+        size_t end = std::min(ranges.size(), (chunk + 1) * chunkSize);
+        for (size_t t = chunk * chunkSize; t < end; t++) {
+            ranges[t] = cellRange(t);
+        }
+    });
+
+    layerStart.assign(mGridX.size() + 1, 0);
+    for (const CellRange& range : ranges) {
+        for (size_t i = range.first[0]; i < range.last[0]; i++) {
+            layerStart[i + 1]++;
+        }
+    }
+    for (size_t i = 1; i < layerStart.size(); i++) {
+        layerStart[i] += layerStart[i - 1];
+    }
+    layerTriangles.resize(layerStart.back());
+    std::pmr::vector<size_t> fill(layerStart.begin(), layerStart.end() - 1, layerStart.get_allocator());
+    for (size_t t = 0; t < ranges.size(); t++) {
+        for (size_t i = ranges[t].first[0]; i < ranges[t].last[0]; i++) {
+            layerTriangles[fill[i]++] = static_cast<int>(t);
+        }
+    }
+}
+
+void Voxelizer::collectSurfaceCells(ThreadPool& pool) {
+    // The same traversal as a triangle-driven run, keeping which triangles touched each cell
+    RunArena arena(pool.threadCount());
+    std::pmr::vector<CellRange> ranges(arena.shared());
+    std::pmr::vector<size_t> layerStart(arena.shared());
+    std::pmr::vector<int> layerTriangles(arena.shared());
+    listLayerTriangles(pool, ranges, layerStart, layerTriangles);
+
+    mSurfaceCells.assign(mGridX.size(), LayerCells());
+    std::vector<Scratch> scratch = workerScratch(arena);
+    std::vector<std::pmr::vector<std::pair<size_t, int>>> hits;
+    for (int worker = 0; worker < arena.workerCount(); worker++) {
+        hits.emplace_back(arena.worker(worker));
+    }
+    // Once per run, as it walks every vertex of the mesh
+    const Vec3f nearExtent = listedExtent(mVoxelSize);
+    pool.run(mGridX.size(), [&](size_t i, int worker) {
+        scratch[worker].layer.assign(mGrid.layerWords(), 0);
+        hits[worker].clear();
+        markTriangleDriven(i, layerTriangles.data() + layerStart[i], layerStart[i + 1] - layerStart[i], ranges, scratch[worker], &hits[worker], nearExtent);
+        mSurfaceCells[i].assign(hits[worker]);
+    });
+}
+
+Vec3f Voxelizer::listedExtent(double voxelSize) const {
+    // The tests round coordinates of the size of the mesh's farthest corner from the origin and offsets of the
+    // size of a triangle, to about 1e-7 of each
+    Point3D minCorner(0.0, 0.0, 0.0);
+    Point3D maxCorner(0.0, 0.0, 0.0);
+    mMesh.bounds(minCorner, maxCorner);
+    double scale = std::max({ std::fabs(minCorner.x()), std::fabs(minCorner.y()), std::fabs(minCorner.z()), std::fabs(maxCorner.x()), std::fabs(maxCorner.y()), std::fabs(maxCorner.z()) });
+    float half = static_cast<float>(voxelSize * 0.5 + 1e-5 * (2 * scale + voxelSize));
+    return { half, half, half };
+}
+
+void Voxelizer::LayerCells::assign(std::pmr::vector<std::pair<size_t, int>>& hits) {
+    std::sort(hits.begin(), hits.end());
+    cells.clear();
+    start.clear();
+    triangles.resize(hits.size());
+    for (size_t n = 0; n < hits.size(); n++) {
+        if (n == 0 || hits[n].first != hits[n - 1].first) {
+            cells.push_back(hits[n].first);
+            start.push_back(n);
+        }
+        triangles[n] = hits[n].second;
+    }
+    start.push_back(hits.size());
+}
+
+void Voxelizer::makeGeometry() const {
+    Point3D origin = mGrid.sizeX() > 0 ? cellCorner(0, 0, 0) : Point3D();
+    mGeometry = buildGeometry(mGrid, origin, mVoxelSize, mMeshStats);
+
+    // The coarse level is only drawn, so its counts are not kept
+    if (mOptions.coarseLevel && mGrid.count() > 0) {
+        ThreadPool pool(mOptions.threadCount);
+        VoxelMeshStats coarseStats;
+        mGeometry.coarse = std::make_shared<const VoxelGeometry>(buildGeometry(downsampledGrid(pool), origin, 2 * mVoxelSize, coarseStats));
+    }
+    mHasGeometry = true;
+}
+
+void Voxelizer::clearGeometry() {
+    mGeometry = VoxelGeometry();
+    mHasGeometry = false;
+}
+
+VoxelGeometry Voxelizer::buildGeometry(const VoxelGrid& grid, const Point3D& origin, double voxelSize, VoxelMeshStats& stats) const {
+    // Built into local buffers, grouped into chunks in place and then handed over whole, so snapshots and
+    // geometry() share them without copying
+    std::vector<float> vertices;
+    std::vector<unsigned short> cells;
+    std::vector<VoxelChunk> chunks;
+    bool fitsInstances = grid.sizeX() <= instanceAxisLimit && grid.sizeY() <= instanceAxisLimit && grid.sizeZ() <= instanceAxisLimit;
+    if (mOptions.meshing == VoxelizerOptions::Meshing::Instances && fitsInstances) {
+        stats = makeInstanceGeometry(grid, cells);
+        chunks = VoxelChunks::groupCells(cells, origin, voxelSize, mOptions.threadCount);
+    }
+    else {
+        // The quads sit on the cell lattice itself, so faces of neighbouring cells line up exactly
+        std::vector<float> planesX = latticeSteps(origin.x(), grid.sizeX() + 1, voxelSize);
+        std::vector<float> planesY = latticeSteps(origin.y(), grid.sizeY() + 1, voxelSize);
+        std::vector<float> planesZ = latticeSteps(origin.z(), grid.sizeZ() + 1, voxelSize);
+        if (mOptions.meshing == VoxelizerOptions::Meshing::Cubes) {
+            stats = makeCubeGeometry(grid, planesX, planesY, planesZ, vertices);
+        }
+        else {
+            VoxelMesher mesher(grid, planesX, planesY, planesZ, mOptions.threadCount);
+            stats = mesher.mesh(mOptions.meshing == VoxelizerOptions::Meshing::CulledFaces ? VoxelMesher::Mode::CulledFaces : VoxelMesher::Mode::Greedy, vertices);
+        }
+        chunks = VoxelChunks::groupQuads(vertices, origin, voxelSize, mOptions.threadCount);
+    }
+    stats.bytes = vertices.size() * sizeof(float) + cells.size() * sizeof(unsigned short);
+
+    VoxelGeometry geometry;
+    geometry.vertices = std::make_shared<const std::vector<float>>(std::move(vertices));
+    geometry.cells = std::make_shared<const std::vector<unsigned short>>(std::move(cells));
+    geometry.chunks = std::make_shared<const std::vector<VoxelChunk>>(std::move(chunks));
+    geometry.origin = origin;
+    geometry.voxelSize = voxelSize;
+    return geometry;
+}
+
+VoxelGrid Voxelizer::downsampledGrid(ThreadPool& pool) const {
+    // Cell (i, j, k) of the coarse grid is occupied when any of the cells 2i..2i+1, 2j..2j+1, 2k..2k+1 is
+    VoxelGrid coarse((mGrid.sizeX() + 1) / 2, (mGrid.sizeY() + 1) / 2, (mGrid.sizeZ() + 1) / 2, mOptions.storage);
+    struct Layers
+    {
+        std::vector<unsigned long long> fine[2];
+        std::vector<unsigned long long> coarse;
+    };
+    std::vector<Layers> layers(pool.threadCount());
+    pool.run(coarse.sizeX(), [&](size_t i, int worker) {
+        Layers& layer = layers[worker];
+        layer.coarse.assign(coarse.layerWords(), 0);
+        for (size_t half = 0; half < 2 && 2 * i + half < mGrid.sizeX(); half++) {
+            std::vector<unsigned long long>& fine = layer.fine[half];
+            fine.resize(mGrid.layerWords());
+            mGrid.getLayer(2 * i + half, fine.data());
+            for (size_t word = 0; word < fine.size(); word++) {
+                if (fine[word] == 0) {
+                    continue;
+                }
+                for (size_t bit = 0; bit < 64; bit++) {
+                    if (fine[word] & (1ULL << bit)) {
+                        size_t cell = word * 64 + bit;
+                        size_t coarseCell = (cell / mGrid.sizeZ() / 2) * coarse.sizeZ() + (cell % mGrid.sizeZ()) / 2;
+                        layer.coarse[coarseCell / 64] |= 1ULL << (coarseCell % 64);
+                    }
                 }
             }
         }
+        coarse.setLayer(i, layer.coarse.data());
+    });
+    return coarse;
+}
+
+std::vector<size_t> Voxelizer::layerOffsets(ThreadPool& pool, const VoxelGrid& grid, size_t valuesPerCell) const {
+    std::vector<size_t> offsets(grid.sizeX() + 1, 0);
+    std::vector<std::vector<unsigned long long>> layers(pool.threadCount());
+    pool.run(grid.sizeX(), [&](size_t i, int worker) {
+        std::vector<unsigned long long>& layer = layers[worker];
+        layer.resize(grid.layerWords());
+        grid.getLayer(i, layer.data());
+        size_t count = 0;
+        for (unsigned long long word : layer) {
+            count += std::bitset<64>(word).count();
+        }
+        offsets[i + 1] = count * valuesPerCell;
+    });
+    for (size_t i = 0; i < grid.sizeX(); i++) {
+        offsets[i + 1] += offsets[i];
     }
+    return offsets;
 }
 
-bool Voxelizer::intersectsAnyTriangle(const Point3D& voxelCorner) {
-    // Iterate through the triangles and check for intersection
-    for (int i = 0; i < mV.size(); i += 3) {
-        Point3D point1 = mV[i];
-        Point3D point2 = mV[static_cast<std::vector<Point3D, std::allocator<Point3D>>::size_type>(i) + 1];
-        Point3D point3 = mV[static_cast<std::vector<Point3D, std::allocator<Point3D>>::size_type>(i) + 2];
+VoxelMeshStats Voxelizer::makeInstanceGeometry(const VoxelGrid& grid, std::vector<unsigned short>& cells) const {
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(mOptions.threadCount);
+
+    // Each layer lists its cells, in y, z order, straight into its own range of the result
+    std::vector<size_t> offsets = layerOffsets(pool, grid, 4);
+    cells.resize(offsets.back());
+    std::vector<std::vector<unsigned long long>> layers(pool.threadCount());
+    pool.run(grid.sizeX(), [&](size_t i, int worker) {
+        std::vector<unsigned long long>& layer = layers[worker];
+        layer.resize(grid.layerWords());
+        grid.getLayer(i, layer.data());
+        unsigned short* out = cells.data() + offsets[i];
+        for (size_t word = 0; word < layer.size(); word++) {
+            if (layer[word] == 0) {
+                continue;
+            }
+            for (size_t bit = 0; bit < 64; bit++) {
+                if (layer[word] & (1ULL << bit)) {
+                    size_t cell = word * 64 + bit;
+                    *out++ = static_cast<unsigned short>(i);
+                    *out++ = static_cast<unsigned short>(cell / grid.sizeZ());
+                    *out++ = static_cast<unsigned short>(cell % grid.sizeZ());
+                    *out++ = 0;
+                }
+            }
+        }
+    });
+
+    // Every cell is still drawn as a whole cube; the saving is in the bytes handed over
+    VoxelMeshStats stats;
+    stats.voxelCount = grid.count();
+    stats.cubeVertexCount = 24 * stats.voxelCount;
+    stats.vertexCount = stats.cubeVertexCount;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
 
-        if (triangleIntersectsVoxel(voxelCorner, point1, point2, point3, mVoxelSize)) {
-            return true;
+VoxelMeshStats Voxelizer::makeCubeGeometry(const VoxelGrid& grid, const std::vector<float>& planesX, const std::vector<float>& planesY, const std::vector<float>& planesZ, std::vector<float>& vertices) const {
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(mOptions.threadCount);
+
+    // Each layer writes its cubes, in y, z order, straight into its own range of the result, so the quads
+    // are never held twice. The cubes span lattice planes, so neighbouring cubes share their faces exactly.
+    std::vector<size_t> offsets = layerOffsets(pool, grid, 72);
+    vertices.resize(offsets.back());
+    std::vector<std::vector<unsigned long long>> layers(pool.threadCount());
+    std::vector<std::vector<float>> cubes(pool.threadCount());
+    pool.run(grid.sizeX(), [&](size_t i, int worker) {
+        std::vector<unsigned long long>& layer = layers[worker];
+        std::vector<float>& cube = cubes[worker];
+        layer.resize(grid.layerWords());
+        grid.getLayer(i, layer.data());
+        size_t offset = offsets[i];
+        for (size_t word = 0; word < layer.size(); word++) {
+            if (layer[word] == 0) {
+                continue;
+            }
+            for (size_t bit = 0; bit < 64; bit++) {
+                if (layer[word] & (1ULL << bit)) {
+                    size_t cell = word * 64 + bit;
+                    size_t j = cell / grid.sizeZ();
+                    size_t k = cell % grid.sizeZ();
+                    cube.clear();
+                    addCube(Point3D(planesX[i], planesY[j], planesZ[k]), Point3D(planesX[i + 1], planesY[j + 1], planesZ[k + 1]), cube);
+                    std::copy(cube.begin(), cube.end(), vertices.begin() + offset);
+                    offset += cube.size();
+                }
+            }
         }
+    });
+
+    VoxelMeshStats stats;
+    stats.voxelCount = grid.count();
+    stats.cubeVertexCount = 24 * stats.voxelCount;
+    stats.vertexCount = vertices.size() / 3;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+std::vector<float> Voxelizer::gridSteps(double min, double max, double voxelSize) {
+    // The last lattice point not beyond max; the quotient may round either way, so settle it on the products
+    size_t last = static_cast<size_t>(std::max(0.0, std::floor((max - min) / voxelSize)));
+    while (min + (last + 1) * voxelSize <= max) {
+        last++;
+    }
+    while (last > 0 && min + last * voxelSize > max) {
+        last--;
     }
-    return false;
+    return max < min ? std::vector<float>() : latticeSteps(min, last + 1, voxelSize);
 }
 
-bool Voxelizer::triangleIntersectsVoxel(const Point3D& voxelCorner, const Point3D& p1, const Point3D& p2, const Point3D& p3, int voxelSize) {
-    // Implement a robust triangle-voxel intersection test
-    // For simplicity, this example assumes AABB (Axis-Aligned Bounding Box) check
-    Point3D voxelMax = voxelCorner + Point3D(voxelSize, voxelSize, voxelSize);
+std::vector<float> Voxelizer::latticeSteps(double origin, size_t count, double voxelSize) {
+    std::vector<float> steps(count);
+    for (size_t n = 0; n < count; n++) {
+        steps[n] = static_cast<float>(origin + n * voxelSize);
+    }
+    return steps;
+}
 
-    // Perform AABB-Triangle intersection check
-    return aabbIntersectsTriangle(voxelCorner, voxelMax, p1, p2, p3);
+size_t Voxelizer::cellIndex(size_t j, size_t k) const {
+    return j * mGridZ.size() + k;
 }
 
-bool Voxelizer::aabbIntersectsTriangle(const Point3D& min, const Point3D& max, const Point3D& p1, const Point3D& p2, const Point3D& p3) {
-    // Compute AABB center and extents
-    Point3D c = (min + max) * 0.5f;
-    Point3D e = (max - min) * 0.5f;
-
-    // Translate triangle to origin
-    Point3D v0 = p1 - c;
-    Point3D v1 = p2 - c;
-    Point3D v2 = p3 - c;
-
-    // Compute edge vectors for the triangle
-    Point3D f0 = v1 - v0;
-    Point3D f1 = v2 - v1;
-    Point3D f2 = v0 - v2;
-
-    // Compute face normals for AABB
-    Point3D u0(1, 0, 0);
-    Point3D u1(0, 1, 0);
-    Point3D u2(0, 0, 1);
-
-    // Test axes a00..a22 (9 tests)
-    Point3D axes[9] = {
-        Point3D(0, -f0.z(), f0.y()),
-        Point3D(0, -f1.z(), f1.y()),
-        Point3D(0, -f2.z(), f2.y()),
-        Point3D(f0.z(), 0, -f0.x()),
-        Point3D(f1.z(), 0, -f1.x()),
-        Point3D(f2.z(), 0, -f2.x()),
-        Point3D(-f0.y(), f0.x(), 0),
-        Point3D(-f1.y(), f1.x(), 0),
-        Point3D(-f2.y(), f2.x(), 0)
-    };
+Voxelizer::CellRange Voxelizer::cellRange(size_t triangle) const {
+    return cellRange(mMesh.corner(triangle, 0), mMesh.corner(triangle, 1), mMesh.corner(triangle, 2), mGridX, mGridY, mGridZ, mVoxelSize);
+}
 
-    for (int i = 0; i < 9; i++) {
-        Point3D a = axes[i];
-        float p0 = v0.dot(a);
-        float p1 = v1.dot(a);
-        float p2 = v2.dot(a);
+Voxelizer::CellRange Voxelizer::cellRange(const Point3D& p1, const Point3D& p2, const Point3D& p3, const std::vector<float>& gridX, const std::vector<float>& gridY, const std::vector<float>& gridZ, double voxelSize) {
+    double lower[3] = { std::min({ p1.x(), p2.x(), p3.x() }), std::min({ p1.y(), p2.y(), p3.y() }), std::min({ p1.z(), p2.z(), p3.z() }) };
+    double upper[3] = { std::max({ p1.x(), p2.x(), p3.x() }), std::max({ p1.y(), p2.y(), p3.y() }), std::max({ p1.z(), p2.z(), p3.z() }) };
+
+    // Widen the range slightly so rounding never drops a cell the exact test would accept
+    const std::vector<float>* grids[3] = { &gridX, &gridY, &gridZ };
+    CellRange range;
+    for (int axis = 0; axis < 3; axis++) {
+        double padding = 1e-6 * (1.0 + std::max(std::fabs(lower[axis]), std::fabs(upper[axis])));
+        const std::vector<float>& grid = *grids[axis];
+        range.first[axis] = std::lower_bound(grid.begin(), grid.end(), lower[axis] - padding - voxelSize) - grid.begin();
+        range.last[axis] = std::upper_bound(grid.begin(), grid.end(), upper[axis] + padding) - grid.begin();
+    }
+    // A range that is empty along one axis is empty along x as well, so no layer lists it
+    if (range.first[1] >= range.last[1] || range.first[2] >= range.last[2]) {
+        range.last[0] = range.first[0];
+    }
+    return range;
+}
 
-        float r = e.x() * fabs(a.x()) + e.y() * fabs(a.y()) + e.z() * fabs(a.z());
+Voxelizer::Scratch::Scratch(std::pmr::memory_resource* memory) : candidates(memory), minX(memory), minY(memory), minZ(memory), hits(memory), nearHits(memory), layer(memory) {
+}
 
-        if (std::max({ -p0, -p1, -p2 }) > r || std::min({ -p0, -p1, -p2 }) < -r) return false;
+std::vector<Voxelizer::Scratch> Voxelizer::workerScratch(RunArena& arena) {
+    std::vector<Scratch> scratch;
+    scratch.reserve(arena.workerCount());
+    for (int worker = 0; worker < arena.workerCount(); worker++) {
+        scratch.emplace_back(arena.worker(worker));
     }
+    return scratch;
+}
 
-    // Test face normals of AABB (3 tests)
-    if (std::max({ v0.x(), v1.x(), v2.x() }) < -e.x() || std::min({ v0.x(), v1.x(), v2.x() }) > e.x()) return false;
-    if (std::max({ v0.y(), v1.y(), v2.y() }) < -e.y() || std::min({ v0.y(), v1.y(), v2.y() }) > e.y()) return false;
-    if (std::max({ v0.z(), v1.z(), v2.z() }) < -e.z() || std::min({ v0.z(), v1.z(), v2.z() }) > e.z()) return false;
+void Voxelizer::markCellDriven(size_t i, Scratch& scratch) {
+    // Visit every cell of the layer and test it against the mesh
+    for (size_t j = 0; j < mGridY.size(); j++) {
+        for (size_t k = 0; k < mGridZ.size(); k++) {
+            Point3D voxelCorner(mGridX[i], mGridY[j], mGridZ[k]);
+            // Check if the voxel intersects with any triangle and mark it if it does
+            if (intersectsAnyTriangle(voxelCorner, scratch)) {
+                size_t cell = cellIndex(j, k);
+                scratch.layer[cell / 64] |= 1ULL << (cell % 64);
+            }
+        }
+    }
+}
 
-    // Test face normals of triangle (1 test)
-    Point3D n = f0.cross(f1);
-    float d = -n.dot(v0);
-    float r = e.x() * fabs(n.x()) + e.y() * fabs(n.y()) + e.z() * fabs(n.z());
-    if (fabs(d) > r) return false;
+void Voxelizer::markTriangleDriven(size_t i, const int* triangles, size_t count, const std::pmr::vector<CellRange>& ranges, Scratch& scratch, std::pmr::vector<std::pair<size_t, int>>* hits, Vec3f nearExtent) {
+    // Visit only the cells of the layer overlapping each triangle's bounding box, so the cost follows the surface area.
+    // The triangle is set up once for all the cells it is tested against.
+    const float half = static_cast<float>(mVoxelSize * 0.5);
+    const Vec3f halfExtent = { half, half, half };
+    for (size_t n = 0; n < count; n++) {
+        const CellRange& range = ranges[triangles[n]];
+        const Vec3f p1 = toVec3f(mMesh.cornerPosition(triangles[n], 0));
+        const Vec3f p2 = toVec3f(mMesh.cornerPosition(triangles[n], 1));
+        const Vec3f p3 = toVec3f(mMesh.cornerPosition(triangles[n], 2));
+        SatKernel::TriangleSetup setup = SatKernel::setupTriangle(p1, p2, p3, halfExtent);
+        SatKernel::TriangleSetup nearSetup;
+        if (hits) {
+            nearSetup = SatKernel::setupTriangle(p1, p2, p3, nearExtent);
+        }
 
-    return true;
+        // Test the triangle against one z row of cells at a time
+        size_t rowLength = range.last[2] - range.first[2];
+        scratch.minX.assign(rowLength, mGridX[i]);
+        scratch.minZ.assign(mGridZ.begin() + range.first[2], mGridZ.begin() + range.last[2]);
+        scratch.hits.resize(rowLength);
+        scratch.nearHits.resize(rowLength);
+        for (size_t j = range.first[1]; j < range.last[1]; j++) {
+            scratch.minY.assign(rowLength, mGridY[j]);
+            SatKernel::triangleIntersectsBoxes(setup, scratch.minX.data(), scratch.minY.data(), scratch.minZ.data(), rowLength, mVoxelSize, scratch.hits.data(), mOptions.vectorize);
+            if (hits) {
+                SatKernel::triangleIntersectsBoxes(nearSetup, scratch.minX.data(), scratch.minY.data(), scratch.minZ.data(), rowLength, mVoxelSize, scratch.nearHits.data(), mOptions.vectorize);
+            }
+            for (size_t k = 0; k < rowLength; k++) {
+                size_t cell = cellIndex(j, range.first[2] + k);
+                if (scratch.hits[k]) {
+                    scratch.layer[cell / 64] |= 1ULL << (cell % 64);
+                }
+                // The widened boxes hold the exact ones, so every touching cell is listed
+                if (hits && scratch.nearHits[k]) {
+                    hits->push_back({ cell, scratch.hits[k] ? triangles[n] : ~triangles[n] });
+                }
+            }
+        }
+    }
+}
+
+bool Voxelizer::intersectsAnyTriangle(const Point3D& voxelCorner) {
+    // Outside a cell-driven run neither the setups nor the bins may exist yet
+    if (mTriangleSetupSize != mVoxelSize) {
+        makeTriangles();
+    }
+    if (mOptions.acceleration == VoxelizerOptions::Acceleration::UniformGrid && mTriangleGrid.empty()) {
+        mTriangleGrid.build(mMesh);
+    }
+    return intersectsAnyTriangle(voxelCorner, mScratch);
+}
+
+bool Voxelizer::intersectsAnyTriangle(const Point3D& voxelCorner, Scratch& scratch) {
+    Point3D voxelMax = voxelCorner + Point3D(mVoxelSize, mVoxelSize, mVoxelSize);
+    if (mOptions.acceleration == VoxelizerOptions::Acceleration::UniformGrid) {
+        // Only the triangles binned around the voxel can touch it
+        mTriangleGrid.query(voxelCorner, voxelMax, scratch.candidates);
+        return SatKernel::boxIntersectsAny(voxelCorner, voxelMax, mTriangleSetups.data(), scratch.candidates.data(), scratch.candidates.size(), mOptions.vectorize);
+    }
+
+    // Test the voxel against every triangle of the mesh
+    return SatKernel::boxIntersectsAny(voxelCorner, voxelMax, mTriangleSetups.data(), nullptr, mTriangleSetups.size(), mOptions.vectorize);
+}
+
+bool Voxelizer::triangleIntersectsVoxel(const Point3D& voxelCorner, const Point3D& p1, const Point3D& p2, const Point3D& p3, double voxelSize) {
+    // The cube test of the voxelization runs
+    const float size = static_cast<float>(voxelSize);
+    const float half = static_cast<float>(voxelSize * 0.5);
+    SatKernel::TriangleSetup setup = SatKernel::setupTriangle(toVec3f(p1), toVec3f(p2), toVec3f(p3), { half, half, half });
+    Vec3f lower = toVec3f(voxelCorner);
+    Vec3f upper = lower + Vec3f{ size, size, size };
+    return SatKernel::boxIntersectsTriangle(setup, (lower + upper) * 0.5f);
+}
+
+bool Voxelizer::aabbIntersectsTriangle(const Point3D& min, const Point3D& max, const Point3D& p1, const Point3D& p2, const Point3D& p3) {
+    // Compute AABB center and extents in single precision, like the batched tests
+    Vec3f lower = toVec3f(min);
+    Vec3f upper = toVec3f(max);
+    Vec3f c = (lower + upper) * 0.5f;
+    Vec3f e = (upper - lower) * 0.5f;
+
+    // Separating axis test of the 9 edge cross products, the 3 box faces and the triangle face
+    return SatKernel::boxIntersectsTriangle(SatKernel::setupTriangle(toVec3f(p1), toVec3f(p2), toVec3f(p3), e), c);
 }
 
 void Voxelizer::makeCubes(std::string fileName)
 {
     // Read the STL file to get vertices, colors, and normals
-    IOOperation::STLReader reader(fileName, mV, mC, mN);
+    IOOperation::STLReader reader(fileName, mMesh, mOptions.threadCount);
+    if (cancelled()) {
+        return;
+    }
+    if (mOptions.traversal == VoxelizerOptions::Traversal::CellDriven && mOptions.acceleration == VoxelizerOptions::Acceleration::UniformGrid) {
+        mTriangleGrid.build(mMesh);
+    }
 
-    // Clear existing vertices and colors before voxelizing
-    mVertices.clear();
-    mColors.clear();
+    // Clear existing vertices before voxelizing
+    clearGeometry();
 
     // Create bounding box grid and fill triangles
-    createBoundingBoxGrid(mV);
+    createBoundingBoxGrid(mMesh);
 }
 
-void Voxelizer::setVoxelSize(int inVoxelSize)
+void Voxelizer::makeTriangles()
+{
+    // The cell-driven tests meet every triangle many times, so each is set up once for the voxel size
+    const float half = static_cast<float>(mVoxelSize * 0.5);
+    mTriangleSetups.resize(mMesh.triangleCount());
+    ThreadPool pool(mOptions.threadCount);
+    const size_t chunkSize = 4096;
+    pool.run((mTriangleSetups.size() + chunkSize - 1) / chunkSize, [&](size_t chunk, int) {
+        size_t end = std::min(mTriangleSetups.size(), (chunk + 1) * chunkSize);
+        for (size_t t = chunk * chunkSize; t < end; t++) {
+            mTriangleSetups[t] = SatKernel::setupTriangle(toVec3f(mMesh.cornerPosition(t, 0)), toVec3f(mMesh.cornerPosition(t, 1)), toVec3f(mMesh.cornerPosition(t, 2)), { half, half, half });
+        }
+    });
+    mTriangleSetupSize = mVoxelSize;
+}
+
+void Voxelizer::setVoxelSize(double inVoxelSize)
 {
     // Setter method for the voxel size
     mVoxelSize = inVoxelSize;
 }
 
-void Voxelizer::addCube(const Point3D& voxelCorner, int voxelSize)
+void Voxelizer::setOptions(const VoxelizerOptions& inOptions)
 {
-    float xMin = floor(voxelCorner.x());
-    float yMin = floor(voxelCorner.y());
-    float zMin = floor(voxelCorner.z());
+    // Setter method for the run settings; the triangle bins are built on first use
+    if (inOptions.meshing != mOptions.meshing || inOptions.coarseLevel != mOptions.coarseLevel) {
+        clearGeometry();
+    }
+    mOptions = inOptions;
+    if (mOptions.traversal == VoxelizerOptions::Traversal::CellDriven && mOptions.acceleration == VoxelizerOptions::Acceleration::UniformGrid && mTriangleGrid.empty()) {
+        mTriangleGrid.build(mMesh);
+    }
+}
 
-    xMin = abs(xMin) > voxelSize ? xMin - (int(xMin) % voxelSize) : 0;
-    yMin = abs(yMin) > voxelSize ? yMin - (int(yMin) % voxelSize) : 0;
-    zMin = abs(zMin) > voxelSize ? zMin - (int(zMin) % voxelSize) : 0;
-    float xMax = xMin + voxelSize;
-    float yMax = yMin + voxelSize;
-    float zMax = zMin + voxelSize;
+void Voxelizer::addCube(const Point3D& lower, const Point3D& upper, std::vector<float>& vertices) const
+{
+    double xMin = lower.x();
+    double yMin = lower.y();
+    double zMin = lower.z();
+    double xMax = upper.x();
+    double yMax = upper.y();
+    double zMax = upper.z();
 
     // Add vertices for each face of the cube
 
     // Front face
-    addQuad(Point3D(xMin, yMin, zMin), Point3D(xMax, yMin, zMin), Point3D(xMax, yMax, zMin), Point3D(xMin, yMax, zMin));
+    addQuad(Point3D(xMin, yMin, zMin), Point3D(xMax, yMin, zMin), Point3D(xMax, yMax, zMin), Point3D(xMin, yMax, zMin), vertices);
 
     // Right side face
-    addQuad(Point3D(xMax, yMin, zMin), Point3D(xMax, yMax, zMin), Point3D(xMax, yMax, zMax), Point3D(xMax, yMin, zMax));
+    addQuad(Point3D(xMax, yMin, zMin), Point3D(xMax, yMax, zMin), Point3D(xMax, yMax, zMax), Point3D(xMax, yMin, zMax), vertices);
 
     // Back face
-    addQuad(Point3D(xMax, yMax, zMax), Point3D(xMax, yMin, zMax), Point3D(xMin, yMin, zMax), Point3D(xMin, yMax, zMax));
+    addQuad(Point3D(xMax, yMax, zMax), Point3D(xMax, yMin, zMax), Point3D(xMin, yMin, zMax), Point3D(xMin, yMax, zMax), vertices);
 
     // Left face
-    addQuad(Point3D(xMin, yMin, zMax), Point3D(xMin, yMax, zMax), Point3D(xMin, yMax, zMin), Point3D(xMin, yMin, zMin));
+    addQuad(Point3D(xMin, yMin, zMax), Point3D(xMin, yMax, zMax), Point3D(xMin, yMax, zMin), Point3D(xMin, yMin, zMin), vertices);
 
     // Top face
-    addQuad(Point3D(xMin, yMax, zMin), Point3D(xMax, yMax, zMin), Point3D(xMax, yMax, zMax), Point3D(xMin, yMax, zMax));
+    addQuad(Point3D(xMin, yMax, zMin), Point3D(xMax, yMax, zMin), Point3D(xMax, yMax, zMax), Point3D(xMin, yMax, zMax), vertices);
 
     // Bottom face
-    addQuad(Point3D(xMin, yMin, zMin), Point3D(xMax, yMin, zMin), Point3D(xMax, yMin, zMax), Point3D(xMin, yMin, zMax));
+    addQuad(Point3D(xMin, yMin, zMin), Point3D(xMax, yMin, zMin), Point3D(xMax, yMin, zMax), Point3D(xMin, yMin, zMax), vertices);
 }
 
-void Voxelizer::addQuad(const Point3D& p1, const Point3D& p2, const Point3D& p3, const Point3D& p4)
+void Voxelizer::addQuad(const Point3D& p1, const Point3D& p2, const Point3D& p3, const Point3D& p4, std::vector<float>& vertices) const
 {
-    // Add vertices for a quad and assign colors
+    // Add vertices for a quad
 
     // Vertices
-    mVertices.push_back(p1.x());
-    mVertices.push_back(p1.y());
-    mVertices.push_back(p1.z());
+    vertices.push_back(p1.x());
+    vertices.push_back(p1.y());
+    vertices.push_back(p1.z());
 
-    mVertices.push_back(p2.x());
-    mVertices.push_back(p2.y());
-    mVertices.push_back(p2.z());
+    vertices.push_back(p2.x());
+    vertices.push_back(p2.y());
+    vertices.push_back(p2.z());
 
-    mVertices.push_back(p3.x());
-    mVertices.push_back(p3.y());
-    mVertices.push_back(p3.z());
+    vertices.push_back(p3.x());
+    vertices.push_back(p3.y());
+    vertices.push_back(p3.z());
 
-    mVertices.push_back(p4.x());
-    mVertices.push_back(p4.y());
-    mVertices.push_back(p4.z());
+    vertices.push_back(p4.x());
+    vertices.push_back(p4.y());
+    vertices.push_back(p4.z());
 }
\ No newline at end of file
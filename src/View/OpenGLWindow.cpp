@@ -1,5 +1,6 @@
 #include <QMouseEvent>
 #include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLPaintDevice>
 #include <QOpenGLShaderProgram>
 #include <QPainter>
@@ -10,6 +11,7 @@
 #include <ostream>
 #include <string>
 #include <cmath>
+#include <algorithm>
 #include <QColorDialog>
 #include "Model/stdafx.h"
 #include "View/OpenGLWindow.h"
@@ -20,6 +22,7 @@
 
 OpenGLWindow::OpenGLWindow(const QColor& background, QWidget* parent)
 	: mBackground(background), renderSTL(false),
+	mIndexBuffer(QOpenGLBuffer::IndexBuffer),
 	mMatrixUniform(-1),
 	mNormalAttr(-1),
 	mVertexAttr(-1)
@@ -41,58 +44,291 @@ void OpenGLWindow::reset()
 	makeCurrent();
 	delete mProgram;
 	mProgram = nullptr;
+	delete mInstanceProgram;
+	mInstanceProgram = nullptr;
 	delete mVshader;
 	mVshader = nullptr;
 	delete mFshader;
 	mFshader = nullptr;
+	mVao.destroy();
 	mVbo.destroy();
+	mIndexBuffer.destroy();
+	mInstanceVao.destroy();
+	mCubeBuffer.destroy();
+	mFrameQuery.destroy();
+	destroyChunks(mFine);
+	destroyChunks(mCoarse);
 	doneCurrent();
 }
 
+void OpenGLWindow::uploadGeometry()
+{
+	if (!mVbo.isCreated())
+	{
+		mVbo.create();
+		mIndexBuffer.create();
+		mVao.create();
+	}
+
+	// glBufferData takes sizes beyond the int range of QOpenGLBuffer::allocate
+	size_t vertexFloats = mVertices ? mVertices->size() : 0;
+	mVbo.bind();
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertexFloats * sizeof(float)), mVertices ? mVertices->data() : nullptr, GL_STATIC_DRAW);
+	mIndexBuffer.bind();
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(mIndices.size() * sizeof(unsigned int)), mIndices.data(), GL_STATIC_DRAW);
+	mVbo.release();
+	mIndexBuffer.release();
+	mIndexCount = static_cast<int>(mIndices.size());
+	if (mVao.isCreated())
+	{
+		mVao.bind();
+		bindAttributes();
+		mVao.release();
+	}
+
+	// Cells are only drawn where the context can instance the unit cube
+	mInstanced = mVoxels.cells && mInstancing;
+	uploadChunks(mVoxels, mFine);
+	if (mVoxels.coarse)
+	{
+		uploadChunks(*mVoxels.coarse, mCoarse);
+	}
+	else
+	{
+		destroyChunks(mCoarse);
+	}
+
+	// The buffers hold the geometry from now on; the CPU copy is freed once nobody else shares it
+	mVertices.reset();
+	mVoxels = VoxelGeometry();
+	std::vector<unsigned int>().swap(mIndices);
+	mGeometryChanged = false;
+}
+
+void OpenGLWindow::uploadChunks(const VoxelGeometry& geometry, ChunkLevel& level)
+{
+	destroyChunks(level);
+	level.origin = QVector3D(geometry.origin.x(), geometry.origin.y(), geometry.origin.z());
+	level.cellSize = static_cast<float>(geometry.voxelSize);
+
+	// A quad is four vertices of three floats, a cell four 16-bit indices
+	const char* data = nullptr;
+	size_t elementBytes = 0;
+	int elementCount = 0;
+	if (mInstanced && geometry.cells)
+	{
+		data = reinterpret_cast<const char*>(geometry.cells->data());
+		elementBytes = 4 * sizeof(unsigned short);
+		elementCount = 1;
+	}
+	else if (!mInstanced && geometry.vertices)
+	{
+		data = reinterpret_cast<const char*>(geometry.vertices->data());
+		elementBytes = 12 * sizeof(float);
+		elementCount = 4;
+	}
+	if (data == nullptr || !geometry.chunks)
+	{
+		return;
+	}
+
+	const std::vector<VoxelChunk>& chunks = *geometry.chunks;
+	level.chunks.resize(chunks.size());
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		const VoxelChunk& chunk = chunks[c];
+		ChunkBuffer& buffer = level.chunks[c];
+		buffer.buffer.create();
+		buffer.buffer.bind();
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(chunk.count * elementBytes), data + chunk.first * elementBytes, GL_STATIC_DRAW);
+		buffer.buffer.release();
+		buffer.min = QVector3D(chunk.min[0], chunk.min[1], chunk.min[2]);
+		buffer.max = QVector3D(chunk.max[0], chunk.max[1], chunk.max[2]);
+		buffer.count = static_cast<int>(chunk.count) * elementCount;
+	}
+}
+
+void OpenGLWindow::destroyChunks(ChunkLevel& level)
+{
+	for (ChunkBuffer& chunk : level.chunks)
+	{
+		chunk.buffer.destroy();
+	}
+	level.chunks.clear();
+}
+
+// Whether a box can show inside the view volume of an orthographic matrix: the box maps to a box in
+// clip space centered on the mapped center, whose half extents are the absolute matrix times those of the box
+static bool boxVisible(const QMatrix4x4& matrix, const QVector3D& min, const QVector3D& max)
+{
+	QVector3D center = matrix.map((min + max) / 2);
+	QVector3D half = (max - min) / 2;
+	for (int row = 0; row < 3; row++)
+	{
+		float extent = std::abs(matrix(row, 0)) * half.x() + std::abs(matrix(row, 1)) * half.y() + std::abs(matrix(row, 2)) * half.z();
+		if (std::abs(center[row]) - extent > 1.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void OpenGLWindow::drawChunks(const ChunkLevel& level, const QMatrix4x4& matrix)
+{
+	for (const ChunkBuffer& chunk : level.chunks)
+	{
+		if (!boxVisible(matrix, chunk.min, chunk.max))
+		{
+			continue;
+		}
+		QOpenGLBuffer buffer = chunk.buffer;
+		buffer.bind();
+		if (mInstanced)
+		{
+			// Attribute 1 of the instance VAO takes the cells from the buffer of the chunk
+			glVertexAttribPointer(1, 3, GL_UNSIGNED_SHORT, GL_FALSE, 4 * sizeof(unsigned short), nullptr);
+			context()->extraFunctions()->glDrawArraysInstanced(GL_TRIANGLES, 0, 36, chunk.count);
+		}
+		else
+		{
+			glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+			glDrawArrays(GL_QUADS, 0, chunk.count);
+		}
+		buffer.release();
+	}
+}
+
+void OpenGLWindow::bindAttributes()
+{
+	mVbo.bind();
+	mIndexBuffer.bind();
+	glEnableVertexAttribArray(m_posAttr);
+	glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+}
+
 void OpenGLWindow::paintGL()
 {
 	// Paint OpenGL scene
+	beginFrameTiming();
 	glClearColor(0.9f, 0.7f, 0.6f, 1.0f); 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Bind shader program
-	mProgram->bind();
+	// Geometry is copied to the GPU once when it changes, not on every frame
+	if (mGeometryChanged)
+	{
+		uploadGeometry();
+	}
 
 	// Set up transformation matrix
 	QMatrix4x4 matrix;
 	matrix.ortho(-30.0f * zoomFactor, 30.0f * zoomFactor, -30.0f * zoomFactor, 30.0f * zoomFactor, -100.0f, 100.0f * zoomFactor);
 	matrix.translate(0, 0, -62);
 	matrix.rotate(rotationAngle);
+
+	// The view spans 60 * zoomFactor units; once a cell gets smaller than a pixel the coarse level looks the same
+	const ChunkLevel* level = &mFine;
+	float pixelsPerUnit = std::min(width(), height()) / (60.0f * zoomFactor);
+	if (!mCoarse.chunks.empty() && mFine.cellSize * pixelsPerUnit < 1.0f)
+	{
+		level = &mCoarse;
+	}
+
+	if (!renderSTL && mInstanced)
+	{
+		// Render voxel data as one unit cube per cell, scaled and moved onto the cell by the vertex shader
+		mInstanceProgram->bind();
+		mInstanceProgram->setUniformValue("matrix", matrix);
+		mInstanceProgram->setUniformValue("origin", level->origin);
+		mInstanceProgram->setUniformValue("voxelSize", level->cellSize);
+		mInstanceProgram->setUniformValue("r", r);
+		mInstanceProgram->setUniformValue("g", g);
+		mInstanceProgram->setUniformValue("b", b);
+		mInstanceVao.bind();
+		drawChunks(*level, matrix);
+		mInstanceVao.release();
+		mInstanceProgram->release();
+		endFrameTiming();
+		return;
+	}
+
+	// Bind shader program
+	mProgram->bind();
 	mProgram->setUniformValue(m_matrixUniform, matrix);
 	mProgram->setUniformValue("r", r);
 	mProgram->setUniformValue("g", g);
 	mProgram->setUniformValue("b", b);
 
-	// Enable vertex and color attributes
-	glEnableVertexAttribArray(m_posAttr);
-	glEnableVertexAttribArray(m_colAttr);
+	// The vertex array object holds the attribute setup; without one it is repeated every frame
+	if (mVao.isCreated())
+	{
+		mVao.bind();
+	}
+	else if (mVbo.isCreated())
+	{
+		bindAttributes();
+	}
 
-	// Render depending on the mode (STL or voxel)
+	// Render depending on the mode (STL or voxel); the color comes from the r, g, b uniforms
 	if (renderSTL)
 	{
-		// Render STL file (wireframe)
-		glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, mVertices.data());
-		glVertexAttribPointer(m_colAttr, 3, GL_FLOAT, GL_FALSE, 0, mColors.data());
-
-		glDrawArrays(GL_LINE_LOOP, 0, mVertices.size() / 3);
+		// Render STL file (wireframe of the shared vertices)
+		glDrawElements(GL_LINES, mIndexCount, GL_UNSIGNED_INT, nullptr);
 	}
 	else
 	{
-		// Render voxel data (solid)
-		glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, mVertices.data());
-		glVertexAttribPointer(m_colAttr, 3, GL_FLOAT, GL_FALSE, 0, mColors.data());
+		// Render voxel data (solid), chunk by chunk; chunks outside the view are skipped
+		drawChunks(*level, matrix);
+	}
 
-		glDrawArrays(GL_QUADS, 0, mVertices.size() / 3);
+	if (mVao.isCreated())
+	{
+		mVao.release();
+	}
+	else if (mVbo.isCreated())
+	{
+		glDisableVertexAttribArray(m_posAttr);
+		mVbo.release();
+		mIndexBuffer.release();
+	}
+	endFrameTiming();
+}
+
+void OpenGLWindow::beginFrameTiming()
+{
+	// Without timer queries the interval between frames is all there is to report
+	if (!mFrameQuery.isCreated())
+	{
+		if (mFrameInterval.isValid())
+		{
+			emit frameTimed(mFrameInterval.nsecsElapsed() / 1e6);
+		}
+		mFrameInterval.start();
+		return;
+	}
+
+	// The query of an earlier frame is only read once the GPU is done with it, so the CPU never waits; until then
+	// frames go untimed, since only one query can be pending
+	if (mFrameQueryPending && mFrameQuery.isResultAvailable())
+	{
+		emit frameTimed(mFrameQuery.waitForResult() / 1e6);
+		mFrameQueryPending = false;
 	}
+	if (!mFrameQueryPending)
+	{
+		mFrameQuery.begin();
+		mFrameTiming = true;
+	}
+}
 
-	// Disable vertex and color attributes
-	glDisableVertexAttribArray(m_colAttr);
-	glDisableVertexAttribArray(m_posAttr);
+void OpenGLWindow::endFrameTiming()
+{
+	if (mFrameTiming)
+	{
+		mFrameQuery.end();
+		mFrameTiming = false;
+		mFrameQueryPending = true;
+	}
 }
 
 static const char* vertexShaderSource =
@@ -113,6 +349,38 @@ static const char* fragmentShaderSource =
 "gl_FragColor = vec4(r, g, b, 1.0);\n"
 "}";
 
+// Instanced voxels: attribute 0 is a corner of the unit cube, attribute 1 the cell index of the instance
+static const char* instanceVertexShaderSource =
+"#version 330\n"
+"layout(location = 0) in vec3 corner;\n"
+"layout(location = 1) in vec3 cell;\n"
+"uniform mat4 matrix;\n"
+"uniform vec3 origin;\n"
+"uniform float voxelSize;\n"
+"void main() {\n"
+"   gl_Position = matrix * vec4(origin + (cell + corner) * voxelSize, 1.0);\n"
+"}\n";
+
+static const char* instanceFragmentShaderSource =
+"#version 330\n"
+"uniform float r;\n"
+"uniform float g;\n"
+"uniform float b;\n"
+"out vec4 color;\n"
+"void main() {\n"
+"   color = vec4(r, g, b, 1.0);\n"
+"}\n";
+
+// Two triangles per face of the unit cube
+static const float unitCube[] = {
+	0, 0, 0, 0, 1, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 1, 0, 0,
+	0, 0, 1, 1, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1, 1,
+	0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 1, 0,
+	1, 0, 0, 1, 1, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1,
+	0, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 1,
+	0, 1, 0, 0, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1, 1, 1, 1, 0,
+};
+
 void OpenGLWindow::initializeGL()
 {
 	// Initialize OpenGL functions
@@ -129,6 +397,35 @@ void OpenGLWindow::initializeGL()
 	m_matrixUniform = mProgram->uniformLocation("matrix");
 	Q_ASSERT(m_matrixUniform != -1);
 
+	// Frames are timed on the GPU where the context has timer queries (OpenGL 3.3 or ARB_timer_query)
+	mFrameQuery.create();
+
+	// Instanced voxels need OpenGL 3.3, which Mesa's llvmpipe also provides on machines without a GPU
+	mInstancing = !context()->isOpenGLES() && context()->format().version() >= qMakePair(3, 3);
+	if (mInstancing)
+	{
+		mInstanceProgram = new QOpenGLShaderProgram(this);
+		mInstancing = mInstanceProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, instanceVertexShaderSource)
+			&& mInstanceProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, instanceFragmentShaderSource)
+			&& mInstanceProgram->link();
+	}
+	if (mInstancing)
+	{
+		mCubeBuffer.create();
+		mCubeBuffer.bind();
+		mCubeBuffer.allocate(unitCube, sizeof(unitCube));
+		mInstanceVao.create();
+		mInstanceVao.bind();
+		mCubeBuffer.bind();
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+		// Attribute 1 is pointed at the cells of each chunk as it is drawn
+		glEnableVertexAttribArray(1);
+		context()->extraFunctions()->glVertexAttribDivisor(1, 1);
+		mInstanceVao.release();
+		mCubeBuffer.release();
+	}
+
 }
 
 QString OpenGLWindow::readShader(QString filePath)
@@ -176,33 +473,48 @@ void OpenGLWindow::wheelEvent(QWheelEvent* event)
 	update();
 }
 
-void OpenGLWindow::voxelRenderer(std::string fileName, int voxelSize)
+void OpenGLWindow::voxelRenderer(std::string fileName, double voxelSize)
+{
+	// Render voxel data
+	// The geometry keeps the quads once the voxelizer is gone
+	Voxelizer::Ptr voxelizer = Voxelizer::getVoxelizer(fileName, voxelSize);
+	showVoxels(voxelizer->geometry());
+}
+
+void OpenGLWindow::showVoxels(const VoxelGeometry& geometry)
 {
 	// Render voxel data
 	renderSTL = false;
-	Voxelizer* Voxelizer = Voxelizer::getVoxelizer(fileName, voxelSize);
-	mVertices = Voxelizer->vertices();
-	mColors = Voxelizer->colors();
+	mVertices.reset();
+	mVoxels = geometry;
+	mIndices.clear();
+	mGeometryChanged = true;
 	update();
 }
 
 void OpenGLWindow::STLRenderer(std::string fileName)
 {
 	// Render STL file
-	mVertices.clear();
-	mColors.clear();
-	mNormals.clear();
+	mVertices.reset();
+	mIndices.clear();
+	mVoxels = VoxelGeometry();
 	update();
 	renderSTL = true;
-	IOOperation::STLReader reader(fileName, mV, mC, mN);
-	GeomContainer* geomContainer = GeomContainer::getContainer(mV);
+	Mesh mesh;
+	IOOperation::STLReader reader(fileName, mesh);
+	std::unique_ptr<GeomContainer> geomContainer = GeomContainer::getContainer(mesh);
 	geomContainer->makeTriangleVertices();
-	mVertices = geomContainer->vertices();
-	mColors = geomContainer->colors();
-	mNormals = geomContainer->normals();
+	mVertices = std::make_shared<const std::vector<float>>(geomContainer->releaseVertices());
+	mIndices = geomContainer->releaseIndices();
+	mGeometryChanged = true;
 	update();
 }
 
+bool OpenGLWindow::supportsInstancing() const
+{
+	return mInstancing;
+}
+
 void OpenGLWindow::selectColor(const QColor& color)
 {
 	QColorDialog colorDialog(this);